@@ -0,0 +1,67 @@
+function pblib_build_codec(source, varargin)
+%pblib_build_codec
+%   function pblib_build_codec(source, varargin)
+%
+%   Compiles a pb_codec_*.cc file, written by protoc --matlab_out with the
+%   codec=generated option, into a mex function in the same directory.  Once
+%   it is there the pb_read_* and pb_write_* functions generated with it parse
+%   and serialize through its compiled code for their messages, which is
+%   faster than pblib_mex_codec.  pblib_build_mex must have been run, the
+%   generated codec is only used where pblib_mex_codec would be.
+%
+%   The support code is taken from the src directory next to protobuflib, as
+%   for pblib_build_mex.  Any further arguments are passed on to mex, e.g.
+%   pblib_build_codec('out/pb_codec_foo.cc', '-g') for a debug build.
+%
+%   See also pblib_build_mex, pblib_mex_available.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  lib_dir = fileparts(mfilename('fullpath'));
+  src_dir = fullfile(lib_dir, '..', 'src');
+  codec_dir = fullfile(src_dir, 'farsounder', 'protobuf', 'matlab');
+  out_dir = fileparts(source);
+  if isempty(out_dir)
+    out_dir = pwd;
+  end
+  libs = {};
+  if isunix()
+    % parallel.cc uses pthreads, Windows threads need no extra library.
+    libs = {'-lpthread'};
+  end
+  mex('-largeArrayDims', ['-I' src_dir], '-outdir', out_dir, varargin{:}, ...
+      source, ...
+      fullfile(codec_dir, 'generated_codec.cc'), ...
+      fullfile(codec_dir, 'codec.cc'), ...
+      fullfile(codec_dir, 'varint.cc'), ...
+      fullfile(codec_dir, 'parallel.cc'), libs{:});
+  % The generated functions look for the codec once per session.
+  clear('functions');
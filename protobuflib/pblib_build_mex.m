@@ -0,0 +1,68 @@
+function pblib_build_mex(varargin)
+%pblib_build_mex
+%   function pblib_build_mex(varargin)
+%
+%   Compiles the pblib_mex_codec mex function into the protobuflib directory.
+%   Once it is there the generated pb_read_* and pb_write_* functions parse and
+%   serialize through it instead of the .m code, which is much faster.
+%
+%   The sources are taken from the src directory next to protobuflib, as laid
+%   out in the protobuf-matlab source tree.  Any arguments are passed on to mex,
+%   e.g. pblib_build_mex('-g') for a debug build.  The packed varint decoder
+%   uses SSE2 whenever the compiler targets it and AVX2 and BMI2 when enabled,
+%   e.g. pblib_build_mex('CXXFLAGS=$CXXFLAGS -march=native') with gcc or clang.
+%
+%   See also pblib_mex_available.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  lib_dir = fileparts(mfilename('fullpath'));
+  src_dir = fullfile(lib_dir, '..', 'src');
+  codec_dir = fullfile(src_dir, 'farsounder', 'protobuf', 'matlab');
+  libs = {};
+  if isunix()
+    % parallel.cc and prefetch_reader.cc use pthreads, Windows threads need
+    % no extra library.
+    libs = {'-lpthread'};
+    if ~ismac()
+      % shm_open of ring_buffer.cc is in librt with older glibc.
+      libs{end + 1} = '-lrt';
+    end
+  end
+  mex('-largeArrayDims', ['-I' src_dir], '-outdir', lib_dir, varargin{:}, ...
+      fullfile(codec_dir, 'pblib_mex_codec.cc'), ...
+      fullfile(codec_dir, 'codec.cc'), ...
+      fullfile(codec_dir, 'varint.cc'), ...
+      fullfile(codec_dir, 'mapped_file.cc'), ...
+      fullfile(codec_dir, 'parallel.cc'), ...
+      fullfile(codec_dir, 'prefetch_reader.cc'), ...
+      fullfile(codec_dir, 'ring_buffer.cc'), libs{:});
+  pblib_mex_available(true);
@@ -0,0 +1,55 @@
+function pblib_clear_descriptor_cache(varargin)
+%pblib_clear_descriptor_cache
+%   function pblib_clear_descriptor_cache(varargin)
+%
+%   The generated pb_descriptor_* functions build their descriptor once and
+%   return it from a cache afterwards.  Without arguments, this rebuilds the
+%   cached descriptor of every pb_descriptor_* function currently in memory.
+%   Otherwise only the given descriptor functions are rebuilt, passed as
+%   names or function handles, e.g.
+%     pblib_clear_descriptor_cache(@pb_descriptor_foo, 'pb_descriptor_bar');
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (nargin == 0)
+    loaded = inmem();
+    descriptor_functions = loaded(strncmp(loaded, 'pb_descriptor_', 14));
+  else
+    descriptor_functions = varargin;
+  end
+  for i=1:length(descriptor_functions)
+    descriptor_function = descriptor_functions{i};
+    if (isa(descriptor_function, 'function_handle'))
+      descriptor_function(true);
+    else
+      feval(descriptor_function, true);
+    end
+  end
@@ -0,0 +1,78 @@
+function [msgs] = pblib_columns_to_struct(columns, descriptor_function)
+%pblib_columns_to_struct
+%   function [msgs] = pblib_columns_to_struct(columns, descriptor_function)
+%
+%   Converts a repeated message field read as columns back into a struct array
+%   of messages.  The generator option repeated_messages=columns makes the read
+%   functions store repeated fields of messages whose fields are all singular
+%   and numeric as one struct with a row vector per field, element j of each
+%   row being the value in message j.  The serializers call this to write such
+%   fields, and it's useful for code that wants the messages one at a time.
+%
+%   INPUTS:
+%     columns             : struct with a row vector for every field of the
+%                           message, all of the same length
+%     descriptor_function : the pb_descriptor_* function of the message
+%
+%   OUTPUTS:
+%     msgs : 1xN struct array of messages with every field set
+%
+%   See also pblib_generic_parse_from_string, pblib_generic_serialize_to_string.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+%   Support function used by Protobuf compiler generated .m files.
+
+  descriptor = descriptor_function();
+  names = {descriptor.fields.name};
+  count = length(columns.(names{1}));
+  for i=2:length(names)
+    if (length(columns.(names{i})) ~= count)
+      error('proto:pblib_columns_to_struct:length_mismatch', ...
+            ['Column ' names{i} ' of ' descriptor.full_name ...
+             ' has a different length than column ' names{1}]);
+    end
+  end
+  if (count == 0)
+    msgs = struct([]);
+    return;
+  end
+
+  % struct expands the cell arrays into the elements of a struct array, scalar
+  % cells are shared by all of them
+  args = cell(1, 2 * length(names) + 6);
+  args(1 : 2) = {'has_field', {true(1, length(names))}};
+  for i=1:length(names)
+    args(2 * i + 1 : 2 * i + 2) = {names{i}, num2cell(columns.(names{i}))};
+  end
+  args(end - 3 : end) = {'unknown_fields', {[]}, ...
+                         'descriptor_function', {descriptor_function}};
+  msgs = struct(args{:});
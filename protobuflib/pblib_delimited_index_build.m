@@ -0,0 +1,139 @@
+function [index] = pblib_delimited_index_build(filename, index)
+%pblib_delimited_index_build
+%   index = pblib_delimited_index_build(filename, index)
+%
+%   Scans a file of length delimited messages, as written by
+%   pblib_delimited_writer_write, and saves the offset and length of every
+%   message to the side-car index file [filename '.idx'].  Only the length
+%   prefixes are read, the messages themselves are skipped over.
+%
+%   The index file holds the characters 'PBIX', then the version, the number
+%   of messages, the number of bytes of the data file covered and the size of
+%   the fingerprint as uint64s, then the fingerprint, which is that many bytes
+%   from the start of the data file followed by as many from the end of the
+%   covered part, and finally the offsets and the lengths of the messages as
+%   uint64s, all little endian.  pblib_delimited_index_load compares the
+%   fingerprint against the data file to notice when it has been rewritten.
+%
+%   INPUTS:
+%     filename : name of the file of length delimited messages
+%     index    : optional index of the start of the same file, only the
+%                messages appended to the file since are scanned
+%
+%   OUTPUTS:
+%     index    : struct with the fields filename, offsets, lengths and
+%                data_size.  offsets(i) is the file offset of the first byte of
+%                message i, after its length prefix, lengths(i) its length in
+%                bytes and data_size the number of bytes of the file covered.
+%
+%   See also pblib_delimited_index_load, pblib_delimited_index_read.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  INDEX_VERSION = 2;
+  CHUNK_SIZE = 1048576;
+  FINGERPRINT_SIZE = 64;
+
+  fid = fopen(filename, 'r');
+  if (fid < 0)
+    error('proto:pblib_delimited_index_build:cannot_open', ...
+          ['Cannot open ' filename ' for reading.']);
+  end
+  fseek(fid, 0, 'eof');
+  file_size = ftell(fid);
+
+  if (nargin < 2)
+    offsets = zeros(1, 1024);
+    lengths = zeros(1, 1024);
+    count = 0;
+    position = 0;
+  else
+    offsets = index.offsets;
+    lengths = index.lengths;
+    count = length(offsets);
+    position = index.data_size;
+  end
+
+  while (position < file_size)
+    fseek(fid, position, 'bof');
+    chunk = fread(fid, CHUNK_SIZE, '*uint8')';
+    chunk_end = length(chunk);
+    num_read = 0;
+    while (num_read < chunk_end)
+      prefix_end = find(chunk(num_read + 1 : min(num_read + 10, chunk_end)) < 128, 1);
+      if (isempty(prefix_end))
+        if (position + chunk_end < file_size)
+          % the length prefix continues in the next chunk
+          break;
+        end
+        fclose(fid);
+        error('proto:pblib_delimited_index_build:truncated', ...
+              'The file ends in the middle of a message length.');
+      end
+      [msg_len, len_len] = pblib_read_varint64(chunk, num_read + 1);
+      count = count + 1;
+      if (count > length(offsets))
+        offsets(2 * count) = 0;
+        lengths(2 * count) = 0;
+      end
+      offsets(count) = position + num_read + len_len;
+      lengths(count) = double(msg_len);
+      num_read = num_read + len_len + lengths(count);
+    end
+    % messages that continue past the chunk are skipped with the fseek
+    position = position + num_read;
+  end
+  if (position > file_size)
+    fclose(fid);
+    error('proto:pblib_delimited_index_build:truncated', ...
+          'The file ends in the middle of a message.');
+  end
+  fingerprint_size = min(FINGERPRINT_SIZE, position);
+  fingerprint = pblib_delimited_index_fingerprint(fid, position, fingerprint_size);
+  fclose(fid);
+
+  index.filename = filename;
+  index.offsets = offsets(1 : count);
+  index.lengths = lengths(1 : count);
+  index.data_size = position;
+
+  index_filename = [filename '.idx'];
+  fid = fopen(index_filename, 'w', 'ieee-le');
+  if (fid < 0)
+    error('proto:pblib_delimited_index_build:cannot_open', ...
+          ['Cannot open ' index_filename ' for writing.']);
+  end
+  fwrite(fid, uint8('PBIX'), 'uint8');
+  fwrite(fid, [INDEX_VERSION count index.data_size fingerprint_size], 'uint64');
+  fwrite(fid, fingerprint, 'uint8');
+  fwrite(fid, index.offsets, 'uint64');
+  fwrite(fid, index.lengths, 'uint64');
+  fclose(fid);
@@ -0,0 +1,91 @@
+function [index] = pblib_delimited_index_load(filename)
+%pblib_delimited_index_load
+%   index = pblib_delimited_index_load(filename)
+%
+%   Loads the side-car index [filename '.idx'] of a file of length delimited
+%   messages.  The index is built with pblib_delimited_index_build if it
+%   doesn't exist or no longer matches the file, and extended if messages have
+%   been appended to the file since it was built.
+%
+%   INPUTS:
+%     filename : name of the file of length delimited messages
+%
+%   OUTPUTS:
+%     index    : the index, see pblib_delimited_index_build
+%
+%   See also pblib_delimited_index_build, pblib_delimited_index_read.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  INDEX_VERSION = 2;
+
+  file_info = dir(filename);
+  if (isempty(file_info))
+    error('proto:pblib_delimited_index_load:cannot_open', ...
+          ['Cannot find ' filename '.']);
+  end
+
+  fid = fopen([filename '.idx'], 'r', 'ieee-le');
+  if (fid < 0)
+    index = pblib_delimited_index_build(filename);
+    return;
+  end
+  magic = fread(fid, [1 4], 'uint8=>char');
+  header = fread(fid, [1 4], 'uint64');
+  if (~strcmp(magic, 'PBIX') || length(header) < 4 || header(1) ~= INDEX_VERSION ...
+      || header(3) > file_info.bytes)
+    fclose(fid);
+    index = pblib_delimited_index_build(filename);
+    return;
+  end
+  count = header(2);
+  fingerprint = fread(fid, [1 2 * header(4)], '*uint8');
+  index.filename = filename;
+  index.offsets = fread(fid, [1 count], 'uint64');
+  index.lengths = fread(fid, [1 count], 'uint64');
+  index.data_size = header(3);
+  fclose(fid);
+
+  % The data file may have been rewritten since the index was built, so check
+  % that the bytes the index was built from are still there.
+  data_fid = fopen(filename, 'r');
+  if (data_fid < 0)
+    error('proto:pblib_delimited_index_load:cannot_open', ...
+          ['Cannot open ' filename '.']);
+  end
+  current = pblib_delimited_index_fingerprint(data_fid, index.data_size, header(4));
+  fclose(data_fid);
+
+  if (length(index.lengths) < count || ~isequal(fingerprint, current))
+    index = pblib_delimited_index_build(filename);
+  elseif (index.data_size < file_info.bytes)
+    index = pblib_delimited_index_build(filename, index);
+  end
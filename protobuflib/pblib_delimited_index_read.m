@@ -0,0 +1,87 @@
+function [msgs] = pblib_delimited_index_read(index, read_function, message_numbers)
+%pblib_delimited_index_read
+%   msgs = pblib_delimited_index_read(index, read_function, message_numbers)
+%
+%   Reads the messages with the given numbers from a file of length delimited
+%   messages, seeking straight to them with the offsets in index.  Each run of
+%   consecutive message numbers is read from the file in one go and its
+%   messages parsed in place by passing their buffer_start and buffer_end to
+%   read_function.
+%
+%   INPUTS:
+%     index           : index of the file returned by pblib_delimited_index_load
+%                       or pblib_delimited_index_build
+%     read_function   : handle to the generated read function of the messages
+%                       in the file, e.g. @pb_read_test__TestAllTypes
+%     message_numbers : 1 based numbers of the messages to read, e.g. 1000:1099
+%
+%   OUTPUTS:
+%     msgs            : struct array of the messages, in the order of
+%                       message_numbers
+%
+%   See also pblib_delimited_index_load, pblib_delimited_index_build.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (any(message_numbers < 1 | message_numbers > length(index.offsets) ...
+          | message_numbers ~= floor(message_numbers)))
+    error('proto:pblib_delimited_index_read:out_of_range', ...
+          ['Message numbers must be between 1 and ' num2str(length(index.offsets)) '.']);
+  end
+
+  fid = fopen(index.filename, 'r');
+  if (fid < 0)
+    error('proto:pblib_delimited_index_read:cannot_open', ...
+          ['Cannot open ' index.filename ' for reading.']);
+  end
+
+  num_msgs = numel(message_numbers);
+  msgs = cell(1, num_msgs);
+  run_start = 1;
+  for i=1:num_msgs
+    if (i < num_msgs && message_numbers(i + 1) == message_numbers(i) + 1)
+      continue;
+    end
+    first = message_numbers(run_start);
+    last = message_numbers(i);
+    block_start = index.offsets(first);
+    block_end = index.offsets(last) + index.lengths(last);
+    fseek(fid, block_start, 'bof');
+    buffer = fread(fid, block_end - block_start, '*uint8')';
+    for j=run_start:i
+      number = message_numbers(j);
+      msg_start = index.offsets(number) - block_start + 1;
+      msgs{j} = read_function(buffer, msg_start, msg_start + index.lengths(number) - 1);
+    end
+    run_start = i + 1;
+  end
+  fclose(fid);
+  msgs = [msgs{:}];
@@ -0,0 +1,120 @@
+function [msgs, reader] = pblib_delimited_reader_next(reader, max_messages)
+%pblib_delimited_reader_next
+%   [msgs, reader] = pblib_delimited_reader_next(reader, max_messages)
+%
+%   Reads the next max_messages messages from a reader opened with
+%   pblib_delimited_reader_open. Each message is parsed by calling the
+%   reader's read function with the buffer_start and buffer_end of the message
+%   in the reader's buffer, so the message bytes are never copied out of it.
+%   Only the bytes needed for the returned messages, rounded up to whole
+%   chunks, are taken from the file, though a reader with a queue_depth reads
+%   further ahead in the background.
+%
+%   INPUTS:
+%     reader       : reader state returned by pblib_delimited_reader_open or a
+%                    previous call to pblib_delimited_reader_next
+%     max_messages : optional maximum number of messages to read, defaults
+%                    to 1
+%
+%   OUTPUTS:
+%     msgs         : struct array of the messages read, with fewer than
+%                    max_messages elements at the end of the file and empty
+%                    once all messages have been read
+%     reader       : updated reader state to pass to the next call
+%
+%   See also pblib_delimited_reader_open, pblib_delimited_reader_close.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (nargin < 2)
+    max_messages = 1;
+  end
+
+  msgs = cell(1, max_messages);
+  num_msgs = 0;
+  while (num_msgs < max_messages)
+    % A varint length prefix is at most 10 bytes long
+    if (reader.buffer_end - reader.num_read < 10 && ~reader.at_eof)
+      reader = fill_buffer(reader, 10);
+    end
+    if (reader.num_read >= reader.buffer_end)
+      break;
+    end
+    prefix_end = find(reader.buffer(reader.num_read + 1 : ...
+                                    min(reader.num_read + 10, reader.buffer_end)) < 128, 1);
+    if (isempty(prefix_end))
+      error('proto:pblib_delimited_reader_next:truncated', ...
+            'The file ends in the middle of a message length.');
+    end
+    [msg_len, len_len] = pblib_read_varint64(reader.buffer, reader.num_read + 1);
+    msg_len = double(msg_len);
+    if (reader.num_read + len_len + msg_len > reader.buffer_end)
+      reader = fill_buffer(reader, len_len + msg_len);
+      if (len_len + msg_len > reader.buffer_end)
+        error('proto:pblib_delimited_reader_next:truncated', ...
+              'The file ends in the middle of a message.');
+      end
+    end
+    msg_start = reader.num_read + len_len + 1;
+    msg_end = reader.num_read + len_len + msg_len;
+    num_msgs = num_msgs + 1;
+    msgs{num_msgs} = reader.read_function(reader.buffer, msg_start, msg_end);
+    reader.num_read = msg_end;
+  end
+  msgs = [msgs{1 : num_msgs}];
+
+
+function reader = fill_buffer(reader, num_needed)
+% Drops the parsed bytes from the front of the buffer and appends the next
+% chunk of the file, reading more than a chunk if num_needed unparsed bytes
+% wouldn't fit otherwise.
+  num_left = reader.buffer_end - reader.num_read;
+  num_to_read = max(reader.chunk_size, num_needed - num_left);
+  if (isempty(reader.stream))
+    [chunk, count] = fread(reader.fid, num_to_read, '*uint8');
+    chunk = chunk';
+    reader.at_eof = count < num_to_read;
+  else
+    % The background thread reads whole chunks, all but the last one of the
+    % file chunk_size bytes long.
+    chunks = {};
+    count = 0;
+    while (count < num_to_read && ~reader.at_eof)
+      chunks{end + 1} = pblib_mex_codec('stream_next', reader.stream);
+      count = count + numel(chunks{end});
+      reader.at_eof = numel(chunks{end}) < reader.chunk_size;
+    end
+    chunk = [chunks{:}];
+  end
+  reader.buffer = [reader.buffer(reader.num_read + 1 : reader.buffer_end) chunk];
+  reader.buffer_offset = reader.buffer_offset + reader.num_read;
+  reader.buffer_end = num_left + count;
+  reader.num_read = 0;
@@ -0,0 +1,91 @@
+function [reader] = pblib_delimited_reader_open(filename, read_function, chunk_size, queue_depth)
+%pblib_delimited_reader_open
+%   reader = pblib_delimited_reader_open(filename, read_function, chunk_size, queue_depth)
+%
+%   Opens a file of length delimited messages for reading with
+%   pblib_delimited_reader_next. Every message in the file is preceded by its
+%   length encoded as a varint, which is the format written by the C++ and Java
+%   writeDelimitedTo functions. The file is read chunk_size bytes at a time, so
+%   files much larger than memory can be read. With pblib_mex_codec the chunks
+%   are read on a background thread, which keeps up to queue_depth of them
+%   ready while the messages of the current one are parsed, and the operating
+%   system is asked to prefetch the file. Close the reader with
+%   pblib_delimited_reader_close.
+%
+%   INPUTS:
+%     filename      : name of the file to read
+%     read_function : handle to the generated read function of the messages in
+%                     the file, e.g. @pb_read_test__TestAllTypes
+%     chunk_size    : optional number of bytes read from the file at a time,
+%                     defaults to 1048576. Messages larger than chunk_size are
+%                     read whole.
+%     queue_depth   : optional number of chunks read ahead in the background,
+%                     defaults to 2. 0 reads each chunk when it is needed, on
+%                     the calling thread, which is also what happens without
+%                     pblib_mex_codec.
+%
+%   OUTPUTS:
+%     reader        : reader state to pass to pblib_delimited_reader_next
+%
+%   See also pblib_delimited_reader_next, pblib_delimited_reader_close.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (nargin < 3)
+    chunk_size = 1048576;
+  end
+  if (nargin < 4)
+    queue_depth = 2;
+  end
+
+  fid = fopen(filename, 'r');
+  if (fid < 0)
+    error('proto:pblib_delimited_reader_open:cannot_open', ...
+          ['Cannot open ' filename ' for reading.']);
+  end
+
+  reader.stream = [];
+  if (queue_depth > 0 && pblib_mex_available())
+    fclose(fid);
+    fid = -1;
+    reader.stream = pblib_mex_codec('stream_open', filename, chunk_size, queue_depth);
+  end
+  reader.fid = fid;
+  reader.read_function = read_function;
+  reader.chunk_size = chunk_size;
+  % buffer(1 : buffer_end) holds the bytes read from the file but not parsed
+  % yet, starting at file offset buffer_offset. num_read of them have been
+  % consumed.
+  reader.buffer = zeros([1 0], 'uint8');
+  reader.buffer_end = 0;
+  reader.buffer_offset = 0;
+  reader.num_read = 0;
+  reader.at_eof = false;
@@ -0,0 +1,68 @@
+function [writer] = pblib_delimited_writer_open(filename, buffer_size)
+%pblib_delimited_writer_open
+%   writer = pblib_delimited_writer_open(filename, buffer_size)
+%
+%   Opens a file for appending length delimited messages with
+%   pblib_delimited_writer_write. Every message is preceded by its length
+%   encoded as a varint, which is the format read by the C++ and Java
+%   parseDelimitedFrom functions and by pblib_delimited_reader_next. Messages
+%   are collected in a buffer of buffer_size bytes which is written to the file
+%   in one go once it is full. Close the writer with
+%   pblib_delimited_writer_close to write out the rest of the buffer.
+%
+%   INPUTS:
+%     filename    : name of the file to append to, created if it doesn't exist
+%     buffer_size : optional number of bytes collected before writing to the
+%                   file, defaults to 1048576
+%
+%   OUTPUTS:
+%     writer      : writer state to pass to pblib_delimited_writer_write
+%
+%   See also pblib_delimited_writer_write, pblib_delimited_writer_flush,
+%   pblib_delimited_writer_close, pblib_delimited_reader_open.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (nargin < 2)
+    buffer_size = 1048576;
+  end
+
+  fid = fopen(filename, 'a');
+  if (fid < 0)
+    error('proto:pblib_delimited_writer_open:cannot_open', ...
+          ['Cannot open ' filename ' for writing.']);
+  end
+
+  writer.fid = fid;
+  writer.buffer_size = buffer_size;
+  % buffer(1 : num_written) holds the messages not written to the file yet
+  writer.buffer = zeros([1 buffer_size], 'uint8');
+  writer.num_written = 0;
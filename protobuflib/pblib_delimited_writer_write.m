@@ -0,0 +1,65 @@
+function [writer] = pblib_delimited_writer_write(writer, msgs)
+%pblib_delimited_writer_write
+%   writer = pblib_delimited_writer_write(writer, msgs)
+%
+%   Serializes msgs into the writer's buffer, each preceded by its length, and
+%   writes the buffer to the file whenever it fills up.  Pass as many messages
+%   per call as is convenient; the file is written to once per buffer_size
+%   bytes either way.  Call it as writer = pblib_delimited_writer_write(writer,
+%   msgs) so Matlab can fill the buffer in place.
+%
+%   INPUTS:
+%     writer : writer state returned by pblib_delimited_writer_open or a
+%              previous call to pblib_delimited_writer_write
+%     msgs   : a message struct or struct array of messages
+%
+%   OUTPUTS:
+%     writer : updated writer state to pass to the next call
+%
+%   See also pblib_delimited_writer_open, pblib_delimited_writer_flush,
+%   pblib_delimited_writer_close.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  % Take the buffer out of writer so it isn't shared while it's being filled
+  buffer = writer.buffer;
+  writer.buffer = [];
+  num_written = writer.num_written;
+  for i=1:length(msgs)
+    [buffer, num_written] = pblib_generic_serialize_to_buffer(...
+        msgs(i), buffer, num_written, true);
+    if (num_written >= writer.buffer_size)
+      fwrite(writer.fid, buffer(1 : num_written), 'uint8');
+      num_written = 0;
+    end
+  end
+  writer.buffer = buffer;
+  writer.num_written = num_written;
@@ -46,6 +46,10 @@ function [len] = pblib_encoded_field_size(field_value, field_descriptor)
   LABEL_REPEATED = 3;
   switch(field_descriptor.wire_type)
     case 0 % 'varint'
+      if (pblib_mex_available())
+        len = pblib_mex_codec('packed_size', field_value, field_descriptor);
+        return;
+      end
       len = 0;
       for j=1:length(field_value)
         len = len + pblib_encoded_varint_size(...
@@ -59,13 +63,13 @@ function [len] = pblib_encoded_field_size(field_value, field_descriptor)
           if (field_descriptor.label == LABEL_REPEATED)
             len = 0;
             for j=1:length(field_value)
-              temp_len = length(field_value{j});
+              temp_len = value_length(field_value{j});
               len = len + ...
                   pblib_encoded_varint_size(temp_len) + ...
                   temp_len;
             end
           else
-            temp_len = length(field_value);
+            temp_len = value_length(field_value);
             len = pblib_encoded_varint_size(temp_len) + ...
                 temp_len;
           end
@@ -91,3 +95,10 @@ function [len] = pblib_encoded_field_size(field_value, field_descriptor)
   end
 
 
+function [len] = value_length(value)
+  if (isstruct(value))
+    % bytes read lazily, see pblib_get
+    len = value.lazy_end - value.lazy_start + 1;
+  else
+    len = length(value);
+  end
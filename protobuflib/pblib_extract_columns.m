@@ -0,0 +1,136 @@
+function [varargout] = pblib_extract_columns(descriptor_function, field_paths, source)
+%pblib_extract_columns
+%   [column1, column2, ...] = pblib_extract_columns(descriptor_function, field_paths, source)
+%
+%   Reads one column per field path from many messages, without creating the
+%   message structs.  Each path must lead, through singular message fields,
+%   to a singular numeric, enum or bool field, and its column is a row vector
+%   of the Matlab class of that field with one element per message.  Messages
+%   without the field hold its default value.  Only the fields on the paths
+%   are decoded, everything else is skipped over.
+%
+%     [time_us, heading] = pblib_extract_columns(@pb_descriptor_sonar__Ping, ...
+%         {'header.time_us', 'heading'}, 'pings.pb');
+%
+%   INPUTS:
+%     descriptor_function : handle to the generated descriptor function of the
+%                           messages, e.g. @pb_descriptor_test__TestAllTypes
+%     field_paths         : the fields to read, as accepted by
+%                           pblib_field_projection
+%     source              : a cell array of uint8 buffers holding one message
+%                           each, or the name of a file of length delimited
+%                           messages, which is indexed with
+%                           pblib_delimited_index_load
+%
+%   OUTPUTS:
+%     one column per field path
+%
+%   See also pblib_field_projection, pblib_read_fields.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  [projection, field_indices] = pblib_field_projection(descriptor_function, field_paths);
+  descriptor = descriptor_function();
+  if (ischar(source))
+    index = pblib_delimited_index_load(source);
+    buffer_starts = index.offsets + 1;
+    buffer_ends = index.offsets + index.lengths;
+  end
+
+  if (pblib_mex_available())
+    if (ischar(source))
+      columns = pblib_mex_codec('extract_columns', source, descriptor, projection, ...
+                                field_indices, buffer_starts, buffer_ends);
+    else
+      columns = pblib_mex_codec('extract_columns', source, descriptor, projection, ...
+                                field_indices);
+    end
+    varargout = columns;
+    return;
+  end
+
+  % Find the field at the end of each path
+  num_columns = length(field_indices);
+  names = cell(1, num_columns);
+  columns = cell(1, num_columns);
+  if (ischar(source))
+    num_msgs = length(buffer_starts);
+  else
+    num_msgs = numel(source);
+  end
+  for i=1:num_columns
+    level_descriptor = descriptor;
+    names{i} = cell(1, length(field_indices{i}));
+    for j=1:length(field_indices{i})
+      field = level_descriptor.fields(field_indices{i}(j));
+      names{i}{j} = field.name;
+      if (j < length(field_indices{i}))
+        if (field.label == 3) % repeated
+          error('proto:pblib_extract_columns:repeated', ...
+                ['Field ' field.name ' is repeated.']);
+        end
+        level_descriptor = field.descriptor_function();
+      end
+    end
+    if (field.label == 3 || field.matlab_type == 7 || field.matlab_type == 8 || ...
+        field.matlab_type == 9) % repeated, 'string', 'bytes' or 'message'
+      error('proto:pblib_extract_columns:not_numeric', ...
+            ['Field ' field.name ' is not a singular numeric field.']);
+    end
+    columns{i} = repmat(field.default_value, 1, num_msgs);
+  end
+
+  if (ischar(source))
+    mapping = memmapfile(source, 'Format', 'uint8');
+  end
+  for k=1:num_msgs
+    if (ischar(source))
+      buffer = mapping.Data(buffer_starts(k) : buffer_ends(k))';
+    else
+      buffer = source{k};
+    end
+    msg = pblib_generic_parse_from_string(buffer, descriptor, 1, length(buffer), ...
+                                          false, projection);
+    for i=1:num_columns
+      value = msg;
+      for j=1:length(names{i})
+        if (~value.has_field(field_indices{i}(j)))
+          value = [];
+          break;
+        end
+        value = value.(names{i}{j});
+      end
+      if (~isempty(value))
+        columns{i}(k) = value;
+      end
+    end
+  end
+  varargout = columns;
@@ -0,0 +1,125 @@
+function [projection, field_indices] = pblib_field_projection(descriptor_function, field_paths)
+%pblib_field_projection
+%   [projection, field_indices] = pblib_field_projection(descriptor_function, field_paths)
+%
+%   Selects the fields pblib_read_fields reads from a message.  Each path is
+%   either a field name, with the fields of nested messages separated by dots
+%   as in 'header.timestamp', or a vector of field numbers, one per level of
+%   nesting.  A message field given on its own is read whole.  Build the
+%   projection once and pass it to pblib_read_fields for every message rather
+%   than the paths, when reading many messages.
+%
+%   INPUTS:
+%     descriptor_function : handle to the generated descriptor function of the
+%                           message, e.g. @pb_descriptor_test__TestAllTypes
+%     field_paths         : a cell array of paths, a single name or a vector
+%                           of the numbers of top level fields
+%
+%   OUTPUTS:
+%     projection          : struct with a logical row wanted, with one element
+%                           per field of the descriptor, and a cell row
+%                           children holding the projections of the message
+%                           fields of which only some fields are wanted
+%     field_indices       : cell array with the indices into the fields of
+%                           the descriptor at each level of each path
+%
+%   See also pblib_read_fields.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (ischar(field_paths))
+    field_paths = {field_paths};
+  elseif (isnumeric(field_paths))
+    field_paths = num2cell(field_paths);
+  end
+
+  descriptor = descriptor_function();
+  field_indices = cell(1, numel(field_paths));
+  for i=1:numel(field_paths)
+    if (ischar(field_paths{i}))
+      path = regexp(field_paths{i}, '\.', 'split');
+    else
+      path = num2cell(field_paths{i});
+    end
+    field_indices{i} = zeros(1, length(path));
+    level_descriptor = descriptor;
+    for j=1:length(path)
+      if (j > 1)
+        field = level_descriptor.fields(field_indices{i}(j - 1));
+        if (field.matlab_type ~= 9) % 'message'
+          error('proto:pblib_field_projection:not_a_message', ...
+                ['Field ' field.name ' of ' level_descriptor.full_name ...
+                 ' is not a message.']);
+        end
+        level_descriptor = field.descriptor_function();
+      end
+      field_indices{i}(j) = find_field(level_descriptor, path{j});
+    end
+  end
+  projection = make_projection(descriptor, field_indices);
+
+
+function [projection] = make_projection(descriptor, field_indices)
+  num_fields = length(descriptor.fields);
+  projection.wanted = false(1, num_fields);
+  projection.children = cell(1, num_fields);
+  whole = false(1, num_fields);
+  child_indices = cell(1, num_fields);
+  for i=1:length(field_indices)
+    index = field_indices{i}(1);
+    projection.wanted(index) = true;
+    if (length(field_indices{i}) == 1)
+      whole(index) = true;
+    else
+      child_indices{index}{end + 1} = field_indices{i}(2 : end);
+    end
+  end
+  for index=find(projection.wanted & ~whole)
+    projection.children{index} = make_projection(...
+        descriptor.fields(index).descriptor_function(), child_indices{index});
+  end
+
+
+function [index] = find_field(descriptor, name_or_number)
+  if (ischar(name_or_number))
+    index = [];
+    if (~isempty(descriptor.fields))
+      index = find(strcmp({descriptor.fields.name}, name_or_number), 1);
+    end
+    name = name_or_number;
+  else
+    index = pblib_find_field_index(descriptor.field_numbers, name_or_number);
+    name = num2str(name_or_number);
+  end
+  if (isempty(index) || index == 0)
+    error('proto:pblib_field_projection:unknown_field', ...
+          ['Message ' descriptor.full_name ' has no field ' name]);
+  end
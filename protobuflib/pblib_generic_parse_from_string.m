@@ -1,13 +1,23 @@
 function [msg, num_read] = pblib_generic_parse_from_string(...
-    buffer, descriptor, buffer_start, buffer_end)
+    buffer, descriptor, buffer_start, buffer_end, lazy, projection)
 %pblib_generic_parse_from_string
-%   [msg, num_read] = pblib_generic_parse_from_string(buffer, descriptor, buffer_start, buffer_end)
+%   [msg, num_read] = pblib_generic_parse_from_string(buffer, descriptor, buffer_start, buffer_end, lazy, projection)
 %
 %   INPUTS:
 %       buffer       : buffer to parse proto message from
 %       descriptor   : a proto message descriptor, as generated by one of the read functions
 %       buffer_start : optional buffer start index, used so we can avoid reallocating the buffer
 %       buffer_end   : optional buffer end index, used so we can avoid reallocating the buffer
+%       lazy         : optional, if true message and bytes fields aren't decoded but
+%                      only their range in buffer kept, until pblib_get is
+%                      called on them. Defaults to false.
+%       projection   : optional projection made by pblib_field_projection. Only the
+%                      fields it selects are read, all others and unknown fields
+%                      are skipped over and keep their default values.
+%
+%   Repeated message fields whose descriptor has the columns option, see
+%   pblib_columns_to_struct, are read into a struct of row vectors, one per
+%   field of the message.  They are never lazy.
 
 %   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
 %   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
@@ -48,54 +58,106 @@ function [msg, num_read] = pblib_generic_parse_from_string(...
   if (nargin < 4)
     buffer_end = length(buffer);
   end
+  if (nargin < 5)
+    lazy = false;
+  end
+  if (nargin < 6)
+    projection = [];
+  end
 
   % Label enum
   LABEL_OPTIONAL = 1;
   LABEL_REQUIRED = 2;
   LABEL_REPEATED = 3;
 
-  % Create the has_field map and set default values
-  msg.has_field = java.util.HashMap;
+  % Create the has_field flags and set default values
+  msg.has_field = false(1, length(descriptor.fields));
   for field=descriptor.fields
-    put(msg.has_field, field.name, 0);
     msg.(field.name) = field.default_value;
   end
 
   msg.unknown_fields = [];
+  % Repeated fields grow geometrically, field_counts holds the number of
+  % elements in use
+  field_counts = zeros(1, length(descriptor.fields));
+  field_indeces_by_number = descriptor.field_indeces_by_number;
+  max_dense_number = length(field_indeces_by_number);
   num_read = buffer_start - 1;
   while (num_read < buffer_end)
     [number, wire_type, tag_len] = pblib_read_tag(buffer, num_read + 1);
-    index = get(descriptor.field_indeces_by_number, number);
+    if (number >= 1 && number <= max_dense_number)
+      index = field_indeces_by_number(number);
+    else
+      index = pblib_find_field_index(descriptor.field_numbers, number);
+    end
     [wire_value, temp_num_read] = pblib_read_wire_type(buffer, num_read + tag_len + 1, wire_type);
-    if (~isempty(index))
+    if (index > 0 && (isempty(projection) || projection.wanted(index)))
       field = descriptor.fields(index);
-      if (field.wire_type ~= wire_type && ~field.options.packed)
+      % repeated fields of scalars can be sent either packed or not
+      is_packed = field.label == LABEL_REPEATED && wire_type == 2 && ...
+          field.wire_type ~= 2;
+      if (field.wire_type ~= wire_type && ~is_packed)
         error('proto:read:wire_type_mismatch', ...
               ['Wire type mismatch while reading ' field.name ...
                '. Got ' num2str(wire_type) ' but expected ' ...
                num2str(field.wire_type)]);
       end
-      if field.label == LABEL_REPEATED
-        if field.options.packed
-          msg.(field.name) = read_packed_field(field, wire_value);
+      is_lazy = lazy && (field.matlab_type == 8 || field.matlab_type == 9) && ... % 'bytes' or 'message'
+          ~field.options.columns;
+      child_projection = [];
+      if (~isempty(projection))
+        child_projection = projection.children{index};
+      end
+      if field.options.columns
+        if (~isempty(child_projection))
+          element = read_projected_message(field, wire_value, lazy, child_projection);
         else
+          element = field.read_function(wire_value);
+        end
+        % every column grows geometrically, as other repeated fields do
+        count = field_counts(index);
+        for name=fieldnames(field.default_value)'
+          if (count >= length(msg.(field.name).(name{1})))
+            msg.(field.name).(name{1})(2 * (count + 1)) = 0;
+          end
+          msg.(field.name).(name{1})(count + 1) = element.(name{1});
+        end
+        field_counts(index) = count + 1;
+      elseif field.label == LABEL_REPEATED
+        if is_packed
+          values = read_packed_field(field, wire_value);
+        elseif (~isempty(child_projection))
+          values = read_projected_message(field, wire_value, lazy, child_projection);
+        elseif (is_lazy && field.matlab_type == 9)
+          values = make_lazy_value(wire_value);
+        elseif (is_lazy)
+          values = {make_lazy_value(wire_value)};
+        elseif (field.matlab_type == 7 || field.matlab_type == 8) % 'string' or 'bytes'
           % strings and byte arrays must be stored in cell arrays
-          % and so need special treatment
-          if (field.matlab_type == 7 || field.matlab_type == 8) % 'string' or 'bytes'
-            if (get(msg.has_field, field.name))
-              msg.(field.name) = [msg.(field.name) field.read_function(wire_value)];
-            else
-              msg.(field.name) = {field.read_function(wire_value)};
-            end
-          else
-            msg.(field.name) = [msg.(field.name) field.read_function(wire_value)];
+          values = {field.read_function(wire_value)};
+        else
+          values = field.read_function(wire_value);
+        end
+        count = field_counts(index);
+        if (count == 0)
+          msg.(field.name) = values;
+        else
+          new_count = count + length(values);
+          if (new_count > length(msg.(field.name)))
+            msg.(field.name)(2 * new_count) = msg.(field.name)(1);
           end
+          msg.(field.name)(count + 1 : new_count) = values;
         end
+        field_counts(index) = count + length(values);
+      elseif (~isempty(child_projection))
+        msg.(field.name) = read_projected_message(field, wire_value, lazy, child_projection);
+      elseif (is_lazy)
+        msg.(field.name) = make_lazy_value(wire_value);
       else
         msg.(field.name) = field.read_function(wire_value);
       end
-      put(msg.has_field, field.name, 1);
-    else
+      msg.has_field(index) = true;
+    elseif (isempty(projection))
       msg.unknown_fields = [...
           msg.unknown_fields struct(...
               'number', number, 'wire_type', wire_type, ...
@@ -104,19 +166,64 @@ function [msg, num_read] = pblib_generic_parse_from_string(...
     num_read = num_read + tag_len + temp_num_read;
   end
 
+  % Drop the unused capacity of repeated fields
+  for i=find(field_counts)
+    name = descriptor.fields(i).name;
+    if (descriptor.fields(i).options.columns)
+      for column=fieldnames(msg.(name))'
+        msg.(name).(column{1}) = msg.(name).(column{1})(1 : field_counts(i));
+      end
+    elseif (field_counts(i) < length(msg.(name)))
+      msg.(name) = msg.(name)(1 : field_counts(i));
+    end
+  end
+
   % Check to make sure required fields have been read in We will only issue a warning if
   % they haven't so that debugging the final message would be easier
-  for field=descriptor.fields
-    if field.label == LABEL_REQUIRED && ~get(msg.has_field, field.name)
+  if (~isempty(projection))
+    return;
+  end
+  for i=1:length(descriptor.fields)
+    if descriptor.fields(i).label == LABEL_REQUIRED && ~msg.has_field(i)
       warning('proto:read:required_enforcement', ...
               'Required field not set while parsing. This is an error.')
     end
   end
 
+function [value] = read_projected_message(field, wire_value, lazy, projection)
+  value = pblib_generic_parse_from_string(wire_value{1}, field.descriptor_function(), ...
+                                          wire_value{2}, wire_value{3}, lazy, projection);
+  value.descriptor_function = field.descriptor_function;
+
+function [value] = make_lazy_value(wire_value)
+% A lazy value refers to the buffer rather than copying it, Matlab only copies
+% the buffer if it's changed
+  value = struct('lazy_buffer', wire_value{1}, ...
+                 'lazy_start', wire_value{2}, ...
+                 'lazy_end', wire_value{3});
+
 function [values] = read_packed_field(field, wire_value)
   [wire_value, buffer_start, buffer_end] = deal(wire_value{:});
   wire_values_length = buffer_end - buffer_start + 1;
   matlab_type_str = pblib_matlab_type_to_string(field.matlab_type);
+  if (field.wire_type == 1 || field.wire_type == 5) % '64bit' or '32bit'
+    % fixed width values are stored little endian back to back, so the whole
+    % run can be reinterpreted at once
+    if (mod(wire_values_length, pblib_helpers_iff(field.wire_type == 1, 8, 4)) ~= 0)
+      error('proto:read:packed_length', ...
+            ['Length of packed field ' field.name ...
+             ' is not a multiple of its value size.']);
+    end
+    values = reshape(typecast(wire_value(buffer_start : buffer_end), ...
+                              matlab_type_str), 1, []);
+    return;
+  end
+  if (pblib_mex_available() && isa(wire_value, 'uint8'))
+    % varints are decoded a block at a time by the native codec
+    values = pblib_mex_codec('parse_packed', wire_value, field, ...
+                             buffer_start, buffer_end);
+    return;
+  end
   values = zeros(...
       [1 ceil(wire_values_length / ...
               pblib_type_to_estimated_encoded_length(field.type))], ...
@@ -0,0 +1,172 @@
+function [buffer, num_written] = pblib_generic_serialize_to_buffer(...
+    msg, buffer, num_written, delimited, sizes)
+%pblib_generic_serialize_to_buffer
+%   function [buffer, num_written] = pblib_generic_serialize_to_buffer(...
+%       msg, buffer, num_written, delimited, sizes)
+%
+%   Serializes msg into buffer(num_written + 1 : end) and returns the
+%   number of bytes in buffer that are now in use.  buffer is grown if it's
+%   too short, so a buffer preallocated for several messages can be filled
+%   one message at a time without copying any of them.  Nested messages are
+%   written straight into their final position as well.
+%
+%   INPUTS:
+%     msg         : a proto message struct with a descriptor_function
+%     buffer      : a uint8 row vector
+%     num_written : the number of bytes at the start of buffer to keep
+%     delimited   : optional, if true msg is preceded by its length encoded as
+%                   a varint, as in the writeDelimitedTo format. Defaults to
+%                   false.
+%     sizes       : optional, the sizes of msg as returned by
+%                   pblib_get_serialized_size, for callers that already have
+%                   them
+%
+%   See also pblib_generic_serialize_to_string, pblib_get_serialized_size
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+%   Support function used by Protobuf compiler generated .m files.
+
+  % the sizes of msg and all its nested messages are computed in one pass
+  if (nargin < 5)
+    [msg_size, sizes] = pblib_get_serialized_size(msg);
+  else
+    msg_size = sizes(1);
+  end
+  if (nargin >= 4 && delimited)
+    length_bytes = pblib_write_varint(uint64(msg_size));
+    buffer(num_written + 1 : num_written + length(length_bytes)) = length_bytes;
+    num_written = num_written + length(length_bytes);
+  end
+  if (length(buffer) < num_written + msg_size)
+    buffer(num_written + msg_size) = 0;
+  end
+  [buffer, num_written] = write_message(msg, buffer, num_written, sizes, 1);
+
+
+function [buffer, num_written, next_size] = write_message(...
+    msg, buffer, num_written, sizes, next_size)
+  % enum values we use
+  WIRE_TYPE_LENGTH_DELIMITED = 2;
+  LABEL_REPEATED = 3;
+
+  msg_start = num_written;
+  msg_size = sizes(next_size);
+  next_size = next_size + 1;
+  if (isfield(msg, 'lazy_buffer'))
+    % a message read lazily is written as the bytes it was read from
+    buffer(num_written + 1 : num_written + msg_size) = ...
+        msg.lazy_buffer(msg.lazy_start : msg.lazy_end);
+    num_written = num_written + msg_size;
+    return;
+  end
+  descriptor = msg.descriptor_function();
+  for i=1:length(descriptor.fields)
+    field = descriptor.fields(i);
+    if (~msg.has_field(i) || isempty(msg.(field.name)))
+      continue;
+    end
+    if (field.matlab_type == 9) % 'message'
+      % nested messages are written straight into buffer, using the sizes
+      % computed up front
+      tag = pblib_write_tag(field.number, field.wire_type);
+      values = msg.(field.name);
+      if (field.options.columns)
+        values = pblib_columns_to_struct(values, field.descriptor_function);
+      end
+      for j=1:length(values)
+        length_bytes = pblib_write_varint(uint32(sizes(next_size)));
+        buffer(num_written + 1 : num_written + length(tag)) = tag;
+        num_written = num_written + length(tag);
+        buffer(num_written + 1 : num_written + length(length_bytes)) = length_bytes;
+        num_written = num_written + length(length_bytes);
+        [buffer, num_written, next_size] = write_message(...
+            values(j), buffer, num_written, sizes, next_size);
+      end
+    elseif (field.label == LABEL_REPEATED)
+      if (field.options.packed)
+        % two is the length delimited wire_type
+        tag = pblib_write_tag(field.number, WIRE_TYPE_LENGTH_DELIMITED);
+        buffer(num_written + 1 : num_written + length(tag)) = tag;
+        num_written = num_written + length(tag);
+
+        wire_values = write_packed_field(msg.(field.name), field);
+        wire_value = pblib_write_wire_type(wire_values, WIRE_TYPE_LENGTH_DELIMITED);
+        buffer(num_written + 1 : num_written + length(wire_value)) = wire_value;
+        num_written = num_written + length(wire_value);
+      else
+        tag = pblib_write_tag(field.number, field.wire_type);
+        for j=1:length(msg.(field.name))
+          buffer(num_written + 1 : num_written + length(tag)) = tag;
+          num_written = num_written + length(tag);
+          if (field.matlab_type == 7 || field.matlab_type == 8) % 'string' or 'bytes'
+            value = msg.(field.name){j};
+            if (isstruct(value))
+              % bytes read lazily, see pblib_get
+              value = value.lazy_buffer(value.lazy_start : value.lazy_end);
+            end
+          else
+            value = msg.(field.name)(j);
+          end
+          wire_values = pblib_write_wire_type(field.write_function(value), field.wire_type);
+          buffer(num_written + 1 : num_written + length(wire_values)) = wire_values;
+          num_written = num_written + length(wire_values);
+        end
+      end
+    else
+      tag = pblib_write_tag(field.number, field.wire_type);
+      buffer(num_written + 1 : num_written + length(tag)) = tag;
+      num_written = num_written + length(tag);
+
+      value = msg.(field.name);
+      if (field.matlab_type == 8 && isstruct(value)) % 'bytes'
+        % bytes read lazily, see pblib_get
+        value = value.lazy_buffer(value.lazy_start : value.lazy_end);
+      end
+      wire_value = pblib_write_wire_type(field.write_function(value), field.wire_type);
+      buffer(num_written + 1 : num_written + length(wire_value)) = wire_value;
+      num_written = num_written + length(wire_value);
+    end
+  end
+  % now write the unknown fields
+  for i=1:length(msg.unknown_fields)
+    buffer(num_written + 1 : num_written + length(msg.unknown_fields(i).raw_data)) = ...
+        msg.unknown_fields(i).raw_data;
+    num_written = num_written + length(msg.unknown_fields(i).raw_data);
+  end
+  if (num_written - msg_start ~= msg_size)
+    error('proto:pblib_generic_serialize_to_string', ...
+          ['num_written, ' num2str(num_written - msg_start) ...
+           ', is different from precalculated length ' ...
+           num2str(msg_size)]);
+  end
+
+
@@ -0,0 +1,91 @@
+function [value, msg] = pblib_get(msg, field_name)
+%pblib_get
+%   function [value, msg] = pblib_get(msg, field_name)
+%
+%   Returns the value of a field of the proto message msg, decoding it first if
+%   msg was read lazily.  With the lazy argument of the generated read
+%   functions, message and bytes fields are only stored as their range in the
+%   buffer that was read.  pblib_get decodes such a field, nested messages
+%   being read lazily in turn, and also returns msg with the decoded value
+%   stored in it, so that it only has to be decoded once:
+%     [header, msg] = pblib_get(msg, 'header');
+%
+%   Fields that aren't lazy are returned as they are, so pblib_get can be used
+%   for any message.
+%
+%   See also pblib_set, pblib_generic_parse_from_string.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  descriptor = msg.descriptor_function();
+  index = [];
+  if (~isempty(descriptor.fields))
+    index = find(strcmp({descriptor.fields.name}, field_name), 1);
+  end
+  if (isempty(index))
+    error('proto:pblib_get:unknown_field', ...
+          ['Message ' descriptor.full_name ' has no field ' field_name]);
+  end
+  field = descriptor.fields(index);
+  value = msg.(field_name);
+  if (iscell(value))
+    % repeated bytes
+    was_lazy = false;
+    for j=1:length(value)
+      if (isstruct(value{j}))
+        value{j} = decode_lazy_value(field, value{j});
+        was_lazy = true;
+      end
+    end
+  elseif (isstruct(value) && isfield(value, 'lazy_buffer'))
+    values = cell(1, length(value));
+    for j=1:length(value)
+      values{j} = decode_lazy_value(field, value(j));
+    end
+    value = [values{:}];
+    was_lazy = true;
+  else
+    was_lazy = false;
+  end
+  if (was_lazy)
+    msg.(field_name) = value;
+  end
+
+
+function [value] = decode_lazy_value(field, lazy_value)
+  if (field.matlab_type == 9) % 'message'
+    value = pblib_generic_parse_from_string(lazy_value.lazy_buffer, ...
+        field.descriptor_function(), lazy_value.lazy_start, lazy_value.lazy_end, true);
+    value.descriptor_function = field.descriptor_function;
+  else
+    value = field.read_function(...
+        {lazy_value.lazy_buffer, lazy_value.lazy_start, lazy_value.lazy_end});
+  end
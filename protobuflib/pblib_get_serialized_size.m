@@ -1,12 +1,17 @@
-function [msg_size] = pblib_get_serialized_size(msg)
+function [msg_size, sizes] = pblib_get_serialized_size(msg)
 %pblib_get_serialized_size 
-%   function [msg_size] = pblib_get_serialized_size(msg)
+%   function [msg_size, sizes] = pblib_get_serialized_size(msg)
 %
 %   Estimates the size a message will take when serialized.
 % 
 %   Will go through a message and estimate serialized sizes of valid fields.
 %   Estimates generally include tag size plus encoded field size.
 %
+%   sizes holds msg_size followed by the sizes of all messages nested in msg,
+%   in the order pblib_generic_serialize_to_string writes them.  Passing them
+%   on saves it from computing the size of every nested message again at each
+%   level of nesting.
+%
 %   See also pblib_generic_serialize_to_string, pblib_write_wire_type
   
 %   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
@@ -42,16 +47,36 @@ function [msg_size] = pblib_get_serialized_size(msg)
 %   Author: fedor.labounko@gmail.com (Fedor Labounko)
 %   Support function used by Protobuf compiler generated .m files.
 
+  [sizes, num_sizes] = compute_sizes(msg, zeros(1, 16), 0);
+  sizes = sizes(1 : num_sizes);
+  msg_size = sizes(1);
+
 
+function [sizes, num_sizes] = compute_sizes(msg, sizes, num_sizes)
   LABEL_REPEATED = 3;
   WIRE_TYPE_LENGTH_DELIMITED = 2;
+  % reserve the slot of msg before those of its nested messages
+  num_sizes = num_sizes + 1;
+  slot = num_sizes;
+  if (slot > length(sizes))
+    sizes(2 * slot) = 0;
+  end
+  if (isfield(msg, 'lazy_buffer'))
+    % a message read lazily is written as the bytes it was read from
+    sizes(slot) = msg.lazy_end - msg.lazy_start + 1;
+    return;
+  end
   msg_size = 0;
   descriptor = msg.descriptor_function();
   for i=1:length(descriptor.fields)
     field = descriptor.fields(i);
-    if (get(msg.has_field, field.name) == 0 || isempty(msg.(field.name)))
+    if (~msg.has_field(i) || isempty(msg.(field.name)))
       continue;
     end
+    values = msg.(field.name);
+    if (field.options.columns)
+      values = pblib_columns_to_struct(values, field.descriptor_function);
+    end
 
     if (field.options.packed)
       tag_length = pblib_encoded_tag_size(...
@@ -65,17 +90,30 @@ function [msg_size] = pblib_get_serialized_size(msg)
     if (field.label == LABEL_REPEATED)
       msg_size = msg_size + tag_length + ...
           (1 - field.options.packed) * ...
-          (length(msg.(field.name)) - 1) * tag_length;
+          (length(values) - 1) * tag_length;
     else
       msg_size = msg_size + tag_length;
     end
-    msg_size = msg_size + pblib_encoded_field_size(msg.(field.name), field);
+    if (field.matlab_type == 9) % 'message'
+      field_size = 0;
+      for j=1:length(values)
+        child_slot = num_sizes + 1;
+        [sizes, num_sizes] = compute_sizes(values(j), sizes, num_sizes);
+        field_size = field_size + ...
+            pblib_encoded_varint_size(sizes(child_slot)) + sizes(child_slot);
+      end
+    else
+      field_size = pblib_encoded_field_size(msg.(field.name), field);
+    end
+    if (field.options.packed)
+      % packed values are written as one length delimited value
+      field_size = field_size + pblib_encoded_varint_size(field_size);
+    end
+    msg_size = msg_size + field_size;
   end
   
   % Now add the space required by the stored unknown fields
   for i=1:length(msg.unknown_fields)
     msg_size = msg_size + length(msg.unknown_fields(i).raw_data);
   end
-
-
-
+  sizes(slot) = msg_size;
@@ -0,0 +1,93 @@
+function [msgs] = pblib_read_batch(descriptor_function, source, buffer_starts, buffer_ends)
+%pblib_read_batch
+%   msgs = pblib_read_batch(descriptor_function, buffers)
+%   msgs = pblib_read_batch(descriptor_function, buffer, buffer_starts, buffer_ends)
+%
+%   Parses many messages of one type in a single call and returns them as a
+%   struct array.  The descriptor is fetched once for the whole batch and the
+%   result allocated once, rather than per message as with a pb_read_* call
+%   for each of them.  With pblib_mex_codec all messages are parsed by one
+%   call into it.
+%
+%   INPUTS:
+%     descriptor_function : handle to the generated descriptor function of the
+%                           messages, e.g. @pb_descriptor_test__TestAllTypes
+%     buffers             : cell array of uint8 buffers, each holding one
+%                           message
+%     buffer              : a uint8 buffer holding all the messages
+%     buffer_starts       : 1 based index of the first byte of each message
+%                           in buffer
+%     buffer_ends         : 1 based index of the last byte of each message
+%
+%   OUTPUTS:
+%     msgs                : 1xN struct array of the messages
+%
+%   See also pblib_read_mapped_file, pblib_generic_parse_from_string.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (iscell(source))
+    count = numel(source);
+  else
+    if (nargin < 4 || numel(buffer_starts) ~= numel(buffer_ends))
+      error('proto:pblib_read_batch:range', ...
+            'buffer_starts and buffer_ends must have the same number of elements.');
+    end
+    count = numel(buffer_starts);
+  end
+
+  if (pblib_mex_available() && (iscell(source) || isa(source, 'uint8')))
+    if (iscell(source))
+      msgs = pblib_mex_codec('parse_batch', source, descriptor_function);
+    else
+      msgs = pblib_mex_codec('parse_batch', source, descriptor_function, ...
+                             double(buffer_starts), double(buffer_ends));
+    end
+    return;
+  end
+
+  descriptor = descriptor_function();
+  msgs = struct([]);
+  for i=1:count
+    if (iscell(source))
+      msg = pblib_generic_parse_from_string(source{i}, descriptor);
+    else
+      msg = pblib_generic_parse_from_string(source, descriptor, ...
+                                            buffer_starts(i), buffer_ends(i));
+    end
+    msg.descriptor_function = descriptor_function;
+    if (i == 1)
+      % copies of the first message allocate the whole struct array at once
+      msgs = repmat(msg, 1, count);
+    else
+      msgs(i) = msg;
+    end
+  end
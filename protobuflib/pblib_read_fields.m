@@ -0,0 +1,73 @@
+function [msg] = pblib_read_fields(descriptor_function, field_paths, buffer, buffer_start, buffer_end)
+%pblib_read_fields
+%   msg = pblib_read_fields(descriptor_function, field_paths, buffer, buffer_start, buffer_end)
+%
+%   Reads only the given fields of a message, like the generated read
+%   functions otherwise do.  All other fields, including those of nested
+%   messages not on one of the paths, are skipped over using just their length
+%   and keep their default values, with has_field false.  Unknown fields are
+%   dropped.
+%
+%   INPUTS:
+%     descriptor_function : handle to the generated descriptor function of the
+%                           message, e.g. @pb_descriptor_test__TestAllTypes
+%     field_paths         : the fields to read, as accepted by
+%                           pblib_field_projection, or a projection it made
+%     buffer              : a buffer of uint8's to parse
+%     buffer_start        : optional starting index to consider of the buffer
+%                           defaults to 1
+%     buffer_end          : optional ending index to consider of the buffer
+%                           defaults to length(buffer)
+%
+%   See also pblib_field_projection.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (nargin < 4)
+    buffer_start = 1;
+  end
+  if (nargin < 5)
+    buffer_end = length(buffer);
+  end
+  if (isstruct(field_paths))
+    projection = field_paths;
+  else
+    projection = pblib_field_projection(descriptor_function, field_paths);
+  end
+
+  descriptor = descriptor_function();
+  if (pblib_mex_available() && isa(buffer, 'uint8'))
+    msg = pblib_mex_codec('parse', buffer, descriptor, buffer_start, buffer_end, projection);
+  else
+    msg = pblib_generic_parse_from_string(buffer, descriptor, buffer_start, buffer_end, ...
+                                          false, projection);
+  end
+  msg.descriptor_function = descriptor_function;
@@ -0,0 +1,79 @@
+function [msgs] = pblib_read_mapped_file(filename, descriptor_function, buffer_starts, buffer_ends)
+%pblib_read_mapped_file
+%   msgs = pblib_read_mapped_file(filename, descriptor_function, buffer_starts, buffer_ends)
+%
+%   Parses messages straight from a file, without reading it into a buffer
+%   first.  msgs(i) is parsed from the bytes buffer_starts(i) : buffer_ends(i)
+%   of the file, using the same 1 based range convention as the buffer_start
+%   and buffer_end of the generated read functions.  With pblib_mex_codec the
+%   file is memory mapped and parsed in place, so only the pages holding the
+%   messages are ever read.  Without it, memmapfile is used and each message's
+%   bytes are copied out of the mapping to parse them.
+%
+%   The ranges of the messages of a delimited file are
+%   index.offsets + 1 and index.offsets + index.lengths, where index is
+%   returned by pblib_delimited_index_load.
+%
+%   INPUTS:
+%     filename            : name of the file to parse
+%     descriptor_function : handle to the generated descriptor function of the
+%                           messages, e.g. @pb_descriptor_test__TestAllTypes
+%     buffer_starts       : 1 based index of the first byte of each message
+%     buffer_ends         : 1 based index of the last byte of each message
+%
+%   OUTPUTS:
+%     msgs                : struct array of the messages
+%
+%   See also pblib_delimited_index_load, pblib_generic_parse_from_string.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (numel(buffer_starts) ~= numel(buffer_ends))
+    error('proto:pblib_read_mapped_file:range', ...
+          'buffer_starts and buffer_ends must have the same number of elements.');
+  end
+
+  descriptor = descriptor_function();
+  if (pblib_mex_available())
+    msgs = pblib_mex_codec('parse_file', filename, descriptor, ...
+                           double(buffer_starts), double(buffer_ends));
+  else
+    mapping = memmapfile(filename, 'Format', 'uint8');
+    msgs = cell(1, numel(buffer_starts));
+    for i=1:numel(buffer_starts)
+      buffer = mapping.Data(buffer_starts(i) : buffer_ends(i))';
+      msgs{i} = pblib_generic_parse_from_string(buffer, descriptor);
+    end
+  end
+  msgs = [msgs{:}];
+  if (~isempty(msgs))
+    [msgs.descriptor_function] = deal(descriptor_function);
+  end
@@ -0,0 +1,63 @@
+function [msgs, reader, dropped] = pblib_ring_reader_next(reader, max_messages)
+%pblib_ring_reader_next
+%   [msgs, reader, dropped] = pblib_ring_reader_next(reader, max_messages)
+%
+%   Reads the messages the producer has written to the ring since the last
+%   call, up to max_messages of them, from a reader opened with
+%   pblib_ring_reader_open.  It never waits for the producer, so msgs is
+%   empty if there is nothing new.  The producer doesn't wait for readers
+%   either: once a reader falls a whole ring behind, the oldest messages are
+%   overwritten before they are read and reading continues with the newest
+%   one.  The messages are parsed by a single call into pblib_mex_codec
+%   without passing through Matlab arrays.
+%
+%   INPUTS:
+%     reader       : reader state returned by pblib_ring_reader_open or a
+%                    previous call to pblib_ring_reader_next
+%     max_messages : optional maximum number of messages to read, defaults
+%                    to Inf
+%
+%   OUTPUTS:
+%     msgs         : 1xN struct array of the messages read
+%     reader       : updated reader state to pass to the next call
+%     dropped      : number of messages overwritten before they were read
+%
+%   See also pblib_ring_reader_open, pblib_ring_reader_close.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (nargin < 2)
+    max_messages = Inf;
+  end
+
+  [msgs, reader.position, reader.count, dropped] = pblib_mex_codec( ...
+      'ring_read', reader.ring, reader.descriptor_function, ...
+      reader.position, reader.count, min(max_messages, 2^53));
@@ -0,0 +1,65 @@
+function [reader] = pblib_ring_reader_open(name, descriptor_function)
+%pblib_ring_reader_open
+%   reader = pblib_ring_reader_open(name, descriptor_function)
+%
+%   Attaches to a shared memory ring buffer into which a live producer
+%   process writes messages, for reading them with pblib_ring_reader_next.
+%   The layout of the ring is described in ring_buffer.h of the native codec,
+%   which producers include to write to it, and ring_producer.cc is an
+%   example producer.  Only messages written after the reader is opened are
+%   read.  Close the reader with pblib_ring_reader_close.  Rings are POSIX
+%   shared memory objects and need pblib_mex_codec.
+%
+%   INPUTS:
+%     name                : name of the shared memory object, e.g. '/pings'
+%     descriptor_function : handle to the generated descriptor function of the
+%                           messages in the ring, e.g.
+%                           @pb_descriptor_test__TestAllTypes
+%
+%   OUTPUTS:
+%     reader              : reader state to pass to pblib_ring_reader_next
+%
+%   See also pblib_ring_reader_next, pblib_ring_reader_close.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (~pblib_mex_available())
+    error('proto:pblib_ring_reader_open:no_mex', ...
+          'Reading shared memory rings needs pblib_mex_codec, see pblib_build_mex.');
+  end
+
+  [ring, position, count] = pblib_mex_codec('ring_open', name);
+  reader.ring = ring;
+  reader.descriptor_function = descriptor_function;
+  % The byte position of the next message in the ring and the number of
+  % messages the producer wrote before it.
+  reader.position = position;
+  reader.count = count;
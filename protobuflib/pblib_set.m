@@ -2,7 +2,7 @@ function [msg] = pblib_set(msg, field_name, value)
 %pblib_set
 %   function [msg] = pblib_set(msg, field_name, value)
 %
-%   Sets a value in the proto message msg and updates the has_field hash table.  BEWARE:
+%   Sets a value in the proto message msg and marks it as set in has_field.  BEWARE:
 %   This function potentially makes a full copy of your msg because it gets modified.  I
 %   have no idea how smart matlab is and how big of a copy happens and haven't tested it.
 %   This function should therefore only be used if speed is not an issue or you are going
@@ -15,6 +15,12 @@ function [msg] = pblib_set(msg, field_name, value)
 %   If you would like to set the field of a message field, you need to do msg.some_field =
 %   pblib_set(msg.some_field, 'some_other_subfield', 'some_subfield_value');
 %
+%   msg.has_field is a logical row vector with one element per entry of the fields of the
+%   message's descriptor, so the inline equivalent is
+%     msg.some_field_name = some_field_value;
+%     msg.has_field(i) = true;
+%   where i is the 'index' entry of the field in the message's descriptor.
+%
 %   See also pblib_generic_serialize_to_string
   
 %   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
@@ -50,5 +56,14 @@ function [msg] = pblib_set(msg, field_name, value)
 %   Author: fedor.labounko@gmail.com (Fedor Labounko)
 %   Support function used by Protobuf compiler generated .m files.
 
+  descriptor = msg.descriptor_function();
+  index = [];
+  if (~isempty(descriptor.fields))
+    index = find(strcmp({descriptor.fields.name}, field_name), 1);
+  end
+  if (isempty(index))
+    error('proto:pblib_set:unknown_field', ...
+          ['Message ' descriptor.full_name ' has no field ' field_name]);
+  end
   msg.(field_name) = value;
-  put(msg.has_field, field_name, 1);
+  msg.has_field(index) = true;
@@ -0,0 +1,67 @@
+function [buffer] = pblib_write_batch(msgs)
+%pblib_write_batch
+%   buffer = pblib_write_batch(msgs)
+%
+%   Serializes every message of a struct array into one buffer, each preceded
+%   by its length encoded as a varint, as in the writeDelimitedTo format.  The
+%   sizes of all the messages are computed first and the buffer allocated once
+%   for all of them, with pblib_mex_codec in a single call into it.  Written
+%   to a file, the buffer can be read like any delimited file, e.g. with
+%   pblib_delimited_reader_open.
+%
+%   INPUTS:
+%     msgs   : a struct array of messages of one type
+%
+%   OUTPUTS:
+%     buffer : uint8 row vector holding the length delimited messages
+%
+%   See also pblib_read_batch, pblib_generic_serialize_to_buffer,
+%   pblib_delimited_writer_write.
+  
+%   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+%   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+%   http://code.google.com/p/protobuf-matlab/
+%  
+%   Redistribution and use in source and binary forms, with or without
+%   modification, are permitted provided that the following conditions are met:
+%  
+%       * Redistributions of source code must retain the above copyright
+%   notice, this list of conditions and the following disclaimer.
+%  
+%       * Redistributions in binary form must reproduce the above copyright
+%   notice, this list of conditions and the following disclaimer in the
+%   documentation and/or other materials provided with the distribution.
+%  
+%       * Neither the name of the FarSounder Inc. nor the names of its
+%   contributors may be used to endorse or promote products derived from this
+%   software without specific prior written permission.
+%  
+%   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+%   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+%   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+%   ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+%   LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+%   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+%   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+%   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+%   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+%   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+%   POSSIBILITY OF SUCH DAMAGE.
+
+  if (pblib_mex_available())
+    buffer = pblib_mex_codec('serialize_batch', msgs);
+    return;
+  end
+
+  sizes = cell(1, length(msgs));
+  total_size = 0;
+  for i=1:length(msgs)
+    [msg_size, sizes{i}] = pblib_get_serialized_size(msgs(i));
+    total_size = total_size + pblib_encoded_varint_size(msg_size) + msg_size;
+  end
+  buffer = zeros([1 total_size], 'uint8');
+  num_written = 0;
+  for i=1:length(msgs)
+    [buffer, num_written] = pblib_generic_serialize_to_buffer(...
+        msgs(i), buffer, num_written, true, sizes{i});
+  end
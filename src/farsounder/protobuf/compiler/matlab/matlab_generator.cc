@@ -58,13 +58,17 @@ using ::google::protobuf::Descriptor;
 using ::google::protobuf::FieldDescriptor;
 using ::google::protobuf::FieldDescriptor;
 using ::google::protobuf::FileDescriptor;
+using ::google::protobuf::CEscape;
 using ::google::protobuf::LowerString;
 using ::google::protobuf::SimpleDtoa;
 using ::google::protobuf::SimpleFtoa;
 using ::google::protobuf::SimpleItoa;
 using ::google::protobuf::StringReplace;
+using ::google::protobuf::uint32;
 using ::google::protobuf::compiler::GeneratorContext;
+using ::google::protobuf::compiler::ParseGeneratorParameter;
 using ::google::protobuf::internal::MutexLock;
+using ::google::protobuf::internal::WireFormat;
 using ::google::protobuf::io::Printer;
 
 using ::std::make_pair;
@@ -94,6 +98,244 @@ string CamelToLower(const string &name) {
   }
   return new_name;
 }
+
+// Returns the fields of descriptor ordered by field number, which is the
+// order they are listed in the generated descriptor.
+vector<const FieldDescriptor *> FieldsByNumber(const Descriptor &descriptor) {
+  vector<pair<int, int> > sorted_fields;
+  for (int i = 0; i < descriptor.field_count(); ++i) {
+    sorted_fields.push_back(make_pair(descriptor.field(i)->number(), i));
+  }
+  sort(sorted_fields.begin(), sorted_fields.end());
+  vector<const FieldDescriptor *> fields;
+  for (int i = 0; i < sorted_fields.size(); ++i) {
+    fields.push_back(descriptor.field(sorted_fields[i].second));
+  }
+  return fields;
+}
+
+// Returns the 1 based index of field in the fields of its generated descriptor,
+// which is also its element of has_field.
+int FieldIndex(const FieldDescriptor &field) {
+  const Descriptor &descriptor = *field.containing_type();
+  int index = 1;
+  for (int i = 0; i < descriptor.field_count(); ++i) {
+    if (descriptor.field(i)->number() < field.number())
+      ++index;
+  }
+  return index;
+}
+
+// Returns the varint encoded tag for a field as a list of byte values that can
+// be pasted into a matlab array literal.
+string TagBytes(int number, int wire_type) {
+  uint32 value = (static_cast<uint32>(number) << 3) | wire_type;
+  string bytes;
+  while (value > 127) {
+    bytes += SimpleItoa((value & 127) | 128) + " ";
+    value >>= 7;
+  }
+  bytes += SimpleItoa(value);
+  return bytes;
+}
+
+// Wire types, see WireType enum in wire_format_lite.h
+const int kWireTypeVarint = 0;
+const int kWireTypeFixed64 = 1;
+const int kWireTypeLengthDelimited = 2;
+const int kWireTypeFixed32 = 5;
+
+// Descriptors get a dense field_indeces_by_number table when their largest
+// field number is at most the larger of these two limits.
+const int kMaxDenseFieldNumber = 64;
+const int kDenseFieldNumberFactor = 4;
+
+// The C++ types and class ids of the Matlab types in the codecs written with
+// codec=generated, indexed by MatlabType.
+const char* const kCodecCppTypes[] = {
+  "",          // invalid index
+  "int32_t",   // MATLABTYPE_INT32
+  "int64_t",   // MATLABTYPE_INT64
+  "uint32_t",  // MATLABTYPE_UINT32
+  "uint64_t",  // MATLABTYPE_UINT64
+  "double",    // MATLABTYPE_DOUBLE
+  "float",     // MATLABTYPE_SINGLE
+  "",          // MATLABTYPE_STRING
+  "",          // MATLABTYPE_BYTES
+  "",          // MATLABTYPE_MESSAGE
+  "int32_t",   // MATLABTYPE_ENUM
+};
+const char* const kCodecClassIds[] = {
+  "",                // invalid index
+  "mxINT32_CLASS",   // MATLABTYPE_INT32
+  "mxINT64_CLASS",   // MATLABTYPE_INT64
+  "mxUINT32_CLASS",  // MATLABTYPE_UINT32
+  "mxUINT64_CLASS",  // MATLABTYPE_UINT64
+  "mxDOUBLE_CLASS",  // MATLABTYPE_DOUBLE
+  "mxSINGLE_CLASS",  // MATLABTYPE_SINGLE
+  "mxCHAR_CLASS",    // MATLABTYPE_STRING
+  "mxUINT8_CLASS",   // MATLABTYPE_BYTES
+  "mxSTRUCT_CLASS",  // MATLABTYPE_MESSAGE
+  "mxINT32_CLASS",   // MATLABTYPE_ENUM
+};
+
+// Returns the suffix of the functions and tables of a message in a generated
+// codec.
+string CodecIdentifier(const Descriptor &descriptor) {
+  return StringReplace(descriptor.full_name(), ".", "__", true);
+}
+
+// Returns the tag of a field as a C++ literal, and the size of its varint.
+string CodecTag(int number, int wire_type) {
+  return SimpleItoa((static_cast<uint32>(number) << 3) | wire_type) + "u";
+}
+
+string CodecTagSize(int number, int wire_type) {
+  uint32 value = (static_cast<uint32>(number) << 3) | wire_type;
+  int size = 1;
+  while (value > 127) {
+    value >>= 7;
+    ++size;
+  }
+  return SimpleItoa(size);
+}
+
+// Turns the output of SimpleDtoa or SimpleFtoa into a C++ literal of type.
+string CodecFloatLiteral(const string &value, const string &type) {
+  if (value == "inf") {
+    return "std::numeric_limits<" + type + ">::infinity()";
+  } else if (value == "-inf") {
+    return "-std::numeric_limits<" + type + ">::infinity()";
+  } else if (value == "nan") {
+    return "std::numeric_limits<" + type + ">::quiet_NaN()";
+  }
+  string literal = value;
+  if (literal.find_first_of(".e") == string::npos) {
+    literal += ".0";
+  }
+  return type == "float" ? literal + "f" : literal;
+}
+
+// Returns the C++ expression turning the wire value in the uint64_t value
+// into the C++ type of field.
+string CodecDecodeExpression(const FieldDescriptor &field) {
+  switch (field.type()) {
+    case FieldDescriptor::TYPE_INT32:
+    case FieldDescriptor::TYPE_ENUM:
+    case FieldDescriptor::TYPE_SFIXED32:
+      return "static_cast<int32_t>(value)";
+    case FieldDescriptor::TYPE_SINT32:
+      return "static_cast<int32_t>(ZigZagDecode(value))";
+    case FieldDescriptor::TYPE_INT64:
+    case FieldDescriptor::TYPE_SFIXED64:
+      return "static_cast<int64_t>(value)";
+    case FieldDescriptor::TYPE_SINT64:
+      return "ZigZagDecode(value)";
+    case FieldDescriptor::TYPE_UINT32:
+    case FieldDescriptor::TYPE_FIXED32:
+    case FieldDescriptor::TYPE_BOOL:
+      return "static_cast<uint32_t>(value)";
+    case FieldDescriptor::TYPE_FLOAT:
+      return "FloatFromBits(value)";
+    case FieldDescriptor::TYPE_DOUBLE:
+      return "DoubleFromBits(value)";
+    default:
+      return "value";
+  }
+}
+
+// Returns the C++ expression converting element index of the mxArray array
+// to the wire value of field, the same conversion as pblib_mex_codec's.
+string CodecEncodeExpression(const FieldDescriptor &field,
+                             const string &array, const string &index) {
+  string element = "(" + array + ", " + index + ")";
+  switch (field.type()) {
+    case FieldDescriptor::TYPE_INT32:
+    case FieldDescriptor::TYPE_ENUM:
+    case FieldDescriptor::TYPE_SFIXED32:
+      return "static_cast<uint32_t>(ConvertToInt32" + element + ")";
+    case FieldDescriptor::TYPE_SINT32:
+      return "static_cast<uint32_t>(ZigZagEncode(ConvertToInt32" + element +
+          "))";
+    case FieldDescriptor::TYPE_INT64:
+    case FieldDescriptor::TYPE_SFIXED64:
+      return "static_cast<uint64_t>(ConvertToInt64" + element + ")";
+    case FieldDescriptor::TYPE_SINT64:
+      return "ZigZagEncode(ConvertToInt64" + element + ")";
+    case FieldDescriptor::TYPE_UINT32:
+    case FieldDescriptor::TYPE_FIXED32:
+    case FieldDescriptor::TYPE_BOOL:
+      return "ConvertToUint32" + element;
+    case FieldDescriptor::TYPE_FLOAT:
+      return "FloatBits(ConvertToSingle" + element + ")";
+    case FieldDescriptor::TYPE_DOUBLE:
+      return "DoubleBits(ConvertToDouble" + element + ")";
+    default:
+      return "ConvertToUint64" + element;
+  }
+}
+
+// Returns the statement writing the wire value in the expression value.
+string CodecValueWrite(int wire_type, const string &value) {
+  switch (wire_type) {
+    case kWireTypeFixed64:
+      return "target = WriteLittleEndian(" + value + ", 8, target);";
+    case kWireTypeFixed32:
+      return "target = WriteLittleEndian(" + value + ", 4, target);";
+    default:
+      return "target = WriteVarint(" + value + ", target);";
+  }
+}
+
+// Adds descriptor and the message types its fields refer to, transitively,
+// to messages unless already in seen.
+void CollectCodecMessages(const Descriptor &descriptor,
+                          set<const Descriptor *> *seen,
+                          vector<const Descriptor *> *messages) {
+  if (!seen->insert(&descriptor).second)
+    return;
+  messages->push_back(&descriptor);
+  for (int i = 0; i < descriptor.field_count(); ++i) {
+    if (descriptor.field(i)->type() == FieldDescriptor::TYPE_MESSAGE)
+      CollectCodecMessages(*descriptor.field(i)->message_type(), seen,
+                           messages);
+  }
+  for (int i = 0; i < descriptor.nested_type_count(); ++i) {
+    CollectCodecMessages(*descriptor.nested_type(i), seen, messages);
+  }
+}
+
+// Returns the default value of a singular numeric field as a C++ literal.
+string CodecDefaultLiteral(const FieldDescriptor &field) {
+  switch (field.cpp_type()) {
+    case FieldDescriptor::CPPTYPE_INT32:
+      if (field.default_value_int32() == ::google::protobuf::kint32min)
+        return "(-2147483647 - 1)";
+      return SimpleItoa(field.default_value_int32());
+    case FieldDescriptor::CPPTYPE_INT64:
+      if (field.default_value_int64() == ::google::protobuf::kint64min)
+        return "(-9223372036854775807LL - 1)";
+      return SimpleItoa(field.default_value_int64()) + "LL";
+    case FieldDescriptor::CPPTYPE_UINT32:
+      return SimpleItoa(field.default_value_uint32()) + "u";
+    case FieldDescriptor::CPPTYPE_UINT64:
+      return SimpleItoa(field.default_value_uint64()) + "ULL";
+    case FieldDescriptor::CPPTYPE_DOUBLE:
+      return CodecFloatLiteral(SimpleDtoa(field.default_value_double()),
+                               "double");
+    case FieldDescriptor::CPPTYPE_FLOAT:
+      return CodecFloatLiteral(SimpleFtoa(field.default_value_float()),
+                               "float");
+    case FieldDescriptor::CPPTYPE_BOOL:
+      return field.default_value_bool() ? "1u" : "0u";
+    case FieldDescriptor::CPPTYPE_ENUM:
+      if (field.default_value_enum()->number() == ::google::protobuf::kint32min)
+        return "(-2147483647 - 1)";
+      return SimpleItoa(field.default_value_enum()->number());
+    default:
+      return "0";
+  }
+}
 }  // namespace
 
 // See Type enum in descriptor.h
@@ -135,6 +377,22 @@ MatlabGenerator::kMatlabTypeToString[MatlabGenerator::MAX_MATLABTYPE + 1] = {
   "enum", // MATLABTYPE_ENUM
 };
 
+// Must match pblib_matlab_type_to_string.m
+const string
+MatlabGenerator::kMatlabTypeToClassName[MatlabGenerator::MAX_MATLABTYPE + 1] = {
+  "invalid", // invalid index
+  "int32", // MATLABTYPE_INT32
+  "int64", // MATLABTYPE_INT64
+  "uint32", // MATLABTYPE_UINT32
+  "uint64", // MATLABTYPE_UINT64
+  "double", // MATLABTYPE_DOUBLE
+  "single", // MATLABTYPE_SINGLE
+  "char", // MATLABTYPE_STRING
+  "uint8", // MATLABTYPE_BYTES
+  "uint8", // MATLABTYPE_MESSAGE
+  "int32", // MATLABTYPE_ENUM
+};
+
 MatlabGenerator::MatlabGenerator() {}
 MatlabGenerator::~MatlabGenerator() {}
 
@@ -144,9 +402,49 @@ bool MatlabGenerator::Generate(const FileDescriptor* file,
                                GeneratorContext* output_directory,
                                string* error) const {
   MutexLock lock(&mutex_);
+
+  vector<pair<string, string> > options;
+  ParseGeneratorParameter(parameter, &options);
+  specialized_read_ = false;
+  columns_ = false;
+  generated_codec_ = false;
+  for (int i = 0; i < options.size(); ++i) {
+    if (options[i].first == "read") {
+      if (options[i].second == "specialized") {
+        specialized_read_ = true;
+      } else if (options[i].second != "generic") {
+        *error = "Unknown value for generator option read: " +
+            options[i].second;
+        return false;
+      }
+    } else if (options[i].first == "repeated_messages") {
+      if (options[i].second == "columns") {
+        columns_ = true;
+      } else if (options[i].second != "structs") {
+        *error = "Unknown value for generator option repeated_messages: " +
+            options[i].second;
+        return false;
+      }
+    } else if (options[i].first == "codec") {
+      if (options[i].second == "generated") {
+        generated_codec_ = true;
+      } else if (options[i].second != "generic") {
+        *error = "Unknown value for generator option codec: " +
+            options[i].second;
+        return false;
+      }
+    } else {
+      *error = "Unknown generator option: " + options[i].first;
+      return false;
+    }
+  }
+
   file_ = file;
   output_directory_ = output_directory;
   PrintMessageFunctions();
+  if (generated_codec_) {
+    PrintGeneratedCodec();
+  }
   return true;
 }
 
@@ -155,6 +453,7 @@ void MatlabGenerator::PrintMessageFunctions() const {
   for (int i = 0; i < file_->message_type_count(); ++i) {
     PrintDescriptorFunction(*file_->message_type(i));
     PrintReadFunction(*file_->message_type(i));
+    PrintWriteFunction(*file_->message_type(i));
   }
 }
 
@@ -184,7 +483,7 @@ void MatlabGenerator::PrintDescriptorFunction(
 void MatlabGenerator::PrintDescriptorHeader(
     Printer & printer, const Descriptor & descriptor) const {
   string function_name = DescriptorFunctionName(descriptor);
-  printer.Print("function [descriptor] = $function_name$()\n",
+  printer.Print("function [descriptor] = $function_name$(reset)\n",
                 "function_name", function_name);
 }
 
@@ -197,8 +496,11 @@ void MatlabGenerator::PrintDescriptorComment(
                 "name", name, "function_name", function_name);
   printer.Print("%   ");
   PrintDescriptorHeader(printer, descriptor);
-  printer.Print("%\n");
-  printer.Print("%   See also $read_function$",
+  printer.Print("%\n"
+                "%   The descriptor is built on the first call and returned from a cache\n"
+                "%   afterwards. Pass reset = true to rebuild it.\n"
+                "%\n");
+  printer.Print("%   See also $read_function$, pblib_clear_descriptor_cache",
                 "read_function", ReadFunctionName(descriptor));
   printer.Print("\n");
 }
@@ -207,6 +509,12 @@ void MatlabGenerator::PrintDescriptorComment(
 void MatlabGenerator::PrintDescriptorBody(
     Printer & printer, const Descriptor & descriptor) const {
   printer.Print("\n");
+  printer.Print("persistent cached_descriptor;\n"
+                "if ((nargin < 1 || ~reset) && ~isempty(cached_descriptor))\n"
+                "  descriptor = cached_descriptor;\n"
+                "  return;\n"
+                "end\n"
+                "\n");
   printer.Print("descriptor = struct( ...\n");
   printer.Indent();
   printer.Print("'name', '$name$', ...\n", "name", descriptor.name());
@@ -253,6 +561,7 @@ void MatlabGenerator::PrintDescriptorBody(
   printer.Print(");\n\n");
 
   PrintFieldIndecesByNumber(printer, descriptor);
+  printer.Print("cached_descriptor = descriptor;\n");
 }
 
 
@@ -285,11 +594,24 @@ void MatlabGenerator::PrintFieldDescriptors(
 
     m["read_function"] = MakeReadFunctionHandle(*field);
     m["write_function"] = MakeWriteFunctionHandle(*field);
+    // Lets code that only has the descriptor, like the mex codec, get at the
+    // descriptors of nested messages.
+    if (field->type() == FieldDescriptor::TYPE_MESSAGE) {
+      m["descriptor_function"] =
+          "@" + DescriptorFunctionName(*field->message_type());
+    } else {
+      m["descriptor_function"] = "[]";
+    }
     if (field->options().packed()) {
       m["packed"] = "true";
     } else {
       m["packed"] = "false";
     }
+    if (IsColumnsField(*field)) {
+      m["columns"] = "true";
+    } else {
+      m["columns"] = "false";
+    }
     printer.Print(m,
                   "'name', '$name$', ...\n"
                   "'full_name', '$full_name$', ...\n"
@@ -302,7 +624,8 @@ void MatlabGenerator::PrintFieldDescriptors(
                   "'default_value', $default_value$, ...\n"
                   "'read_function', $read_function$, ...\n"
                   "'write_function', $write_function$, ...\n"
-                  "'options', struct('packed', $packed$) ...\n"
+                  "'descriptor_function', $descriptor_function$, ...\n"
+                  "'options', struct('packed', $packed$, 'columns', $columns$) ...\n"
                   );
     printer.Outdent();
 
@@ -317,18 +640,29 @@ void MatlabGenerator::PrintFieldDescriptors(
 void MatlabGenerator::PrintFieldIndecesByNumber(
     Printer & printer, const Descriptor & descriptor) const {
   // Assumes the fields are entered into an array by increasing tag values
-  printer.Print("descriptor.field_indeces_by_number = java.util.HashMap;\n");
-  const FieldDescriptor * field;
-  map<string, string> map_values;
-  vector<pair<int, int> > sorted_fields;
-  for (int i = 0; i < descriptor.field_count(); ++i) {
-    sorted_fields.push_back(make_pair(descriptor.field(i)->number(), i));
+  vector<const FieldDescriptor *> fields = FieldsByNumber(descriptor);
+  printer.Print("descriptor.field_numbers = uint32([");
+  for (int i = 0; i < fields.size(); ++i) {
+    if (i > 0) {
+      printer.Print(i % 10 == 0 ? " ...\n    " : " ");
+    }
+    printer.Print("$number$", "number", SimpleItoa(fields[i]->number()));
   }
-  sort(sorted_fields.begin(), sorted_fields.end());
-  for (int i = 0; i < descriptor.field_count(); ++i) {
-    field = descriptor.field(sorted_fields[i].second);
-    printer.Print("put(descriptor.field_indeces_by_number, uint32($number$), $index$);\n",
-                  "number", SimpleItoa(field->number()),
+  printer.Print("]);\n");
+
+  // Compact field numbers are looked up directly in a table indexed by
+  // number, sparse ones by binary search in field_numbers.
+  int max_number = fields.empty() ? 0 : fields.back()->number();
+  if (max_number > max(kMaxDenseFieldNumber,
+                       kDenseFieldNumberFactor * descriptor.field_count())) {
+    printer.Print("descriptor.field_indeces_by_number = [];\n\n");
+    return;
+  }
+  printer.Print("descriptor.field_indeces_by_number = zeros(1, $max$);\n",
+                "max", SimpleItoa(max_number));
+  for (int i = 0; i < fields.size(); ++i) {
+    printer.Print("descriptor.field_indeces_by_number($number$) = $index$;\n",
+                  "number", SimpleItoa(fields[i]->number()),
                   "index", SimpleItoa(i + 1));
   }
   printer.Print("\n");
@@ -360,7 +694,7 @@ void MatlabGenerator::PrintReadHeader(Printer & printer,
                                       const Descriptor & descriptor) const {
   string name = CamelToLower(descriptor.name());
   string function_name = ReadFunctionName(descriptor);
-  printer.Print("function [$name$] = $function_name$(buffer, buffer_start, buffer_end)\n",
+  printer.Print("function [$name$] = $function_name$(buffer, buffer_start, buffer_end, lazy)\n",
                 "name", name,
                 "function_name", function_name);
 }
@@ -382,6 +716,9 @@ void MatlabGenerator::PrintReadComment(Printer & printer,
                 "%                    defaults to 1\n"
                 "%     buffer_end   : optional ending index to consider of the buffer\n"
                 "%                    defaults to length(buffer)\n"
+                "%     lazy         : optional, if true message and bytes fields are\n"
+                "%                    only decoded when pblib_get is called on them\n"
+                "%                    defaults to false\n"
                 "%\n"
                 "%   MEMBERS:\n");
   for (int i = 0; i < descriptor.field_count(); ++i) {
@@ -480,153 +817,846 @@ void MatlabGenerator::PrintReadBody(Printer & printer,
                 "if (nargin < 3)\n"
                 "  buffer_end = length(buffer);\n"
                 "end\n"
+                "if (nargin < 4)\n"
+                "  lazy = false;\n"
+                "end\n"
                 "\n");
+  PrintMexRead(printer, descriptor);
   string name = CamelToLower(descriptor.name());
   string descriptor_function = DescriptorFunctionName(descriptor);
+  if (specialized_read_) {
+    // Only the generic parser keeps the ranges of lazy fields.
+    printer.Print("if (lazy)\n");
+    printer.Indent();
+  }
   printer.Print("descriptor = $descriptor_function$();\n",
                 "descriptor_function", descriptor_function);
-  printer.Print("$name$ = pblib_generic_parse_from_string(buffer, descriptor, buffer_start, buffer_end);\n",
+  printer.Print("$name$ = pblib_generic_parse_from_string(buffer, descriptor, buffer_start, buffer_end, lazy);\n",
                 "name", name);
   printer.Print("$name$.descriptor_function = @$descriptor_function$;\n",
                 "name", name, "descriptor_function", descriptor_function);
+  if (specialized_read_) {
+    printer.Print("return;\n");
+    printer.Outdent();
+    printer.Print("end\n"
+                  "\n");
+    PrintSpecializedReadBody(printer, descriptor);
+  }
 }
 
 
-string MatlabGenerator::DefaultValueToString(
-    const FieldDescriptor & field) const {
-  MatlabType type = kTypeToMatlabTypeMap[field.type()];
-  field.has_default_value();
-  stringstream s;
-  if (field.is_repeated()) {
-    switch(type) {
-      case MATLABTYPE_INT32:
-        return "int32([])";
-      case MATLABTYPE_INT64:
-        return "int64([])";
-      case MATLABTYPE_UINT32:
-        return "uint32([])";
-      case MATLABTYPE_UINT64:
-        return "uint64([])";
-      case MATLABTYPE_DOUBLE:
-        return "double([])";
-      case MATLABTYPE_SINGLE:
-        return "single([])";
-      case MATLABTYPE_MESSAGE:
-        return "struct([])";
-      case MATLABTYPE_ENUM:
-        return "int32([])";
-      case MATLABTYPE_STRING:
-        return "char([])";
-      case MATLABTYPE_BYTES:
-        return "uint8([])";
+void MatlabGenerator::PrintMexRead(Printer & printer,
+                                   const Descriptor & descriptor) const {
+  map<string, string> m;
+  m["name"] = CamelToLower(descriptor.name());
+  m["descriptor_function"] = DescriptorFunctionName(descriptor);
+  if (!generated_codec_) {
+    printer.Print(m,
+                  "if (~lazy && pblib_mex_available() && isa(buffer, 'uint8'))\n"
+                  "  $name$ = pblib_mex_codec('parse', buffer, $descriptor_function$(), buffer_start, buffer_end);\n"
+                  "  $name$.descriptor_function = @$descriptor_function$;\n"
+                  "  return;\n"
+                  "end\n"
+                  "\n");
+    return;
+  }
+  m["codec"] = CodecFunctionName();
+  m["full_name"] = descriptor.full_name();
+  PrintCodecCheck(printer);
+  printer.Print(m,
+                "if (~lazy && pblib_mex_available() && isa(buffer, 'uint8'))\n"
+                "  if (has_generated_codec)\n"
+                "    $name$ = $codec$('read', '$full_name$', buffer, buffer_start, buffer_end);\n"
+                "  else\n"
+                "    $name$ = pblib_mex_codec('parse', buffer, $descriptor_function$(), buffer_start, buffer_end);\n"
+                "    $name$.descriptor_function = @$descriptor_function$;\n"
+                "  end\n"
+                "  return;\n"
+                "end\n"
+                "\n");
+}
+
+
+void MatlabGenerator::PrintCodecCheck(Printer & printer) const {
+  // Looked up once, pblib_build_codec clears the functions after a build
+  printer.Print("persistent has_generated_codec;\n"
+                "if (isempty(has_generated_codec))\n"
+                "  has_generated_codec = exist('$codec$', 'file') == 3;\n"
+                "end\n",
+                "codec", CodecFunctionName());
+}
+
+
+void MatlabGenerator::PrintSpecializedReadBody(
+    Printer & printer, const Descriptor & descriptor) const {
+  // Works in a local called msg so the field dispatch below can't collide with
+  // the output name, which is derived from the message name.
+  vector<const FieldDescriptor *> fields = FieldsByNumber(descriptor);
+  printer.Print("% Create the has_field flags and set default values\n"
+                "msg.has_field = false(1, $count$);\n",
+                "count", SimpleItoa(fields.size()));
+  for (int i = 0; i < fields.size(); ++i) {
+    printer.Print("msg.$name$ = $default_value$;\n",
+                  "name", fields[i]->name(),
+                  "default_value", DefaultValueToString(*fields[i]));
+  }
+  printer.Print("msg.unknown_fields = [];\n");
+  bool has_repeated = false;
+  for (int i = 0; i < fields.size(); ++i) {
+    has_repeated = has_repeated || fields[i]->is_repeated();
+  }
+  if (has_repeated) {
+    printer.Print("% Repeated fields grow geometrically, field_counts holds the number of\n"
+                  "% elements in use\n"
+                  "field_counts = zeros(1, $count$);\n",
+                  "count", SimpleItoa(fields.size()));
+  }
+  printer.Print("\n"
+                "num_read = buffer_start - 1;\n"
+                "while (num_read < buffer_end)\n");
+  printer.Indent();
+  printer.Print("[number, wire_type, tag_len] = pblib_read_tag(buffer, num_read + 1);\n"
+                "offset = num_read + tag_len + 1;\n"
+                "switch (number)\n");
+  printer.Indent();
+  for (int i = 0; i < fields.size(); ++i) {
+    // Groups are not supported by the matlab library, leave them to the
+    // unknown field handling which reports the error.
+    if (fields[i]->type() == FieldDescriptor::TYPE_GROUP)
+      continue;
+    PrintSpecializedFieldRead(printer, *fields[i]);
+  }
+  printer.Print("otherwise\n");
+  printer.Indent();
+  printer.Print("[value, value_len] = pblib_read_wire_type(buffer, offset, wire_type);\n"
+                "value_len = double(value_len);\n"
+                "msg.unknown_fields = [...\n"
+                "    msg.unknown_fields struct(...\n"
+                "        'number', number, 'wire_type', wire_type, ...\n"
+                "        'raw_data', buffer(num_read + 1 : offset + value_len - 1))];\n");
+  printer.Outdent();
+  printer.Outdent();
+  printer.Print("end\n"
+                "num_read = offset + value_len - 1;\n");
+  printer.Outdent();
+  printer.Print("end\n"
+                "\n");
+
+  if (has_repeated) {
+    printer.Print("% Drop the unused capacity of repeated fields\n");
+    for (int i = 0; i < fields.size(); ++i) {
+      if (!fields[i]->is_repeated())
+        continue;
+      if (IsColumnsField(*fields[i])) {
+        printer.Print("if (field_counts($index$) > 0)\n",
+                      "index", SimpleItoa(i + 1));
+        vector<const FieldDescriptor *> columns =
+            FieldsByNumber(*fields[i]->message_type());
+        for (int j = 0; j < columns.size(); ++j) {
+          printer.Print("  msg.$name$.$column$ = msg.$name$.$column$(1 : field_counts($index$));\n",
+                        "index", SimpleItoa(i + 1),
+                        "name", fields[i]->name(),
+                        "column", columns[j]->name());
+        }
+        printer.Print("end\n");
+        continue;
+      }
+      printer.Print("if (field_counts($index$) > 0 && field_counts($index$) < length(msg.$name$))\n"
+                    "  msg.$name$ = msg.$name$(1 : field_counts($index$));\n"
+                    "end\n",
+                    "index", SimpleItoa(i + 1),
+                    "name", fields[i]->name());
     }
+    printer.Print("\n");
+  }
+
+  for (int i = 0; i < fields.size(); ++i) {
+    if (!fields[i]->is_required())
+      continue;
+    printer.Print("if (~msg.has_field($index$)) % $name$\n"
+                  "  warning('proto:read:required_enforcement', ...\n"
+                  "          'Required field not set while parsing. This is an error.')\n"
+                  "end\n",
+                  "index", SimpleItoa(i + 1),
+                  "name", fields[i]->name());
+  }
+
+  printer.Print("msg.descriptor_function = @$descriptor_function$;\n",
+                "descriptor_function", DescriptorFunctionName(descriptor));
+  printer.Print("$name$ = msg;\n", "name", CamelToLower(descriptor.name()));
+}
+
+
+void MatlabGenerator::PrintSpecializedFieldRead(
+    Printer & printer, const FieldDescriptor & field) const {
+  MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
+  int wire_type = WireFormat::WireTypeForFieldType(field.type());
+  map<string, string> m;
+  m["name"] = field.name();
+  m["index"] = SimpleItoa(FieldIndex(field));
+  m["number"] = SimpleItoa(field.number());
+  m["wire_type"] = SimpleItoa(wire_type);
+  m["label"] = field.is_repeated() ? "repeated" : (field.is_required() ?
+                                                   "required" : "optional");
+  if (field.type() == FieldDescriptor::TYPE_MESSAGE) {
+    m["type"] = field.message_type()->full_name();
+  } else if (field.type() == FieldDescriptor::TYPE_ENUM) {
+    m["type"] = field.enum_type()->full_name();
   } else {
-    switch(type) {
-      case MATLABTYPE_INT32:
-        s << "int32(" << SimpleItoa(field.default_value_int32()) << ")";
-        return s.str();
-      case MATLABTYPE_INT64:
-        s << "int64(" << SimpleItoa(field.default_value_int64()) << ")";
-        return s.str();
-      case MATLABTYPE_UINT32:
-        s << "uint32(";
-        // This is needed as the default values are in a union and if the bool
-        // value is set it doesn't set the full 32 bits
-        if (field.type() == FieldDescriptor::TYPE_BOOL) {
-          s << SimpleItoa(field.default_value_bool());
-        } else {
-          s << SimpleItoa(field.default_value_uint32());
-        }
-        s << ")";
-        return s.str();
-      case MATLABTYPE_UINT64:
-        s << "uint64(" << SimpleItoa(field.default_value_uint64()) << ")";
-        return s.str();
-      case MATLABTYPE_DOUBLE:
-        s << "double(" << SimpleDtoa(field.default_value_double()) << ")";
-        return s.str();
-      case MATLABTYPE_SINGLE:
-        s << "single(" << SimpleFtoa(field.default_value_float()) << ")";
-        return s.str();
-      case MATLABTYPE_MESSAGE:
-        return "struct([])";
-      case MATLABTYPE_ENUM:
-        s << "int32(" << SimpleItoa(field.default_value_enum()->number())<< ")";
-        return s.str();
+    m["type"] = field.type_name();
+  }
+  printer.Print(m, "case $number$ % $label$ $type$ $name$\n");
+  printer.Indent();
+
+  if (field.is_repeated() && wire_type != kWireTypeLengthDelimited) {
+    // Packable field, accept both the packed and the unpacked encoding
+    m["class"] = kMatlabTypeToClassName[matlab_type];
+    m["value"] = MakeReadValueExpression(field, "value");
+    printer.Print(m,
+                  "if (wire_type == $wire_type$)\n");
+    printer.Indent();
+    PrintSpecializedValueRead(printer, wire_type);
+    printer.Print(m, "values = $value$;\n");
+    PrintSpecializedAppend(printer, field);
+    printer.Outdent();
+    printer.Print("elseif (wire_type == 2)\n");
+    printer.Indent();
+    PrintSpecializedValueRead(printer, kWireTypeLengthDelimited);
+    if (wire_type == kWireTypeVarint) {
+      printer.Print(m,
+                    "packed_offset = offset + len_len;\n"
+                    "values = zeros([1 sum(buffer(packed_offset : offset + value_len - 1) < 128)], '$class$');\n"
+                    "for j=1:length(values)\n"
+                    "  [value, element_len] = pblib_read_varint64(buffer, packed_offset);\n"
+                    "  values(j) = $value$;\n"
+                    "  packed_offset = packed_offset + element_len;\n"
+                    "end\n");
+    } else {
+      printer.Print(m,
+                    "values = reshape(typecast(buffer(offset + len_len : offset + value_len - 1), '$class$'), 1, []);\n");
+    }
+    PrintSpecializedAppend(printer, field);
+    printer.Outdent();
+    printer.Print("else\n");
+    printer.Indent();
+    PrintSpecializedWireTypeCheck(printer, field, wire_type);
+    printer.Outdent();
+    printer.Print("end\n");
+  } else {
+    printer.Print(m, "if (wire_type ~= $wire_type$)\n");
+    printer.Indent();
+    PrintSpecializedWireTypeCheck(printer, field, wire_type);
+    printer.Outdent();
+    printer.Print("end\n");
+    PrintSpecializedValueRead(printer, wire_type);
+    switch (matlab_type) {
       case MATLABTYPE_STRING:
-        s << "'" << StringReplace(field.default_value_string(), "'", "''", true) << "'";
-        return s.str();
       case MATLABTYPE_BYTES:
-        s << "uint8('" << StringReplace(field.default_value_string(), "'", "''", true) << "')";
-        return s.str();
+        // Empty values are 0x0, as pblib_generic_parse_from_string and the
+        // default values have them, rather than the 1x0 of an empty range
+        m["class"] = matlab_type == MATLABTYPE_STRING ? "char" : "uint8";
+        printer.Print(m,
+                      "if (len > 0)\n"
+                      "  value = $class$(buffer(offset + len_len : offset + value_len - 1));\n"
+                      "else\n"
+                      "  value = $class$([]);\n"
+                      "end\n");
+        m["value"] = "value";
+        break;
+      case MATLABTYPE_MESSAGE:
+        m["value"] = ReadFunctionName(*field.message_type()) +
+            "(buffer, offset + len_len, offset + value_len - 1)";
+        break;
+      default:
+        m["value"] = MakeReadValueExpression(field, "value");
+    }
+    if (!field.is_repeated()) {
+      printer.Print(m, "msg.$name$ = $value$;\n");
+    } else if (IsColumnsField(field)) {
+      printer.Print(m, "element = $value$;\n");
+      PrintSpecializedColumnsAppend(printer, field);
+    } else if (matlab_type == MATLABTYPE_MESSAGE) {
+      printer.Print(m, "values = $value$;\n");
+      PrintSpecializedAppend(printer, field);
+    } else {
+      // strings and byte arrays must be stored in cell arrays
+      printer.Print(m, "values = {$value$};\n");
+      PrintSpecializedAppend(printer, field);
     }
   }
-  GOOGLE_LOG(FATAL) << "Not reached.";
-  return "''";
+  printer.Print(m, "msg.has_field($index$) = true;\n");
+  printer.Outdent();
 }
 
 
-string MatlabGenerator::MakeReadFunctionHandle(
-    const FieldDescriptor & field) const {
-  MatlabType type = kTypeToMatlabTypeMap[field.type()];
-  FieldDescriptor::Type proto_type = field.type();
-  string function_handle;
-  switch(type) {
-    case MATLABTYPE_INT32:
-      // We must call pblib_helpers_first because the standard varint
-      // will put the result into a uint64
-      //
-      // We must also figure out whether this is encoded using the ZigZag
-      // encoding, which is the case if its type was specificied as sint32 or
-      // sint64
-      if (proto_type == FieldDescriptor::TYPE_SINT32) {
-        return "@(x) pblib_helpers_first(typecast(pblib_helpers_iff(bitget(x, 1), bitset(bitshift(bitxor(intmax('uint64'), x), -1), 64), bitshift(x, -1)), 'int32'))";
-      } else {
-        return "@(x) pblib_helpers_first(typecast(x, 'int32'))";
-      }
-    case MATLABTYPE_INT64:
-      // We must figure out whether this is encoded using the ZigZag encoding,
-      // which is the case if its type was specificied as sint32 or sint64
-      if (proto_type == FieldDescriptor::TYPE_SINT64) {
-        return "@(x) typecast(pblib_helpers_iff(bitget(x, 1), bitset(bitshift(bitxor(intmax('uint64'), x), -1), 64), bitshift(x, -1)), 'int64')";
-      } else {
-        return "@(x) typecast(x, 'int64')";
-      }
-    case MATLABTYPE_UINT32:
-      // We must call pblib_helpers_first because the standard varint
-      // will put the result into a uint64
-      return "@(x) pblib_helpers_first(typecast(x, 'uint32'))";
-    case MATLABTYPE_UINT64:
-      return "@(x) typecast(x, 'uint64')";
-    case MATLABTYPE_DOUBLE:
-      return "@(x) typecast(x, 'double')";
-    case MATLABTYPE_SINGLE:
-      return "@(x) typecast(x, 'single')";
-    case MATLABTYPE_STRING:
-      return "@(x) char(x{1}(x{2} : x{3}))";
-    case MATLABTYPE_BYTES:
-      return "@(x) uint8(x{1}(x{2} : x{3}))";
-    case MATLABTYPE_MESSAGE:
-      return "@(x) " + ReadFunctionName(*field.message_type()) + "(x{1}, x{2}, x{3})";
-    case MATLABTYPE_ENUM:
-      // We must call pblib_helpers_first because the standard varint
-      // will put the result into a uint64
-      return "@(x) pblib_helpers_first(typecast(x, 'int32'))";
+void MatlabGenerator::PrintSpecializedAppend(
+    Printer & printer, const FieldDescriptor & field) const {
+  // Doubles the capacity when it runs out, so that reading n elements one at
+  // a time takes O(n) rather than O(n^2) copies.
+  printer.Print("count = field_counts($index$);\n"
+                "if (count == 0)\n"
+                "  msg.$name$ = values;\n"
+                "else\n"
+                "  new_count = count + length(values);\n"
+                "  if (new_count > length(msg.$name$))\n"
+                "    msg.$name$(2 * new_count) = msg.$name$(1);\n"
+                "  end\n"
+                "  msg.$name$(count + 1 : new_count) = values;\n"
+                "end\n"
+                "field_counts($index$) = count + length(values);\n",
+                "index", SimpleItoa(FieldIndex(field)),
+                "name", field.name());
+}
+
+
+void MatlabGenerator::PrintSpecializedColumnsAppend(
+    Printer & printer, const FieldDescriptor & field) const {
+  // Appends the fields of element to their columns, which grow together the
+  // same way PrintSpecializedAppend grows a repeated field.
+  vector<const FieldDescriptor *> columns =
+      FieldsByNumber(*field.message_type());
+  map<string, string> m;
+  m["index"] = SimpleItoa(FieldIndex(field));
+  m["name"] = field.name();
+  m["first"] = columns[0]->name();
+  printer.Print(m,
+                "count = field_counts($index$);\n"
+                "if (count >= length(msg.$name$.$first$))\n");
+  printer.Indent();
+  for (int i = 0; i < columns.size(); ++i) {
+    m["column"] = columns[i]->name();
+    printer.Print(m, "msg.$name$.$column$(2 * (count + 1)) = 0;\n");
+  }
+  printer.Outdent();
+  printer.Print("end\n");
+  for (int i = 0; i < columns.size(); ++i) {
+    m["column"] = columns[i]->name();
+    printer.Print(m, "msg.$name$.$column$(count + 1) = element.$column$;\n");
   }
-  GOOGLE_LOG(FATAL) << "Shouldn't get here since switch should catch all cases.";
-  return "";
+  printer.Print(m, "field_counts($index$) = count + 1;\n");
 }
 
 
-string MatlabGenerator::MakeWriteFunctionHandle(const FieldDescriptor & field) const {
-  // These functions should undo the work done by the read functions so as to
+void MatlabGenerator::PrintSpecializedWireTypeCheck(
+    Printer & printer, const FieldDescriptor & field, int wire_type) const {
+  printer.Print("error('proto:read:wire_type_mismatch', ...\n"
+                "      ['Wire type mismatch while reading $name$. Got ' ...\n"
+                "       num2str(wire_type) ' but expected $wire_type$']);\n",
+                "name", field.name(),
+                "wire_type", SimpleItoa(wire_type));
+}
+
+
+void MatlabGenerator::PrintSpecializedValueRead(
+    Printer & printer, int wire_type) const {
+  // Sets value_len to the number of bytes the value takes up after the tag and
+  // reads the value into value, or for length delimited values, its length
+  // into len and the length of the length into len_len
+  switch (wire_type) {
+    case kWireTypeVarint:
+      printer.Print("[value, value_len] = pblib_read_varint64(buffer, offset);\n");
+      break;
+    case kWireTypeFixed64:
+      printer.Print("value = buffer(offset : offset + 7);\n"
+                    "value_len = 8;\n");
+      break;
+    case kWireTypeLengthDelimited:
+      printer.Print("[len, len_len] = pblib_read_varint32(buffer, offset);\n"
+                    "value_len = double(len) + len_len;\n");
+      break;
+    case kWireTypeFixed32:
+      printer.Print("value = buffer(offset : offset + 3);\n"
+                    "value_len = 4;\n");
+      break;
+    default:
+      GOOGLE_LOG(FATAL) << "Unhandled wire type " << wire_type
+                        << " in PrintSpecializedValueRead.";
+  }
+}
+
+
+
+void MatlabGenerator::PrintWriteFunction(const Descriptor & descriptor) const {
+  // Print nested messages
+  for (int i = 0; i < descriptor.nested_type_count(); ++i) {
+    PrintWriteFunction(*descriptor.nested_type(i));
+  }
+
+  string filename = WriteFunctionName(descriptor);
+  filename += ".m";
+  google::protobuf::internal::scoped_ptr<
+    google::protobuf::io::ZeroCopyOutputStream>
+      output(output_directory_->Open(filename));
+  Printer printer(output.get(), '$');
+
+  PrintWriteHeader(printer, descriptor);
+  PrintWriteComment(printer, descriptor);
+  printer.Indent();
+  PrintWriteBody(printer, descriptor);
+  printer.Outdent();
+}
+
+
+void MatlabGenerator::PrintWriteHeader(Printer & printer,
+                                       const Descriptor & descriptor) const {
+  printer.Print("function [buffer, num_written, next_size] = $function_name$(msg, buffer, num_written, sizes, next_size)\n",
+                "function_name", WriteFunctionName(descriptor));
+}
+
+
+void MatlabGenerator::PrintWriteComment(Printer & printer,
+                                        const Descriptor & descriptor) const {
+  printer.Print("%$function_name$ Serializes the protobuf message $name$.\n",
+                "name", descriptor.name(),
+                "function_name", WriteFunctionName(descriptor));
+  printer.Print("%   ");
+  PrintWriteHeader(printer, descriptor);
+  printer.Print("%\n"
+                "%   Produces the same bytes as pblib_generic_serialize_to_string, with the\n"
+                "%   tags and the encoding of every field written out for this message.\n"
+                "%\n"
+                "%   INPUTS:\n"
+                "%     msg         : a $name$ message, as returned by $read_function$\n"
+                "%     buffer      : optional, a uint8 row vector to write the message into\n"
+                "%     num_written : the number of bytes at the start of buffer to keep\n"
+                "%     sizes, next_size : used when writing nested messages in place, see\n"
+                "%                   pblib_get_serialized_size\n"
+                "%\n"
+                "%   OUTPUTS:\n"
+                "%     buffer      : the serialized message as a uint8 vector or, given a\n"
+                "%                   buffer, that buffer with the message written after its\n"
+                "%                   first num_written bytes and grown if needed\n"
+                "%     num_written : the number of bytes in use in buffer\n"
+                "%\n"
+                "%   See also $read_function$, pblib_generic_serialize_to_string.\n",
+                "name", descriptor.name(),
+                "read_function", ReadFunctionName(descriptor));
+}
+
+
+void MatlabGenerator::PrintWriteBody(Printer & printer,
+                                     const Descriptor & descriptor) const {
+  printer.Print("\n");
+  if (generated_codec_) {
+    PrintCodecCheck(printer);
+    printer.Print("if (nargin < 4 && pblib_mex_available())\n"
+                  "  if (has_generated_codec)\n"
+                  "    value = $codec$('write', '$full_name$', msg);\n"
+                  "  else\n"
+                  "    value = pblib_mex_codec('serialize', msg, $descriptor_function$());\n"
+                  "  end\n",
+                  "codec", CodecFunctionName(),
+                  "full_name", descriptor.full_name(),
+                  "descriptor_function", DescriptorFunctionName(descriptor));
+  } else {
+    printer.Print("if (nargin < 4 && pblib_mex_available())\n"
+                  "  value = pblib_mex_codec('serialize', msg, $descriptor_function$());\n",
+                  "descriptor_function", DescriptorFunctionName(descriptor));
+  }
+  printer.Print("  if (nargin < 2)\n"
+                "    buffer = value;\n"
+                "    num_written = length(buffer);\n"
+                "  else\n"
+                "    buffer(num_written + 1 : num_written + length(value)) = value;\n"
+                "    num_written = num_written + length(value);\n"
+                "  end\n"
+                "  return;\n"
+                "end\n"
+                "\n");
+  printer.Print("if (nargin < 2)\n"
+                "  buffer = zeros([1 128], 'uint8');\n"
+                "  num_written = 0;\n"
+                "end\n");
+  vector<const FieldDescriptor *> fields = FieldsByNumber(descriptor);
+  // Nested messages are written in place, which needs their sizes up front.
+  // They are computed in one pass for the outermost message and handed down,
+  // each message consumes its own entry of sizes.
+  bool has_message_field = false;
+  for (int i = 0; i < fields.size(); ++i) {
+    has_message_field = has_message_field ||
+        fields[i]->type() == FieldDescriptor::TYPE_MESSAGE;
+  }
+  printer.Print("if (nargin < 5)\n");
+  if (has_message_field) {
+    printer.Print("  [msg_size, sizes] = pblib_get_serialized_size(msg);\n");
+  }
+  printer.Print("  next_size = 1;\n"
+                "end\n"
+                "next_size = next_size + 1;\n"
+                "\n");
+  for (int i = 0; i < fields.size(); ++i) {
+    // Groups are not supported by the matlab library
+    if (fields[i]->type() == FieldDescriptor::TYPE_GROUP)
+      continue;
+    PrintFieldWrite(printer, *fields[i]);
+  }
+  printer.Print("for j=1:length(msg.unknown_fields)\n");
+  printer.Indent();
+  printer.Print("value = msg.unknown_fields(j).raw_data;\n");
+  PrintAppendToBuffer(printer, "value");
+  printer.Outdent();
+  printer.Print("end\n"
+                "if (nargin < 2)\n"
+                "  buffer = buffer(1 : num_written);\n"
+                "end\n");
+}
+
+
+void MatlabGenerator::PrintFieldWrite(Printer & printer,
+                                      const FieldDescriptor & field) const {
+  MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
+  int wire_type = WireFormat::WireTypeForFieldType(field.type());
+  bool packed = field.options().packed();
+  map<string, string> m;
+  m["name"] = field.name();
+  m["index"] = SimpleItoa(FieldIndex(field));
+  if (packed) {
+    m["tag"] = TagBytes(field.number(), kWireTypeLengthDelimited);
+  } else {
+    m["tag"] = TagBytes(field.number(), wire_type);
+  }
+  printer.Print(m, "if (msg.has_field($index$) && ~isempty(msg.$name$))\n");
+  printer.Indent();
+
+  if (field.is_repeated() && packed) {
+    m["values"] = MakeWriteValueExpression(field, "msg." + field.name());
+    if (wire_type == kWireTypeVarint) {
+      printer.Print(m,
+                    "values = $values$;\n"
+                    "packed = zeros([1 10 * length(values)], 'uint8');\n"
+                    "packed_len = 0;\n"
+                    "for j=1:length(values)\n"
+                    "  value = pblib_write_varint(values(j));\n"
+                    "  packed(packed_len + 1 : packed_len + length(value)) = value;\n"
+                    "  packed_len = packed_len + length(value);\n"
+                    "end\n"
+                    "value = packed(1 : packed_len);\n");
+    } else {
+      printer.Print(m, "value = reshape($values$, 1, []);\n");
+    }
+    printer.Print(m, "bytes = [$tag$ pblib_write_varint(uint32(length(value)))];\n");
+    PrintAppendToBuffer(printer, "bytes");
+    PrintAppendToBuffer(printer, "value");
+  } else {
+    string element = "msg." + field.name();
+    if (IsColumnsField(field)) {
+      // Written one message at a time, pblib_get_serialized_size sized them
+      // the same way
+      m["descriptor_function"] = DescriptorFunctionName(*field.message_type());
+      printer.Print(m,
+                    "values = pblib_columns_to_struct(msg.$name$, @$descriptor_function$);\n"
+                    "for j=1:length(values)\n");
+      printer.Indent();
+      element = "values(j)";
+    } else if (field.is_repeated()) {
+      printer.Print(m, "for j=1:length(msg.$name$)\n");
+      printer.Indent();
+      if (matlab_type == MATLABTYPE_STRING || matlab_type == MATLABTYPE_BYTES) {
+        element += "{j}";
+      } else {
+        element += "(j)";
+      }
+    }
+    m["element"] = element;
+    switch (matlab_type) {
+      case MATLABTYPE_STRING:
+        printer.Print(m, "value = uint8($element$);\n");
+        break;
+      case MATLABTYPE_BYTES:
+        printer.Print(m,
+                      "value = $element$;\n"
+                      "if (isstruct(value))\n"
+                      "  % bytes read lazily, see pblib_get\n"
+                      "  value = value.lazy_buffer(value.lazy_start : value.lazy_end);\n"
+                      "end\n"
+                      "value = uint8(value);\n");
+        break;
+      case MATLABTYPE_MESSAGE:
+        m["write_function"] = WriteFunctionName(*field.message_type());
+        printer.Print(m,
+                      "bytes = [$tag$ pblib_write_varint(uint32(sizes(next_size)))];\n");
+        PrintAppendToBuffer(printer, "bytes");
+        if (IsColumnsField(field)) {
+          printer.Print(m,
+                        "[buffer, num_written, next_size] = $write_function$(...\n"
+                        "    $element$, buffer, num_written, sizes, next_size);\n");
+          break;
+        }
+        // A message read lazily is written as the bytes it was read from,
+        // pblib_get_serialized_size gave it an entry of sizes all the same
+        printer.Print(m, "if (isfield($element$, 'lazy_buffer'))\n");
+        printer.Indent();
+        printer.Print(m,
+                      "value = $element$.lazy_buffer($element$.lazy_start : $element$.lazy_end);\n");
+        PrintAppendToBuffer(printer, "value");
+        printer.Print("next_size = next_size + 1;\n");
+        printer.Outdent();
+        printer.Print(m,
+                      "else\n"
+                      "  [buffer, num_written, next_size] = $write_function$(...\n"
+                      "      $element$, buffer, num_written, sizes, next_size);\n"
+                      "end\n");
+        break;
+      default:
+        break;
+    }
+    switch (matlab_type == MATLABTYPE_MESSAGE ? -1 : wire_type) {
+      case -1:
+        // Already written in place above
+        break;
+      case kWireTypeVarint:
+        m["value"] = MakeWriteValueExpression(field, element);
+        printer.Print(m, "bytes = [$tag$ pblib_write_varint($value$)];\n");
+        PrintAppendToBuffer(printer, "bytes");
+        break;
+      case kWireTypeFixed64:
+      case kWireTypeFixed32:
+        m["value"] = MakeWriteValueExpression(field, element);
+        printer.Print(m, "bytes = [$tag$ $value$];\n");
+        PrintAppendToBuffer(printer, "bytes");
+        break;
+      case kWireTypeLengthDelimited:
+        printer.Print(m, "bytes = [$tag$ pblib_write_varint(uint32(length(value)))];\n");
+        PrintAppendToBuffer(printer, "bytes");
+        PrintAppendToBuffer(printer, "value");
+        break;
+      default:
+        GOOGLE_LOG(FATAL) << "Unhandled wire type " << wire_type
+                          << " in PrintFieldWrite.";
+    }
+    if (field.is_repeated()) {
+      printer.Outdent();
+      printer.Print("end\n");
+    }
+  }
+  printer.Outdent();
+  printer.Print("end\n");
+}
+
+
+void MatlabGenerator::PrintAppendToBuffer(Printer & printer,
+                                          const string & variable) const {
+  // The buffer grows geometrically so that writing a message stays linear in
+  // its size
+  printer.Print("if (num_written + length($variable$) > length(buffer))\n"
+                "  buffer(2 * (num_written + length($variable$))) = 0;\n"
+                "end\n"
+                "buffer(num_written + 1 : num_written + length($variable$)) = $variable$;\n"
+                "num_written = num_written + length($variable$);\n",
+                "variable", variable);
+}
+
+bool MatlabGenerator::IsColumnsField(const FieldDescriptor & field) const {
+  if (!columns_ || !field.is_repeated() ||
+      field.type() != FieldDescriptor::TYPE_MESSAGE) {
+    return false;
+  }
+  const Descriptor & message = *field.message_type();
+  if (message.field_count() == 0) {
+    return false;
+  }
+  for (int i = 0; i < message.field_count(); ++i) {
+    const FieldDescriptor & column = *message.field(i);
+    switch (kTypeToMatlabTypeMap[column.type()]) {
+      case MATLABTYPE_STRING:
+      case MATLABTYPE_BYTES:
+      case MATLABTYPE_MESSAGE:
+        return false;
+      default:
+        if (column.is_repeated())
+          return false;
+    }
+  }
+  return true;
+}
+
+
+string MatlabGenerator::DefaultValueToString(
+    const FieldDescriptor & field) const {
+  MatlabType type = kTypeToMatlabTypeMap[field.type()];
+  field.has_default_value();
+  stringstream s;
+  if (IsColumnsField(field)) {
+    // One empty row vector per field of the message, of the field's class
+    vector<const FieldDescriptor *> columns =
+        FieldsByNumber(*field.message_type());
+    s << "struct(";
+    for (int i = 0; i < columns.size(); ++i) {
+      if (i > 0)
+        s << ", ";
+      s << "'" << columns[i]->name() << "', zeros(1, 0, '"
+        << kMatlabTypeToClassName[kTypeToMatlabTypeMap[columns[i]->type()]]
+        << "')";
+    }
+    s << ")";
+    return s.str();
+  }
+  if (field.is_repeated()) {
+    switch(type) {
+      case MATLABTYPE_INT32:
+        return "int32([])";
+      case MATLABTYPE_INT64:
+        return "int64([])";
+      case MATLABTYPE_UINT32:
+        return "uint32([])";
+      case MATLABTYPE_UINT64:
+        return "uint64([])";
+      case MATLABTYPE_DOUBLE:
+        return "double([])";
+      case MATLABTYPE_SINGLE:
+        return "single([])";
+      case MATLABTYPE_MESSAGE:
+        return "struct([])";
+      case MATLABTYPE_ENUM:
+        return "int32([])";
+      case MATLABTYPE_STRING:
+        return "char([])";
+      case MATLABTYPE_BYTES:
+        return "uint8([])";
+    }
+  } else {
+    switch(type) {
+      case MATLABTYPE_INT32:
+        s << "int32(" << SimpleItoa(field.default_value_int32()) << ")";
+        return s.str();
+      case MATLABTYPE_INT64:
+        s << "int64(" << SimpleItoa(field.default_value_int64()) << ")";
+        return s.str();
+      case MATLABTYPE_UINT32:
+        s << "uint32(";
+        // This is needed as the default values are in a union and if the bool
+        // value is set it doesn't set the full 32 bits
+        if (field.type() == FieldDescriptor::TYPE_BOOL) {
+          s << SimpleItoa(field.default_value_bool());
+        } else {
+          s << SimpleItoa(field.default_value_uint32());
+        }
+        s << ")";
+        return s.str();
+      case MATLABTYPE_UINT64:
+        s << "uint64(" << SimpleItoa(field.default_value_uint64()) << ")";
+        return s.str();
+      case MATLABTYPE_DOUBLE:
+        s << "double(" << SimpleDtoa(field.default_value_double()) << ")";
+        return s.str();
+      case MATLABTYPE_SINGLE:
+        s << "single(" << SimpleFtoa(field.default_value_float()) << ")";
+        return s.str();
+      case MATLABTYPE_MESSAGE:
+        return "struct([])";
+      case MATLABTYPE_ENUM:
+        s << "int32(" << SimpleItoa(field.default_value_enum()->number())<< ")";
+        return s.str();
+      case MATLABTYPE_STRING:
+        s << "'" << StringReplace(field.default_value_string(), "'", "''", true) << "'";
+        return s.str();
+      case MATLABTYPE_BYTES:
+        s << "uint8('" << StringReplace(field.default_value_string(), "'", "''", true) << "')";
+        return s.str();
+    }
+  }
+  GOOGLE_LOG(FATAL) << "Not reached.";
+  return "''";
+}
+
+
+string MatlabGenerator::MakeReadFunctionHandle(
+    const FieldDescriptor & field) const {
+  MatlabType type = kTypeToMatlabTypeMap[field.type()];
+  switch(type) {
+    case MATLABTYPE_STRING:
+      return "@(x) char(x{1}(x{2} : x{3}))";
+    case MATLABTYPE_BYTES:
+      return "@(x) uint8(x{1}(x{2} : x{3}))";
+    case MATLABTYPE_MESSAGE:
+      return "@(x) " + ReadFunctionName(*field.message_type()) + "(x{1}, x{2}, x{3})";
+    default:
+      return "@(x) " + MakeReadValueExpression(field, "x");
+  }
+}
+
+
+string MatlabGenerator::MakeReadValueExpression(
+    const FieldDescriptor & field, const string & value) const {
+  // Converts value, as returned by pblib_read_wire_type for a varint, 64bit or
+  // 32bit wire type, into the matlab value of field.
+  MatlabType type = kTypeToMatlabTypeMap[field.type()];
+  FieldDescriptor::Type proto_type = field.type();
+  string expression;
+  switch(type) {
+    case MATLABTYPE_INT32:
+      // We must call pblib_helpers_first because the standard varint
+      // will put the result into a uint64
+      //
+      // We must also figure out whether this is encoded using the ZigZag
+      // encoding, which is the case if its type was specificied as sint32 or
+      // sint64
+      if (proto_type == FieldDescriptor::TYPE_SINT32) {
+        expression = "pblib_helpers_first(typecast(pblib_helpers_iff(bitget($x$, 1), bitset(bitshift(bitxor(intmax('uint64'), $x$), -1), 64), bitshift($x$, -1)), 'int32'))";
+      } else {
+        expression = "pblib_helpers_first(typecast($x$, 'int32'))";
+      }
+      break;
+    case MATLABTYPE_INT64:
+      // We must figure out whether this is encoded using the ZigZag encoding,
+      // which is the case if its type was specificied as sint32 or sint64
+      if (proto_type == FieldDescriptor::TYPE_SINT64) {
+        expression = "typecast(pblib_helpers_iff(bitget($x$, 1), bitset(bitshift(bitxor(intmax('uint64'), $x$), -1), 64), bitshift($x$, -1)), 'int64')";
+      } else {
+        expression = "typecast($x$, 'int64')";
+      }
+      break;
+    case MATLABTYPE_UINT32:
+      // We must call pblib_helpers_first because the standard varint
+      // will put the result into a uint64
+      expression = "pblib_helpers_first(typecast($x$, 'uint32'))";
+      break;
+    case MATLABTYPE_UINT64:
+      expression = "typecast($x$, 'uint64')";
+      break;
+    case MATLABTYPE_DOUBLE:
+      expression = "typecast($x$, 'double')";
+      break;
+    case MATLABTYPE_SINGLE:
+      expression = "typecast($x$, 'single')";
+      break;
+    case MATLABTYPE_ENUM:
+      // We must call pblib_helpers_first because the standard varint
+      // will put the result into a uint64
+      expression = "pblib_helpers_first(typecast($x$, 'int32'))";
+      break;
+    default:
+      GOOGLE_LOG(FATAL) << "No read expression for matlab type " << type << ".";
+  }
+  return StringReplace(expression, "$x$", value, true);
+}
+
+
+string MatlabGenerator::MakeWriteFunctionHandle(const FieldDescriptor & field) const {
+  MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
+  switch(matlab_type) {
+    case MATLABTYPE_STRING:
+      return "@uint8";
+    case MATLABTYPE_BYTES:
+      return "@uint8";
+    case MATLABTYPE_MESSAGE:
+      return "@pblib_generic_serialize_to_string";
+    default:
+      return "@(x) " + MakeWriteValueExpression(field, "x");
+  }
+}
+
+
+string MatlabGenerator::MakeWriteValueExpression(
+    const FieldDescriptor & field, const string & value) const {
+  // These expressions should undo the work done by the read functions so as to
   // pass as input to write_varint the same values that read_varint would pass
   // back as output.  That's why, in particular, we typecast fixed32,
   // sfixed32, etc. into uint8 as that's how read_varint would return them to
   // us.
   MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
   FieldDescriptor::Type type = field.type();
-  string function_handle;
+  string expression;
   switch(matlab_type) {
     case MATLABTYPE_INT32:
       // We must figure out whether this is encoded using the ZigZag encoding,
@@ -635,13 +1665,17 @@ string MatlabGenerator::MakeWriteFunctionHandle(const FieldDescriptor & field) c
       // found we can do the zigzag with (n<<1) ^ (n>>31)
       switch (type) {
         case FieldDescriptor::TYPE_INT32:
-          return "@(x) typecast(int32(x), 'uint32')";
+          expression = "typecast(int32($x$), 'uint32')";
+          break;
         case FieldDescriptor::TYPE_SFIXED32:
-          return "@(x) typecast(int32(x), 'uint8')";
+          expression = "typecast(int32($x$), 'uint8')";
+          break;
         case FieldDescriptor::TYPE_SINT32:
-          return "@(x) typecast(pblib_helpers_iff(int32(x) < 0, -2 * int32(x) - 1, 2 * int32(x)), 'uint32')";
+          expression = "typecast(pblib_helpers_iff(int32($x$) < 0, -2 * int32($x$) - 1, 2 * int32($x$)), 'uint32')";
+          break;
+        default:
+          GOOGLE_LOG(DFATAL)<<"Unhandled matlabtype_int32 type "<<type<<" in WriteValueExpression.";
       }
-      GOOGLE_LOG(DFATAL)<<"Unhandled matlabtype_int32 type "<<type<<" in WriteFunctionHandle.";
       break;
     case MATLABTYPE_INT64:
       // We must figure out whether this is encoded using the ZigZag encoding,
@@ -650,50 +1684,805 @@ string MatlabGenerator::MakeWriteFunctionHandle(const FieldDescriptor & field) c
       // found we can do the zigzag with (n<<1) ^ (n>>63)
       switch(type) {
         case FieldDescriptor::TYPE_INT64:
-          return "@(x) typecast(int64(x), 'uint64')";
+          expression = "typecast(int64($x$), 'uint64')";
+          break;
         case FieldDescriptor::TYPE_SFIXED64:
-          return "@(x) typecast(int64(x), 'uint8')";
+          expression = "typecast(int64($x$), 'uint8')";
+          break;
         case FieldDescriptor::TYPE_SINT64:
-          return "@(x) pblib_helpers_iff(int64(x) < 0, bitxor(bitshift(typecast(int64(x), 'uint64'), 1), intmax('uint64')), bitshift(typecast(int64(x), 'uint64'), 1))";
+          expression = "pblib_helpers_iff(int64($x$) < 0, bitxor(bitshift(typecast(int64($x$), 'uint64'), 1), intmax('uint64')), bitshift(typecast(int64($x$), 'uint64'), 1))";
+          break;
+        default:
+          GOOGLE_LOG(DFATAL)<<"Unhandled matlabtype_int64 type "<<type<<" in WriteValueExpression.";
       }
-      GOOGLE_LOG(DFATAL)<<"Unhandled matlabtype_int32 type "<<type<<" in WriteFunctionHandle.";
       break;
     case MATLABTYPE_UINT32:
       switch(type) {
         case FieldDescriptor::TYPE_FIXED32:
-          return "@(x) typecast(uint32(x), 'uint8')";
+          expression = "typecast(uint32($x$), 'uint8')";
+          break;
         case FieldDescriptor::TYPE_BOOL:
         case FieldDescriptor::TYPE_UINT32:
-          return "@(x) typecast(uint32(x), 'uint32')";
+          expression = "typecast(uint32($x$), 'uint32')";
+          break;
+        default:
+          GOOGLE_LOG(DFATAL)<<"Unhandled matlabtype_uint32 type "<<type<<" in WriteValueExpression.";
       }
-      GOOGLE_LOG(DFATAL)<<"Unhandled matlabtype_uint32 type "<<type<<" in WriteFunctionHandle.";
       break;
     case MATLABTYPE_UINT64:
       switch(type) {
         case FieldDescriptor::TYPE_UINT64:
-          return "@(x) typecast(uint64(x), 'uint64')";
+          expression = "typecast(uint64($x$), 'uint64')";
+          break;
         case FieldDescriptor::TYPE_FIXED64:
-          return "@(x) typecast(uint64(x), 'uint8')";
+          expression = "typecast(uint64($x$), 'uint8')";
+          break;
+        default:
+          GOOGLE_LOG(DFATAL)<<"Unhandled matlabtype_uint64 type "<<type<<" in WriteValueExpression.";
       }
-      GOOGLE_LOG(DFATAL)<<"Unhandled matlabtype_uint64 type "<<type<<" in WriteFunctionHandle.";
       break;
     case MATLABTYPE_DOUBLE:
-      return "@(x) typecast(double(x), 'uint8')";
+      expression = "typecast(double($x$), 'uint8')";
+      break;
     case MATLABTYPE_SINGLE:
-      return "@(x) typecast(single(x), 'uint8')";
+      expression = "typecast(single($x$), 'uint8')";
+      break;
+    case MATLABTYPE_ENUM:
+      expression = "typecast(int32($x$), 'uint32')";
+      break;
+    default:
+      GOOGLE_LOG(DFATAL) << "No write expression for matlab type " << matlab_type << ".";
+  }
+  return StringReplace(expression, "$x$", value, true);
+}
+
+
+void MatlabGenerator::PrintGeneratedCodec() const {
+  // Every message reachable from the file gets its functions, imported ones
+  // included, since nested messages are read by direct calls.
+  set<const Descriptor *> seen;
+  vector<const Descriptor *> messages;
+  for (int i = 0; i < file_->message_type_count(); ++i) {
+    CollectCodecMessages(*file_->message_type(i), &seen, &messages);
+  }
+  set<const Descriptor *> columns_messages;
+  for (int i = 0; i < messages.size(); ++i) {
+    for (int j = 0; j < messages[i]->field_count(); ++j) {
+      if (IsColumnsField(*messages[i]->field(j)))
+        columns_messages.insert(messages[i]->field(j)->message_type());
+    }
+  }
+
+  string filename = CodecFunctionName() + ".cc";
+  google::protobuf::internal::scoped_ptr<
+    google::protobuf::io::ZeroCopyOutputStream>
+      output(output_directory_->Open(filename));
+  Printer printer(output.get(), '$');
+
+  printer.Print("// Generated by the protocol buffer compiler.  DO NOT EDIT!\n"
+                "// source: $source$\n"
+                "//\n"
+                "// The $codec$ mex function, which reads and writes the messages of\n"
+                "// $source$ for their pb_read_* and pb_write_* functions.  Build it\n"
+                "// with pblib_build_codec.\n"
+                "\n"
+                "#include <farsounder/protobuf/matlab/generated_codec.h>\n"
+                "\n"
+                "namespace farsounder {\n"
+                "namespace protobuf {\n"
+                "namespace matlab {\n"
+                "namespace {\n"
+                "\n",
+                "source", file_->name(),
+                "codec", CodecFunctionName());
+  for (int i = 0; i < messages.size(); ++i) {
+    const Descriptor & descriptor = *messages[i];
+    vector<const FieldDescriptor *> fields = FieldsByNumber(descriptor);
+    map<string, string> m;
+    m["id"] = CodecIdentifier(descriptor);
+    printer.Print(m,
+                  "const char* kNames_$id$[] = {\n"
+                  "  \"has_field\",\n");
+    for (int j = 0; j < fields.size(); ++j) {
+      printer.Print("  \"$name$\",\n", "name", fields[j]->name());
+    }
+    printer.Print(m,
+                  "  \"unknown_fields\",\n"
+                  "  \"descriptor_function\",\n"
+                  "};\n"
+                  "mxArray* descriptor_function_$id$ = NULL;\n"
+                  "void Read_$id$(const uint8_t* buffer, size_t begin, size_t end,\n"
+                  "    int depth, mxArray* array, size_t element);\n"
+                  "size_t Size_$id$(const mxArray* msg, size_t element,\n"
+                  "    std::vector<size_t>* sizes);\n"
+                  "uint8_t* Write_$id$(const mxArray* msg, size_t element,\n"
+                  "    const size_t** next_size, uint8_t* target);\n");
+    if (columns_messages.count(&descriptor) > 0) {
+      printer.Print(m,
+                    "mxArray* ReadColumns_$id$(const uint8_t* buffer,\n"
+                    "    const std::vector<Range>& rows, int depth);\n");
+    }
+    printer.Print("\n");
+  }
+  for (int i = 0; i < messages.size(); ++i) {
+    PrintCodecRead(printer, *messages[i]);
+    if (columns_messages.count(messages[i]) > 0)
+      PrintCodecColumnsRead(printer, *messages[i]);
+    PrintCodecSize(printer, *messages[i]);
+    PrintCodecWrite(printer, *messages[i]);
+  }
+
+  printer.Print("const GeneratedMessage kMessages[] = {\n");
+  for (int i = 0; i < messages.size(); ++i) {
+    printer.Print("  {\"$full_name$\", kNames_$id$, $count$, Read_$id$, Size_$id$,\n"
+                  "   Write_$id$},\n",
+                  "full_name", messages[i]->full_name(),
+                  "id", CodecIdentifier(*messages[i]),
+                  "count", SimpleItoa(messages[i]->field_count() + 3));
+  }
+  printer.Print("};\n"
+                "\n"
+                "}  // namespace\n"
+                "}  // namespace matlab\n"
+                "}  // namespace protobuf\n"
+                "}  // namespace farsounder\n"
+                "\n"
+                "void mexFunction(int nlhs, mxArray* plhs[], int nrhs,\n"
+                "                 const mxArray* prhs[]) {\n"
+                "  farsounder::protobuf::matlab::RunGeneratedCodec(\n"
+                "      farsounder::protobuf::matlab::kMessages,\n"
+                "      sizeof(farsounder::protobuf::matlab::kMessages) /\n"
+                "          sizeof(farsounder::protobuf::matlab::kMessages[0]),\n"
+                "      nlhs, plhs, nrhs, prhs);\n"
+                "}\n");
+}
+
+
+void MatlabGenerator::PrintCodecRead(Printer & printer,
+                                     const Descriptor & descriptor) const {
+  vector<const FieldDescriptor *> fields = FieldsByNumber(descriptor);
+  map<string, string> m;
+  m["id"] = CodecIdentifier(descriptor);
+  m["count"] = SimpleItoa(fields.size());
+  m["unknown_fields_index"] = SimpleItoa(fields.size() + 1);
+  m["descriptor_function_index"] = SimpleItoa(fields.size() + 2);
+  m["descriptor_function"] = DescriptorFunctionName(descriptor);
+  printer.Print(m,
+                "void Read_$id$(const uint8_t* buffer, size_t begin, size_t end,\n"
+                "    int depth, mxArray* array, size_t element) {\n");
+  printer.Indent();
+  printer.Print("CheckDepth(depth);\n");
+  if (!fields.empty()) {
+    printer.Print(m, "bool has[$count$] = {false};\n");
+  }
+  // Values are collected in locals named after the field's index, field
+  // names could be C++ keywords.
+  bool has_numeric_field = false;
+  for (int i = 0; i < fields.size(); ++i) {
+    const FieldDescriptor & field = *fields[i];
+    MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
+    m["k"] = SimpleItoa(i);
+    m["type"] = kCodecCppTypes[matlab_type];
+    if (field.type() == FieldDescriptor::TYPE_GROUP) {
+      // Groups are not supported by the matlab library
+      continue;
+    } else if (matlab_type == MATLABTYPE_STRING ||
+               matlab_type == MATLABTYPE_BYTES ||
+               matlab_type == MATLABTYPE_MESSAGE) {
+      if (field.is_repeated()) {
+        printer.Print(m, "std::vector<Range> ranges_$k$;\n");
+      } else {
+        printer.Print(m, "Range range_$k$ = {0, 0};\n");
+      }
+    } else {
+      has_numeric_field = true;
+      if (field.is_repeated()) {
+        printer.Print(m, "std::vector<$type$> values_$k$;\n");
+      } else {
+        m["default"] = CodecDefaultLiteral(field);
+        printer.Print(m, "$type$ value_$k$ = $default$;\n");
+      }
+    }
+  }
+  printer.Print("std::vector<UnknownField> unknown_fields;\n"
+                "size_t position = begin;\n"
+                "while (position < end) {\n"
+                "  size_t tag_begin = position;\n"
+                "  uint64_t tag;\n"
+                "  position = ReadVarint(buffer, position, end, &tag);\n");
+  if (has_numeric_field) {
+    printer.Print("  uint64_t value;\n");
+  }
+  printer.Print("  switch (tag >> 3) {\n");
+  printer.Indent();
+  printer.Indent();
+  for (int i = 0; i < fields.size(); ++i) {
+    if (fields[i]->type() != FieldDescriptor::TYPE_GROUP)
+      PrintCodecFieldRead(printer, *fields[i], i);
+  }
+  printer.Print("default:\n"
+                "  position = SkipUnknownField(buffer, tag_begin, position, end, tag,\n"
+                "                              &unknown_fields);\n"
+                "  break;\n");
+  printer.Outdent();
+  printer.Outdent();
+  printer.Print("  }\n"
+                "}\n"
+                "\n");
+
+  printer.Print(m, "mxArray* has_field = mxCreateLogicalMatrix(1, $count$);\n");
+  if (!fields.empty()) {
+    printer.Print(m,
+                  "mxLogical* has_data = mxGetLogicals(has_field);\n"
+                  "for (int k = 0; k < $count$; ++k) {\n"
+                  "  has_data[k] = has[k];\n"
+                  "}\n");
+  }
+  printer.Print("mxSetFieldByNumber(array, element, 0, has_field);\n");
+  for (int i = 0; i < fields.size(); ++i) {
+    PrintCodecFieldCreate(printer, *fields[i], i);
+  }
+  printer.Print(m,
+                "mxSetFieldByNumber(array, element, $unknown_fields_index$,\n"
+                "                   CreateUnknownFields(buffer, unknown_fields));\n"
+                "mxSetFieldByNumber(array, element, $descriptor_function_index$,\n"
+                "                   DuplicateFunctionHandle(\"$descriptor_function$\",\n"
+                "                                           &descriptor_function_$id$));\n");
+  printer.Outdent();
+  printer.Print("}\n"
+                "\n");
+}
+
+
+void MatlabGenerator::PrintCodecFieldRead(Printer & printer,
+                                          const FieldDescriptor & field,
+                                          int index) const {
+  MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
+  int wire_type = WireFormat::WireTypeForFieldType(field.type());
+  map<string, string> m;
+  m["name"] = field.name();
+  m["number"] = SimpleItoa(field.number());
+  m["k"] = SimpleItoa(index);
+  m["wire_type"] = SimpleItoa(wire_type);
+  m["field_type"] = SimpleItoa(field.type());
+  m["value"] = CodecDecodeExpression(field);
+  switch (wire_type) {
+    case kWireTypeFixed64:
+      m["read"] = "position = ReadFixed(buffer, position, end, 8, &value);";
+      break;
+    case kWireTypeFixed32:
+      m["read"] = "position = ReadFixed(buffer, position, end, 4, &value);";
+      break;
+    default:
+      m["read"] = "position = ReadVarint(buffer, position, end, &value);";
+  }
+  printer.Print(m, "case $number$:  // $name$\n");
+  printer.Indent();
+
+  if (matlab_type == MATLABTYPE_STRING || matlab_type == MATLABTYPE_BYTES ||
+      matlab_type == MATLABTYPE_MESSAGE) {
+    printer.Print(m,
+                  "if ((tag & 7) != 2) {\n"
+                  "  ThrowWireTypeMismatch(buffer, position, end, tag, \"$name$\");\n"
+                  "}\n");
+    if (field.is_repeated()) {
+      printer.Print(m,
+                    "ranges_$k$.push_back(Range());\n"
+                    "position = ReadLengthDelimited(buffer, position, end,\n"
+                    "                               &ranges_$k$.back());\n");
+    } else {
+      printer.Print(m,
+                    "position = ReadLengthDelimited(buffer, position, end, &range_$k$);\n");
+    }
+  } else if (field.is_repeated()) {
+    // Packable field, accept both the packed and the unpacked encoding
+    printer.Print(m,
+                  "if ((tag & 7) == 2) {\n"
+                  "  position = ReadPacked($field_type$, \"$name$\", buffer, position, end,\n"
+                  "                        &values_$k$);\n"
+                  "} else if ((tag & 7) == $wire_type$) {\n"
+                  "  $read$\n"
+                  "  values_$k$.push_back($value$);\n"
+                  "} else {\n"
+                  "  ThrowWireTypeMismatch(buffer, position, end, tag, \"$name$\");\n"
+                  "}\n");
+  } else {
+    printer.Print(m,
+                  "if ((tag & 7) != $wire_type$) {\n"
+                  "  ThrowWireTypeMismatch(buffer, position, end, tag, \"$name$\");\n"
+                  "}\n"
+                  "$read$\n"
+                  "value_$k$ = $value$;\n");
+  }
+  printer.Print(m,
+                "has[$k$] = true;\n"
+                "break;\n");
+  printer.Outdent();
+}
+
+
+void MatlabGenerator::PrintCodecFieldCreate(Printer & printer,
+                                            const FieldDescriptor & field,
+                                            int index) const {
+  MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
+  map<string, string> m;
+  m["k"] = SimpleItoa(index);
+  m["index"] = SimpleItoa(index + 1);
+  m["class"] = kCodecClassIds[matlab_type];
+  m["type"] = kCodecCppTypes[matlab_type];
+  if (field.type() == FieldDescriptor::TYPE_GROUP) {
+    printer.Print(m,
+                  "mxSetFieldByNumber(array, element, $index$, CreateEmpty(mxSTRUCT_CLASS));\n");
+    return;
+  }
+  if (matlab_type == MATLABTYPE_MESSAGE) {
+    const Descriptor & message = *field.message_type();
+    m["message_id"] = CodecIdentifier(message);
+    m["struct_field_count"] = SimpleItoa(message.field_count() + 3);
+  }
+  if (!field.is_repeated() && (matlab_type == MATLABTYPE_STRING ||
+                               matlab_type == MATLABTYPE_BYTES)) {
+    m["default"] = "\"" + CEscape(field.default_value_string()) + "\"";
+    m["default_size"] = SimpleItoa(field.default_value_string().size());
+  }
+
+  if (IsColumnsField(field)) {
+    printer.Print(m,
+                  "mxSetFieldByNumber(array, element, $index$,\n"
+                  "                   ReadColumns_$message_id$(buffer, ranges_$k$, depth + 1));\n");
+  } else if (matlab_type == MATLABTYPE_MESSAGE) {
+    if (field.is_repeated()) {
+      printer.Print(m,
+                    "if (has[$k$]) {\n"
+                    "  mxArray* value = mxCreateStructMatrix(1, ranges_$k$.size(),\n"
+                    "                                        $struct_field_count$, kNames_$message_id$);\n"
+                    "  mxSetFieldByNumber(array, element, $index$, value);\n"
+                    "  for (size_t i = 0; i < ranges_$k$.size(); ++i) {\n"
+                    "    Read_$message_id$(buffer, ranges_$k$[i].begin, ranges_$k$[i].end,\n"
+                    "        depth + 1, value, i);\n"
+                    "  }\n");
+    } else {
+      printer.Print(m,
+                    "if (has[$k$]) {\n"
+                    "  mxArray* value = mxCreateStructMatrix(1, 1, $struct_field_count$,\n"
+                    "                                        kNames_$message_id$);\n"
+                    "  mxSetFieldByNumber(array, element, $index$, value);\n"
+                    "  Read_$message_id$(buffer, range_$k$.begin, range_$k$.end, depth + 1,\n"
+                    "      value, 0);\n");
+    }
+    printer.Print(m,
+                  "} else {\n"
+                  "  mxSetFieldByNumber(array, element, $index$, CreateEmpty(mxSTRUCT_CLASS));\n"
+                  "}\n");
+  } else if (matlab_type == MATLABTYPE_STRING) {
+    if (field.is_repeated()) {
+      printer.Print(m,
+                    "mxSetFieldByNumber(array, element, $index$,\n"
+                    "                   has[$k$] ? CreateStringCell(buffer, ranges_$k$)\n"
+                    "                          : CreateEmpty(mxCHAR_CLASS));\n");
+    } else {
+      printer.Print(m,
+                    "mxSetFieldByNumber(array, element, $index$,\n"
+                    "                   has[$k$] ? CreateString(buffer + range_$k$.begin,\n"
+                    "                                         range_$k$.end - range_$k$.begin)\n"
+                    "                          : CreateDefaultString($default$, $default_size$));\n");
+    }
+  } else if (matlab_type == MATLABTYPE_BYTES) {
+    if (field.is_repeated()) {
+      printer.Print(m,
+                    "mxSetFieldByNumber(array, element, $index$,\n"
+                    "                   has[$k$] ? CreateBytesCell(buffer, ranges_$k$)\n"
+                    "                          : CreateEmpty(mxUINT8_CLASS));\n");
+    } else {
+      printer.Print(m,
+                    "mxSetFieldByNumber(array, element, $index$,\n"
+                    "                   has[$k$] ? CreateBytes(buffer + range_$k$.begin,\n"
+                    "                                        range_$k$.end - range_$k$.begin)\n"
+                    "                          : CreateDefaultBytes($default$, $default_size$));\n");
+    }
+  } else if (field.is_repeated()) {
+    printer.Print(m,
+                  "mxSetFieldByNumber(array, element, $index$,\n"
+                  "                   has[$k$] ? CreateRow($class$, values_$k$)\n"
+                  "                          : CreateEmpty($class$));\n");
+  } else {
+    // value_k starts out as the default value
+    printer.Print(m,
+                  "mxSetFieldByNumber(array, element, $index$,\n"
+                  "                   CreateScalar<$type$>($class$, value_$k$));\n");
+  }
+  if (field.is_required()) {
+    printer.Print(m,
+                  "if (!has[$k$]) {\n"
+                  "  WarnRequiredFieldMissing();\n"
+                  "}\n");
+  }
+}
+
+
+void MatlabGenerator::PrintCodecColumnsRead(
+    Printer & printer, const Descriptor & descriptor) const {
+  vector<const FieldDescriptor *> fields = FieldsByNumber(descriptor);
+  map<string, string> m;
+  m["id"] = CodecIdentifier(descriptor);
+  m["count"] = SimpleItoa(fields.size());
+  printer.Print(m,
+                "mxArray* ReadColumns_$id$(const uint8_t* buffer,\n"
+                "    const std::vector<Range>& rows, int depth) {\n");
+  printer.Indent();
+  // The column names are the field names, which follow has_field
+  printer.Print(m,
+                "CheckDepth(depth);\n"
+                "mxArray* columns = mxCreateStructMatrix(1, 1, $count$, kNames_$id$ + 1);\n");
+  for (int i = 0; i < fields.size(); ++i) {
+    MatlabType matlab_type = kTypeToMatlabTypeMap[fields[i]->type()];
+    m["k"] = SimpleItoa(i);
+    m["class"] = kCodecClassIds[matlab_type];
+    m["type"] = kCodecCppTypes[matlab_type];
+    printer.Print(m,
+                  "mxArray* column_$k$ = mxCreateNumericMatrix(1, rows.size(), $class$, mxREAL);\n"
+                  "mxSetFieldByNumber(columns, 0, $k$, column_$k$);\n"
+                  "$type$* data_$k$ = static_cast<$type$*>(mxGetData(column_$k$));\n");
+  }
+  printer.Print("for (size_t row = 0; row < rows.size(); ++row) {\n");
+  printer.Indent();
+  for (int i = 0; i < fields.size(); ++i) {
+    printer.Print("data_$k$[row] = $default$;\n",
+                  "k", SimpleItoa(i),
+                  "default", CodecDefaultLiteral(*fields[i]));
+  }
+  printer.Print("size_t position = rows[row].begin;\n"
+                "size_t end = rows[row].end;\n"
+                "while (position < end) {\n"
+                "  uint64_t tag;\n"
+                "  position = ReadVarint(buffer, position, end, &tag);\n"
+                "  uint64_t value;\n"
+                "  switch (tag >> 3) {\n");
+  printer.Indent();
+  printer.Indent();
+  for (int i = 0; i < fields.size(); ++i) {
+    const FieldDescriptor & field = *fields[i];
+    int wire_type = WireFormat::WireTypeForFieldType(field.type());
+    m["k"] = SimpleItoa(i);
+    m["name"] = field.name();
+    m["number"] = SimpleItoa(field.number());
+    m["wire_type"] = SimpleItoa(wire_type);
+    m["value"] = CodecDecodeExpression(field);
+    switch (wire_type) {
+      case kWireTypeFixed64:
+        m["read"] = "position = ReadFixed(buffer, position, end, 8, &value);";
+        break;
+      case kWireTypeFixed32:
+        m["read"] = "position = ReadFixed(buffer, position, end, 4, &value);";
+        break;
+      default:
+        m["read"] = "position = ReadVarint(buffer, position, end, &value);";
+    }
+    printer.Print(m,
+                  "case $number$:  // $name$\n"
+                  "  if ((tag & 7) != $wire_type$) {\n"
+                  "    ThrowWireTypeMismatch(buffer, position, end, tag, \"$name$\");\n"
+                  "  }\n"
+                  "  $read$\n"
+                  "  data_$k$[row] = $value$;\n"
+                  "  break;\n");
+  }
+  // Like pblib_mex_codec, the unknown fields of the rows are dropped
+  printer.Print("default:\n"
+                "  position = SkipValue(buffer, position, end, static_cast<int>(tag & 7));\n"
+                "  break;\n");
+  printer.Outdent();
+  printer.Outdent();
+  printer.Print("  }\n"
+                "}\n");
+  printer.Outdent();
+  printer.Print("}\n"
+                "return columns;\n");
+  printer.Outdent();
+  printer.Print("}\n"
+                "\n");
+}
+
+
+void MatlabGenerator::PrintCodecSize(Printer & printer,
+                                     const Descriptor & descriptor) const {
+  vector<const FieldDescriptor *> fields = FieldsByNumber(descriptor);
+  printer.Print("size_t Size_$id$(const mxArray* msg, size_t element,\n"
+                "    std::vector<size_t>* sizes) {\n",
+                "id", CodecIdentifier(descriptor));
+  printer.Indent();
+  printer.Print("size_t slot = sizes->size();\n"
+                "sizes->push_back(0);\n"
+                "size_t size = 0;\n");
+  PrintCodecFieldLoop(printer, fields, false);
+  printer.Print("size += UnknownFieldsSize(msg, element);\n"
+                "(*sizes)[slot] = size;\n"
+                "return size;\n");
+  printer.Outdent();
+  printer.Print("}\n"
+                "\n");
+}
+
+
+void MatlabGenerator::PrintCodecWrite(Printer & printer,
+                                      const Descriptor & descriptor) const {
+  vector<const FieldDescriptor *> fields = FieldsByNumber(descriptor);
+  printer.Print("uint8_t* Write_$id$(const mxArray* msg, size_t element,\n"
+                "    const size_t** next_size, uint8_t* target) {\n",
+                "id", CodecIdentifier(descriptor));
+  printer.Indent();
+  printer.Print("++*next_size;\n");
+  PrintCodecFieldLoop(printer, fields, true);
+  printer.Print("return WriteUnknownFields(msg, element, target);\n");
+  printer.Outdent();
+  printer.Print("}\n"
+                "\n");
+}
+
+
+void MatlabGenerator::PrintCodecFieldLoop(
+    Printer & printer, const vector<const FieldDescriptor *> & fields,
+    bool write) const {
+  bool first = true;
+  for (int i = 0; i < fields.size(); ++i) {
+    // Groups are not supported by the matlab library
+    if (fields[i]->type() == FieldDescriptor::TYPE_GROUP)
+      continue;
+    if (first) {
+      printer.Print("const mxArray* value;\n");
+      first = false;
+    }
+    printer.Print("value = GetFieldToWrite(msg, element, \"$name$\", $k$);\n"
+                  "if (value != NULL) {\n",
+                  "name", fields[i]->name(),
+                  "k", SimpleItoa(i));
+    printer.Indent();
+    if (write) {
+      PrintCodecFieldWrite(printer, *fields[i]);
+    } else {
+      PrintCodecFieldSize(printer, *fields[i]);
+    }
+    printer.Outdent();
+    printer.Print("}\n");
+  }
+}
+
+
+void MatlabGenerator::PrintCodecFieldSize(Printer & printer,
+                                          const FieldDescriptor & field) const {
+  MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
+  int wire_type = WireFormat::WireTypeForFieldType(field.type());
+  map<string, string> m;
+  m["name"] = field.name();
+  m["tag_size"] = CodecTagSize(field.number(), wire_type);
+  m["packed_tag_size"] = CodecTagSize(field.number(), kWireTypeLengthDelimited);
+  m["class"] = kCodecClassIds[matlab_type];
+  m["field_type"] = SimpleItoa(field.type());
+  m["value_size"] = wire_type == kWireTypeFixed64 ? "8" : "4";
+  m["encode"] = CodecEncodeExpression(field, "value", "j");
+  m["encode_first"] = CodecEncodeExpression(field, "value", "0");
+
+  if (IsColumnsField(field)) {
+    vector<const FieldDescriptor *> columns =
+        FieldsByNumber(*field.message_type());
+    m["message_id"] = CodecIdentifier(*field.message_type());
+    m["column_count"] = SimpleItoa(columns.size());
+    // Each row is a message of its own and takes an entry of sizes
+    printer.Print(m,
+                  "const mxArray* columns[$column_count$];\n"
+                  "size_t count = GetColumns(value, \"$name$\", kNames_$message_id$ + 1,\n"
+                  "                          $column_count$, columns);\n"
+                  "for (size_t j = 0; j < count; ++j) {\n"
+                  "  size_t length = 0;\n");
+    for (int i = 0; i < columns.size(); ++i) {
+      int column_wire_type =
+          WireFormat::WireTypeForFieldType(columns[i]->type());
+      m["column_tag_size"] = CodecTagSize(columns[i]->number(),
+                                          column_wire_type);
+      if (column_wire_type == kWireTypeVarint) {
+        m["column_encode"] = CodecEncodeExpression(
+            *columns[i], "columns[" + SimpleItoa(i) + "]", "j");
+        printer.Print(m, "  length += $column_tag_size$ + VarintSize($column_encode$);\n");
+      } else {
+        m["column_value_size"] =
+            column_wire_type == kWireTypeFixed64 ? "8" : "4";
+        printer.Print(m, "  length += $column_tag_size$ + $column_value_size$;\n");
+      }
+    }
+    printer.Print(m,
+                  "  sizes->push_back(length);\n"
+                  "  size += $tag_size$ + VarintSize(length) + length;\n"
+                  "}\n");
+    return;
+  }
+
+  switch (matlab_type) {
     case MATLABTYPE_STRING:
-      return "@uint8";
     case MATLABTYPE_BYTES:
-      return "@uint8";
+      if (field.is_repeated()) {
+        printer.Print(m,
+                      "for (size_t j = 0; j < mxGetNumberOfElements(value); ++j) {\n"
+                      "  size_t length = BytesSize(GetStringCell(value, \"$name$\", j));\n"
+                      "  size += $tag_size$ + VarintSize(length) + length;\n"
+                      "}\n");
+      } else {
+        printer.Print(m,
+                      "size_t length = BytesSize(value);\n"
+                      "size += $tag_size$ + VarintSize(length) + length;\n");
+      }
+      return;
     case MATLABTYPE_MESSAGE:
-      return "@pblib_generic_serialize_to_string";
-    case MATLABTYPE_ENUM:
-      // We must call pblib_helpers_first because the standard varint
-      // will put the result into a uint64
-      return "@(x) typecast(int32(x), 'uint32')";
+      // A struct array is written in full, also for a singular field.  The
+      // bytes of placeholders of messages read lazily are copied and take no
+      // entry of sizes
+      m["message_id"] = CodecIdentifier(*field.message_type());
+      printer.Print(m,
+                    "CheckMessageStruct(value, \"$name$\");\n"
+                    "for (size_t j = 0; j < mxGetNumberOfElements(value); ++j) {\n"
+                    "  size_t length;\n"
+                    "  if (IsLazy(value)) {\n"
+                    "    GetLazyBytes(value, j, &length);\n"
+                    "  } else {\n"
+                    "    length = Size_$message_id$(value, j, sizes);\n"
+                    "  }\n"
+                    "  size += $tag_size$ + VarintSize(length) + length;\n"
+                    "}\n");
+      return;
+    default:
+      break;
+  }
+
+  if (field.is_repeated() && field.options().packed()) {
+    // The payload size is kept in sizes for the write function
+    if (wire_type == kWireTypeVarint) {
+      printer.Print(m,
+                    "size_t count = mxGetNumberOfElements(value);\n"
+                    "size_t payload = 0;\n"
+                    "if (mxGetClassID(value) == $class$) {\n"
+                    "  payload = VarintsSize($field_type$, mxGetData(value), count);\n"
+                    "} else {\n"
+                    "  for (size_t j = 0; j < count; ++j) {\n"
+                    "    payload += VarintSize($encode$);\n"
+                    "  }\n"
+                    "}\n");
+    } else {
+      printer.Print(m,
+                    "size_t payload = mxGetNumberOfElements(value) * $value_size$;\n");
+    }
+    printer.Print(m,
+                  "sizes->push_back(payload);\n"
+                  "size += $packed_tag_size$ + VarintSize(payload) + payload;\n");
+  } else if (field.is_repeated()) {
+    if (wire_type == kWireTypeVarint) {
+      printer.Print(m,
+                    "for (size_t j = 0; j < mxGetNumberOfElements(value); ++j) {\n"
+                    "  size += $tag_size$ + VarintSize($encode$);\n"
+                    "}\n");
+    } else {
+      printer.Print(m,
+                    "size += mxGetNumberOfElements(value) * ($tag_size$ + $value_size$);\n");
+    }
+  } else {
+    if (wire_type == kWireTypeVarint) {
+      printer.Print(m, "size += $tag_size$ + VarintSize($encode_first$);\n");
+    } else {
+      printer.Print(m, "size += $tag_size$ + $value_size$;\n");
+    }
+  }
+}
+
+
+void MatlabGenerator::PrintCodecFieldWrite(Printer & printer,
+                                           const FieldDescriptor & field) const {
+  MatlabType matlab_type = kTypeToMatlabTypeMap[field.type()];
+  int wire_type = WireFormat::WireTypeForFieldType(field.type());
+  map<string, string> m;
+  m["name"] = field.name();
+  m["tag"] = CodecTag(field.number(), wire_type);
+  m["packed_tag"] = CodecTag(field.number(), kWireTypeLengthDelimited);
+  m["class"] = kCodecClassIds[matlab_type];
+  m["field_type"] = SimpleItoa(field.type());
+  m["value_size"] = wire_type == kWireTypeFixed64 ? "8" : "4";
+  m["write"] = CodecValueWrite(wire_type,
+                               CodecEncodeExpression(field, "value", "j"));
+  m["write_first"] = CodecValueWrite(
+      wire_type, CodecEncodeExpression(field, "value", "0"));
+
+  if (IsColumnsField(field)) {
+    vector<const FieldDescriptor *> columns =
+        FieldsByNumber(*field.message_type());
+    m["message_id"] = CodecIdentifier(*field.message_type());
+    m["column_count"] = SimpleItoa(columns.size());
+    printer.Print(m,
+                  "const mxArray* columns[$column_count$];\n"
+                  "size_t count = GetColumns(value, \"$name$\", kNames_$message_id$ + 1,\n"
+                  "                          $column_count$, columns);\n"
+                  "for (size_t j = 0; j < count; ++j) {\n"
+                  "  target = WriteVarint($tag$, target);\n"
+                  "  target = WriteVarint(*(*next_size)++, target);\n");
+    for (int i = 0; i < columns.size(); ++i) {
+      int column_wire_type =
+          WireFormat::WireTypeForFieldType(columns[i]->type());
+      m["column_tag"] = CodecTag(columns[i]->number(), column_wire_type);
+      m["column_write"] = CodecValueWrite(
+          column_wire_type,
+          CodecEncodeExpression(*columns[i],
+                                "columns[" + SimpleItoa(i) + "]", "j"));
+      printer.Print(m,
+                    "  target = WriteVarint($column_tag$, target);\n"
+                    "  $column_write$\n");
+    }
+    printer.Print("}\n");
+    return;
+  }
+
+  switch (matlab_type) {
+    case MATLABTYPE_STRING:
+    case MATLABTYPE_BYTES:
+      if (field.is_repeated()) {
+        printer.Print(m,
+                      "for (size_t j = 0; j < mxGetNumberOfElements(value); ++j) {\n"
+                      "  const mxArray* cell = GetStringCell(value, \"$name$\", j);\n"
+                      "  target = WriteVarint($tag$, target);\n"
+                      "  target = WriteVarint(BytesSize(cell), target);\n"
+                      "  target = WriteBytes(cell, target);\n"
+                      "}\n");
+      } else {
+        printer.Print(m,
+                      "target = WriteVarint($tag$, target);\n"
+                      "target = WriteVarint(BytesSize(value), target);\n"
+                      "target = WriteBytes(value, target);\n");
+      }
+      return;
+    case MATLABTYPE_MESSAGE:
+      printer.Print("for (size_t j = 0; j < mxGetNumberOfElements(value); ++j) {\n"
+                    "  target = WriteVarint($tag$, target);\n"
+                    "  if (IsLazy(value)) {\n"
+                    "    target = WriteLazyBytes(value, j, target);\n"
+                    "  } else {\n"
+                    "    target = WriteVarint(**next_size, target);\n"
+                    "    target = Write_$message_id$(value, j, next_size, target);\n"
+                    "  }\n"
+                    "}\n",
+                    "tag", m["tag"],
+                    "message_id", CodecIdentifier(*field.message_type()));
+      return;
+    default:
+      break;
+  }
+
+  if (field.is_repeated() && field.options().packed()) {
+    printer.Print(m,
+                  "size_t count = mxGetNumberOfElements(value);\n"
+                  "target = WriteVarint($packed_tag$, target);\n"
+                  "target = WriteVarint(*(*next_size)++, target);\n"
+                  "if (mxGetClassID(value) == $class$) {\n");
+    if (wire_type == kWireTypeVarint) {
+      printer.Print(m,
+                    "  target = EncodeVarints($field_type$, mxGetData(value), count, target);\n");
+    } else {
+      // Fixed width values are laid out like the elements of a Matlab array
+      printer.Print(m,
+                    "  memcpy(target, mxGetData(value), count * $value_size$);\n"
+                    "  target += count * $value_size$;\n");
+    }
+    printer.Print(m,
+                  "} else {\n"
+                  "  for (size_t j = 0; j < count; ++j) {\n"
+                  "    $write$\n"
+                  "  }\n"
+                  "}\n");
+  } else if (field.is_repeated()) {
+    printer.Print(m,
+                  "for (size_t j = 0; j < mxGetNumberOfElements(value); ++j) {\n"
+                  "  target = WriteVarint($tag$, target);\n"
+                  "  $write$\n"
+                  "}\n");
+  } else {
+    printer.Print(m,
+                  "target = WriteVarint($tag$, target);\n"
+                  "$write_first$\n");
   }
-  GOOGLE_LOG(DFATAL) << "Shouldn't get here since switch should catch all cases.";
-  return "";
 }
 
 
@@ -705,6 +2494,24 @@ string MatlabGenerator::ReadFunctionName(const Descriptor & descriptor) const {
   return "pb_read_" + StringReplace(descriptor.full_name(), ".", "__", true);
 }
 
+string MatlabGenerator::WriteFunctionName(const Descriptor & descriptor) const {
+  return "pb_write_" + StringReplace(descriptor.full_name(), ".", "__", true);
+}
+
+string MatlabGenerator::CodecFunctionName() const {
+  // The file name without its directory and extension, as a Matlab identifier
+  string name = file_->name();
+  if (name.find_last_of('/') != string::npos)
+    name = name.substr(name.find_last_of('/') + 1);
+  if (name.size() > 6 && name.substr(name.size() - 6) == ".proto")
+    name = name.substr(0, name.size() - 6);
+  for (int i = 0; i < name.size(); ++i) {
+    if (!isalnum(name[i]))
+      name[i] = '_';
+  }
+  return "pb_codec_" + name;
+}
+
 
 }  // namespace matlab
 }  // namespace compiler
@@ -37,6 +37,7 @@
 #define FARSOUNDER_PROTOBUF_COMPILER_MATLAB_GENERATOR_H__
 
 #include <string>
+#include <vector>
 #include <google/protobuf/compiler/code_generator.h>
 #include <google/protobuf/descriptor.h>
 #include <google/protobuf/stubs/common.h>
@@ -90,6 +91,7 @@ class LIBPROTOC_EXPORT MatlabGenerator :
   static const MatlabType kTypeToMatlabTypeMap[
     ::google::protobuf::FieldDescriptor::MAX_TYPE + 1];
   static const ::std::string kMatlabTypeToString[MAX_MATLABTYPE + 1];
+  static const ::std::string kMatlabTypeToClassName[MAX_MATLABTYPE + 1];
 
  private:
   void PrintMessageFunctions() const;
@@ -123,19 +125,115 @@ class LIBPROTOC_EXPORT MatlabGenerator :
   void PrintReadBody(
       ::google::protobuf::io::Printer & printer,
       const ::google::protobuf::Descriptor & descriptor) const;
+  // Hands the buffer to the pblib_mex_codec mex function when it's built.
+  void PrintMexRead(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  // Sets has_generated_codec to whether the codec=generated mex function of
+  // the file is built.
+  void PrintCodecCheck(::google::protobuf::io::Printer & printer) const;
+  void PrintSpecializedReadBody(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintSpecializedFieldRead(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field) const;
+  void PrintSpecializedAppend(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field) const;
+  void PrintSpecializedColumnsAppend(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field) const;
+  void PrintSpecializedWireTypeCheck(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field,
+      int wire_type) const;
+  void PrintSpecializedValueRead(
+      ::google::protobuf::io::Printer & printer,
+      int wire_type) const;
+
+  void PrintWriteFunction(
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintWriteHeader(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintWriteComment(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintWriteBody(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintFieldWrite(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field) const;
+  void PrintAppendToBuffer(
+      ::google::protobuf::io::Printer & printer,
+      const ::std::string & variable) const;
+
+  // codec=generated: the C++ source of a mex function which reads and writes
+  // the messages of the file with all per field work written out, see
+  // farsounder/protobuf/matlab/generated_codec.h.
+  void PrintGeneratedCodec() const;
+  void PrintCodecRead(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintCodecFieldRead(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field,
+      int index) const;
+  void PrintCodecFieldCreate(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field,
+      int index) const;
+  // Reads the rows of a repeated_messages=columns field straight into the
+  // column arrays.
+  void PrintCodecColumnsRead(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintCodecSize(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintCodecWrite(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::Descriptor & descriptor) const;
+  void PrintCodecFieldLoop(
+      ::google::protobuf::io::Printer & printer,
+      const ::std::vector<const ::google::protobuf::FieldDescriptor *> & fields,
+      bool write) const;
+  void PrintCodecFieldSize(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field) const;
+  void PrintCodecFieldWrite(
+      ::google::protobuf::io::Printer & printer,
+      const ::google::protobuf::FieldDescriptor & field) const;
+
+  // Whether field is a repeated message field decoded into a struct of
+  // column arrays, which takes the columns option and a message type whose
+  // fields are all singular and numeric.
+  bool IsColumnsField(const ::google::protobuf::FieldDescriptor & field) const;
 
   ::std::string DefaultValueToString(
       const ::google::protobuf::FieldDescriptor & field) const;
 
   ::std::string MakeReadFunctionHandle(
       const ::google::protobuf::FieldDescriptor & field) const;
+  ::std::string MakeReadValueExpression(
+      const ::google::protobuf::FieldDescriptor & field,
+      const ::std::string & value) const;
   ::std::string MakeWriteFunctionHandle(
       const ::google::protobuf::FieldDescriptor & field) const;
+  ::std::string MakeWriteValueExpression(
+      const ::google::protobuf::FieldDescriptor & field,
+      const ::std::string & value) const;
 
   ::std::string DescriptorFunctionName(
       const ::google::protobuf::Descriptor & descriptor) const;
   ::std::string ReadFunctionName(
       const ::google::protobuf::Descriptor & descriptor) const;
+  ::std::string WriteFunctionName(
+      const ::google::protobuf::Descriptor & descriptor) const;
+  // The mex function written with codec=generated, pb_codec_<file>.
+  ::std::string CodecFunctionName() const;
 
   // Very coarse-grained lock to ensure that Generate() is reentrant.
   // Guards file_ and printer_.
@@ -145,6 +243,21 @@ class LIBPROTOC_EXPORT MatlabGenerator :
   mutable ::google::protobuf::compiler::GeneratorContext*
       output_directory_;  // Set in Generate().
 
+  // Generator options, parsed from the parameter in Generate().
+  // --matlab_out=read=specialized:<dir> emits a fully specialized decoder
+  // into each pb_read_* function instead of a call to
+  // pblib_generic_parse_from_string.
+  mutable bool specialized_read_;
+  // --matlab_out=repeated_messages=columns:<dir> reads repeated fields of
+  // small messages with only numeric fields into one struct holding a row
+  // vector per field, rather than into a struct array.
+  mutable bool columns_;
+  // --matlab_out=codec=generated:<dir> also writes pb_codec_<file>.cc, the
+  // source of a mex function with a reader and a writer compiled for every
+  // message, which the pb_read_* and pb_write_* functions call once it's
+  // built with pblib_build_codec.
+  mutable bool generated_codec_;
+
   GOOGLE_DISALLOW_EVIL_CONSTRUCTORS(MatlabGenerator);
 };
 
@@ -0,0 +1,1697 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <farsounder/protobuf/matlab/codec.h>
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+
+#include <farsounder/protobuf/matlab/parallel.h>
+#include <farsounder/protobuf/matlab/varint.h>
+#include <farsounder/protobuf/matlab/wire_format.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+namespace {
+
+const int kLabelRequired = 2;
+const int kLabelRepeated = 3;
+
+// Same as CodedInputStream's default, deep enough for any sane message and
+// shallow enough not to run out of stack on a corrupt buffer.
+const int kMaxRecursionDepth = 100;
+
+// Less input than this is parsed on the calling thread alone, starting
+// threads would take longer than they save.
+const size_t kMinParallelSize = 1 << 20;
+// The least input a thread is handed at once.
+const size_t kMinChunkSize = 256 << 10;
+
+// ------------------------------------------------------------------
+// Descriptor access
+
+std::string GetString(const mxArray* array) {
+  if (array == NULL || !mxIsChar(array)) {
+    throw CodecError("proto:mex:descriptor", "Expected a string.");
+  }
+  char* chars = mxArrayToString(array);
+  std::string result(chars);
+  mxFree(chars);
+  return result;
+}
+
+const mxArray* GetField(const mxArray* array, size_t element,
+                        const char* name) {
+  const mxArray* value = mxGetField(array, element, name);
+  if (value == NULL) {
+    throw CodecError("proto:mex:descriptor",
+                     std::string("Missing struct field ") + name + ".");
+  }
+  return value;
+}
+
+double GetScalar(const mxArray* array, size_t element, const char* name) {
+  const mxArray* value = GetField(array, element, name);
+  if (mxIsEmpty(value)) {
+    throw CodecError("proto:mex:descriptor",
+                     std::string("Struct field ") + name + " is empty.");
+  }
+  return mxGetScalar(value);
+}
+
+// Calls function_handle with no arguments and returns its only output.
+mxArray* CallFunction(const mxArray* function_handle) {
+  mxArray* output = NULL;
+  mxArray* input = const_cast<mxArray*>(function_handle);
+  mxArray* exception = mexCallMATLABWithTrap(1, &output, 1, &input, "feval");
+  if (exception != NULL) {
+    throw CodecError("proto:mex:descriptor",
+                     "Calling a descriptor_function failed.");
+  }
+  return output;
+}
+
+bool IsPackable(const FieldInfo& field) {
+  return field.wire_type != WIRE_TYPE_LENGTH_DELIMITED;
+}
+
+// ------------------------------------------------------------------
+// Wire values to Matlab values, same as the read_function of each type
+
+mxClassID ClassOf(const FieldInfo& field) {
+  switch (field.matlab_type) {
+    case MATLAB_TYPE_INT32:  return mxINT32_CLASS;
+    case MATLAB_TYPE_INT64:  return mxINT64_CLASS;
+    case MATLAB_TYPE_UINT32: return mxUINT32_CLASS;
+    case MATLAB_TYPE_UINT64: return mxUINT64_CLASS;
+    case MATLAB_TYPE_DOUBLE: return mxDOUBLE_CLASS;
+    case MATLAB_TYPE_SINGLE: return mxSINGLE_CLASS;
+    case MATLAB_TYPE_ENUM:   return mxINT32_CLASS;
+    default:
+      throw CodecError("proto:mex:descriptor",
+                       "Field " + field.name + " is not numeric.");
+  }
+}
+
+// Stores the wire value as element index of data, which is of the field's
+// Matlab class.
+void StoreNumeric(const FieldInfo& field, uint64_t value, void* data,
+                  size_t index) {
+  switch (field.type) {
+    case TYPE_INT32:
+    case TYPE_ENUM:
+    case TYPE_SFIXED32:
+      static_cast<int32_t*>(data)[index] = static_cast<int32_t>(value);
+      break;
+    case TYPE_SINT32:
+      static_cast<int32_t*>(data)[index] =
+          static_cast<int32_t>(ZigZagDecode(value));
+      break;
+    case TYPE_INT64:
+    case TYPE_SFIXED64:
+      static_cast<int64_t*>(data)[index] = static_cast<int64_t>(value);
+      break;
+    case TYPE_SINT64:
+      static_cast<int64_t*>(data)[index] = ZigZagDecode(value);
+      break;
+    case TYPE_UINT32:
+    case TYPE_FIXED32:
+    case TYPE_BOOL:
+      static_cast<uint32_t*>(data)[index] = static_cast<uint32_t>(value);
+      break;
+    case TYPE_UINT64:
+    case TYPE_FIXED64:
+      static_cast<uint64_t*>(data)[index] = value;
+      break;
+    case TYPE_FLOAT: {
+      uint32_t bits = static_cast<uint32_t>(value);
+      memcpy(static_cast<float*>(data) + index, &bits, sizeof(bits));
+      break;
+    }
+    case TYPE_DOUBLE:
+      memcpy(static_cast<double*>(data) + index, &value, sizeof(value));
+      break;
+    default:
+      throw CodecError("proto:mex:descriptor",
+                       "Field " + field.name + " is not numeric.");
+  }
+}
+
+size_t ElementSize(mxClassID class_id) {
+  switch (class_id) {
+    case mxINT32_CLASS:
+    case mxUINT32_CLASS:
+    case mxSINGLE_CLASS:
+      return 4;
+    default:
+      return 8;
+  }
+}
+
+size_t FixedSize(const FieldInfo& field) {
+  return field.wire_type == WIRE_TYPE_FIXED64 ? 8 : 4;
+}
+
+// Decodes the packed values in buffer[begin, end) into data starting at
+// element index.  Returns the number of values decoded.
+size_t StorePacked(const FieldInfo& field, const uint8_t* buffer,
+                   size_t begin, size_t end, void* data, size_t index) {
+  char* target =
+      static_cast<char*>(data) + index * ElementSize(ClassOf(field));
+  if (field.wire_type == WIRE_TYPE_VARINT) {
+    return DecodeVarints(field.type, buffer + begin, end - begin, target);
+  }
+  if ((end - begin) % FixedSize(field) != 0) {
+    throw CodecError("proto:mex:truncated",
+                     "Packed field " + field.name + " is truncated.");
+  }
+  // Fixed width values are laid out like the elements of a Matlab array.
+  if (end > begin) {
+    memcpy(target, buffer + begin, end - begin);
+  }
+  return (end - begin) / FixedSize(field);
+}
+
+// Returns the number of values in a packed run without decoding it.
+size_t CountPacked(const FieldInfo& field, const uint8_t* buffer,
+                   size_t begin, size_t end) {
+  if (field.wire_type == WIRE_TYPE_VARINT) {
+    return CountVarints(buffer + begin, end - begin);
+  }
+  return (end - begin) / FixedSize(field);
+}
+
+}  // namespace
+
+mxArray* CreateString(const uint8_t* data, size_t size) {
+  mwSize dims[2] = {1, size};
+  mxArray* array = mxCreateCharArray(2, dims);
+  mxChar* chars = mxGetChars(array);
+  for (size_t i = 0; i < size; ++i) {
+    chars[i] = data[i];
+  }
+  return array;
+}
+
+mxArray* CreateBytes(const uint8_t* data, size_t size) {
+  mxArray* array = mxCreateNumericMatrix(1, size, mxUINT8_CLASS, mxREAL);
+  if (size > 0) {
+    memcpy(mxGetData(array), data, size);
+  }
+  return array;
+}
+
+mxArray* CreateUint32(uint32_t value) {
+  mxArray* array = mxCreateNumericMatrix(1, 1, mxUINT32_CLASS, mxREAL);
+  *static_cast<uint32_t*>(mxGetData(array)) = value;
+  return array;
+}
+
+namespace {
+
+// ------------------------------------------------------------------
+// Matlab values to wire values, same as the write_function of each type
+
+// An integer converted the way Matlab's conversion functions do it, which
+// saturate instead of wrapping around.
+template <typename T, typename S>
+T Saturate(S value) {
+  if (!std::numeric_limits<T>::is_integer) {
+    return static_cast<T>(value);
+  }
+  if (std::numeric_limits<S>::is_signed && value < 0) {
+    if (!std::numeric_limits<T>::is_signed) {
+      return 0;
+    }
+    if (static_cast<int64_t>(value) <
+        static_cast<int64_t>(std::numeric_limits<T>::min())) {
+      return std::numeric_limits<T>::min();
+    }
+    return static_cast<T>(value);
+  }
+  if (static_cast<uint64_t>(value) >
+      static_cast<uint64_t>(std::numeric_limits<T>::max())) {
+    return std::numeric_limits<T>::max();
+  }
+  return static_cast<T>(value);
+}
+
+// Element index of array converted the way Matlab's conversion functions do
+// it: rounded to nearest with ties away from zero, saturated, NaN to 0.
+template <typename T>
+T ConvertElement(const mxArray* array, size_t index) {
+  const void* data = mxGetData(array);
+  switch (mxGetClassID(array)) {
+    case mxDOUBLE_CLASS:
+    case mxSINGLE_CLASS: {
+      double value = mxGetClassID(array) == mxDOUBLE_CLASS
+          ? static_cast<const double*>(data)[index]
+          : static_cast<const float*>(data)[index];
+      if (!std::numeric_limits<T>::is_integer) {
+        return static_cast<T>(value);
+      }
+      if (value != value) {
+        return 0;
+      }
+      value = value < 0 ? -floor(-value + 0.5) : floor(value + 0.5);
+      if (value <= static_cast<double>(std::numeric_limits<T>::min())) {
+        return std::numeric_limits<T>::min();
+      }
+      if (value >= static_cast<double>(std::numeric_limits<T>::max())) {
+        return std::numeric_limits<T>::max();
+      }
+      return static_cast<T>(value);
+    }
+    case mxINT8_CLASS:
+      return Saturate<T>(static_cast<const int8_t*>(data)[index]);
+    case mxINT16_CLASS:
+      return Saturate<T>(static_cast<const int16_t*>(data)[index]);
+    case mxINT32_CLASS:
+      return Saturate<T>(static_cast<const int32_t*>(data)[index]);
+    case mxINT64_CLASS:
+      return Saturate<T>(static_cast<const int64_t*>(data)[index]);
+    case mxUINT8_CLASS:
+      return Saturate<T>(static_cast<const uint8_t*>(data)[index]);
+    case mxUINT16_CLASS:
+      return Saturate<T>(static_cast<const uint16_t*>(data)[index]);
+    case mxUINT32_CLASS:
+      return Saturate<T>(static_cast<const uint32_t*>(data)[index]);
+    case mxUINT64_CLASS:
+      return Saturate<T>(static_cast<const uint64_t*>(data)[index]);
+    case mxLOGICAL_CLASS:
+      return static_cast<const mxLogical*>(data)[index] ? 1 : 0;
+    case mxCHAR_CLASS:
+      return Saturate<T>(
+          static_cast<uint16_t>(static_cast<const mxChar*>(data)[index]));
+    default:
+      throw CodecError("proto:mex:value", "Expected a numeric value.");
+  }
+}
+
+}  // namespace
+
+int32_t ConvertToInt32(const mxArray* array, size_t index) {
+  return ConvertElement<int32_t>(array, index);
+}
+
+int64_t ConvertToInt64(const mxArray* array, size_t index) {
+  return ConvertElement<int64_t>(array, index);
+}
+
+uint32_t ConvertToUint32(const mxArray* array, size_t index) {
+  return ConvertElement<uint32_t>(array, index);
+}
+
+uint64_t ConvertToUint64(const mxArray* array, size_t index) {
+  return ConvertElement<uint64_t>(array, index);
+}
+
+float ConvertToSingle(const mxArray* array, size_t index) {
+  return ConvertElement<float>(array, index);
+}
+
+double ConvertToDouble(const mxArray* array, size_t index) {
+  return ConvertElement<double>(array, index);
+}
+
+namespace {
+
+// The varint, or the raw bits of the fixed width value, the write_function of
+// field produces for element index of array.  Negative int32s are written as
+// their uint32 bits, like the generated code does.
+uint64_t EncodeNumeric(const FieldInfo& field, const mxArray* array,
+                       size_t index) {
+  switch (field.type) {
+    case TYPE_INT32:
+    case TYPE_ENUM:
+    case TYPE_SFIXED32:
+      return static_cast<uint32_t>(ConvertElement<int32_t>(array, index));
+    case TYPE_SINT32:
+      return static_cast<uint32_t>(
+          ZigZagEncode(ConvertElement<int32_t>(array, index)));
+    case TYPE_INT64:
+    case TYPE_SFIXED64:
+      return static_cast<uint64_t>(ConvertElement<int64_t>(array, index));
+    case TYPE_SINT64:
+      return ZigZagEncode(ConvertElement<int64_t>(array, index));
+    case TYPE_UINT32:
+    case TYPE_FIXED32:
+    case TYPE_BOOL:
+      return ConvertElement<uint32_t>(array, index);
+    case TYPE_UINT64:
+    case TYPE_FIXED64:
+      return ConvertElement<uint64_t>(array, index);
+    case TYPE_FLOAT: {
+      float value = ConvertElement<float>(array, index);
+      uint32_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      return bits;
+    }
+    case TYPE_DOUBLE: {
+      double value = ConvertElement<double>(array, index);
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      return bits;
+    }
+    default:
+      throw CodecError("proto:mex:descriptor",
+                       "Field " + field.name + " is not numeric.");
+  }
+}
+
+size_t NumericSize(const FieldInfo& field, uint64_t value) {
+  switch (field.wire_type) {
+    case WIRE_TYPE_FIXED64: return 8;
+    case WIRE_TYPE_FIXED32: return 4;
+    default: return VarintSize(value);
+  }
+}
+
+uint8_t* WriteNumeric(const FieldInfo& field, uint64_t value,
+                      uint8_t* target) {
+  switch (field.wire_type) {
+    case WIRE_TYPE_FIXED64: return WriteLittleEndian(value, 8, target);
+    case WIRE_TYPE_FIXED32: return WriteLittleEndian(value, 4, target);
+    default: return WriteVarint(value, target);
+  }
+}
+
+}  // namespace
+
+bool IsLazy(const mxArray* array) {
+  return mxIsStruct(array) && mxGetFieldNumber(array, "lazy_buffer") >= 0;
+}
+
+const uint8_t* GetLazyBytes(const mxArray* array, size_t element,
+                            size_t* size) {
+  const mxArray* buffer = mxGetField(array, element, "lazy_buffer");
+  const mxArray* start = mxGetField(array, element, "lazy_start");
+  const mxArray* end = mxGetField(array, element, "lazy_end");
+  if (buffer == NULL || mxGetClassID(buffer) != mxUINT8_CLASS ||
+      start == NULL || mxIsEmpty(start) || end == NULL || mxIsEmpty(end)) {
+    throw CodecError("proto:mex:value",
+                     "A lazy value must have a uint8 lazy_buffer, a "
+                     "lazy_start and a lazy_end.");
+  }
+  // lazy_start and lazy_end are one based and inclusive.
+  double first = mxGetScalar(start);
+  double last = mxGetScalar(end);
+  if (!(first >= 1 && last >= first - 1 &&
+        last <= mxGetNumberOfElements(buffer))) {
+    throw CodecError("proto:mex:value",
+                     "A lazy value refers to bytes outside its lazy_buffer.");
+  }
+  *size = static_cast<size_t>(last - first + 1);
+  return static_cast<const uint8_t*>(mxGetData(buffer)) +
+         static_cast<size_t>(first - 1);
+}
+
+uint8_t* WriteLazyBytes(const mxArray* array, size_t element,
+                        uint8_t* target) {
+  size_t size;
+  const uint8_t* bytes = GetLazyBytes(array, element, &size);
+  target = WriteVarint(size, target);
+  if (size > 0) {
+    memcpy(target, bytes, size);
+  }
+  return target + size;
+}
+
+size_t BytesSize(const mxArray* array) {
+  size_t size = mxGetNumberOfElements(array);
+  if (IsLazy(array)) {
+    GetLazyBytes(array, 0, &size);
+  }
+  return size;
+}
+
+uint8_t* WriteBytes(const mxArray* array, uint8_t* target) {
+  if (IsLazy(array)) {
+    size_t size;
+    const uint8_t* bytes = GetLazyBytes(array, 0, &size);
+    if (size > 0) {
+      memcpy(target, bytes, size);
+    }
+    return target + size;
+  }
+  size_t size = mxGetNumberOfElements(array);
+  if (mxGetClassID(array) == mxUINT8_CLASS) {
+    if (size > 0) {
+      memcpy(target, mxGetData(array), size);
+    }
+    return target + size;
+  }
+  for (size_t i = 0; i < size; ++i) {
+    *target++ = ConvertElement<uint8_t>(array, i);
+  }
+  return target;
+}
+
+namespace {
+
+// Returns element index of a repeated string or bytes field.
+const mxArray* GetCell(const FieldInfo& field, const mxArray* array,
+                       size_t index) {
+  if (!mxIsCell(array)) {
+    throw CodecError("proto:mex:value",
+                     "Repeated field " + field.name + " must be a cell array.");
+  }
+  const mxArray* value = mxGetCell(array, index);
+  if (value == NULL) {
+    throw CodecError("proto:mex:value",
+                     "Repeated field " + field.name + " has an empty cell.");
+  }
+  return value;
+}
+
+void CheckStruct(const FieldInfo& field, const mxArray* array) {
+  if (!mxIsStruct(array)) {
+    throw CodecError("proto:mex:value",
+                     "Field " + field.name + " must be a message struct.");
+  }
+}
+
+// Returns the size of the values of a packed field, without the tag and the
+// length.  Arrays which already have the field's class are handled in bulk.
+size_t PackedPayloadSize(const FieldInfo& field, const mxArray* value) {
+  size_t count = mxGetNumberOfElements(value);
+  if (field.wire_type != WIRE_TYPE_VARINT) {
+    return count * FixedSize(field);
+  }
+  if (mxGetClassID(value) == ClassOf(field)) {
+    return VarintsSize(field.type, mxGetData(value), count);
+  }
+  size_t size = 0;
+  for (size_t j = 0; j < count; ++j) {
+    size += NumericSize(field, EncodeNumeric(field, value, j));
+  }
+  return size;
+}
+
+uint8_t* WritePackedPayload(const FieldInfo& field, const mxArray* value,
+                            uint8_t* target) {
+  size_t count = mxGetNumberOfElements(value);
+  if (mxGetClassID(value) == ClassOf(field)) {
+    if (field.wire_type == WIRE_TYPE_VARINT) {
+      return EncodeVarints(field.type, mxGetData(value), count, target);
+    }
+    memcpy(target, mxGetData(value), count * FixedSize(field));
+    return target + count * FixedSize(field);
+  }
+  for (size_t j = 0; j < count; ++j) {
+    target = WriteNumeric(field, EncodeNumeric(field, value, j), target);
+  }
+  return target;
+}
+
+// ------------------------------------------------------------------
+// Columns
+
+// The message type of a field read as columns may only have singular numeric
+// fields.
+void CheckColumns(const FieldInfo& field) {
+  const MessageInfo& info = *field.message;
+  if (info.fields.empty()) {
+    throw CodecError("proto:mex:descriptor",
+                     "Message " + info.full_name + " of field " + field.name +
+                     " has no fields to read as columns.");
+  }
+  for (size_t f = 0; f < info.fields.size(); ++f) {
+    if (info.fields[f].repeated) {
+      throw CodecError("proto:mex:descriptor",
+                       "Field " + info.fields[f].name + " of " +
+                       info.full_name + " is repeated and can't be read as "
+                       "a column.");
+    }
+    ClassOf(info.fields[f]);  // Throws unless numeric.
+  }
+}
+
+// Collects the column of every field of the message of field from a struct
+// of columns and returns their common length.
+size_t GetColumns(const FieldInfo& field, const mxArray* value,
+                  std::vector<const mxArray*>* columns) {
+  CheckStruct(field, value);
+  CheckColumns(field);
+  const MessageInfo& info = *field.message;
+  size_t count = 0;
+  for (size_t f = 0; f < info.fields.size(); ++f) {
+    const mxArray* column = mxGetField(value, 0, info.fields[f].name.c_str());
+    if (column == NULL) {
+      throw CodecError("proto:mex:value",
+                       "Field " + field.name + " has no column " +
+                       info.fields[f].name + ".");
+    }
+    if (f == 0) {
+      count = mxGetNumberOfElements(column);
+    } else if (mxGetNumberOfElements(column) != count) {
+      throw CodecError("proto:mex:value",
+                       "The columns of field " + field.name +
+                       " differ in length.");
+    }
+    columns->push_back(column);
+  }
+  return count;
+}
+
+// Returns the size of row of the columns as a message, without its tag and
+// length.
+size_t ColumnsRowSize(const MessageInfo& info,
+                      const std::vector<const mxArray*>& columns,
+                      size_t row) {
+  size_t size = 0;
+  for (size_t f = 0; f < info.fields.size(); ++f) {
+    const FieldInfo& column = info.fields[f];
+    size += VarintSize(MakeTag(column.number, column.wire_type)) +
+            NumericSize(column, EncodeNumeric(column, columns[f], row));
+  }
+  return size;
+}
+
+}  // namespace
+
+// ------------------------------------------------------------------
+// has_field
+
+bool HasField(const mxArray* msg, size_t element, size_t index) {
+  const mxArray* has_field = GetField(msg, element, "has_field");
+  if (index >= mxGetNumberOfElements(has_field)) {
+    throw CodecError("proto:mex:value",
+                     "has_field has fewer elements than the message has "
+                     "fields.");
+  }
+  return ConvertElement<uint8_t>(has_field, index) != 0;
+}
+
+// ------------------------------------------------------------------
+// MEX gateways
+
+size_t GetIndex(const mxArray* array) {
+  if (!mxIsNumeric(array) || mxGetNumberOfElements(array) != 1) {
+    throw CodecError("proto:mex:usage", "Buffer indices must be scalars.");
+  }
+  double value = mxGetScalar(array);
+  if (value < 0 || value != static_cast<double>(static_cast<size_t>(value))) {
+    throw CodecError("proto:mex:usage",
+                     "Buffer indices must be non-negative integers.");
+  }
+  return static_cast<size_t>(value);
+}
+
+char error_id[128];
+char error_message[1024];
+
+void SetError(const std::string& id, const std::string& message) {
+  strncpy(error_id, id.c_str(), sizeof(error_id) - 1);
+  error_id[sizeof(error_id) - 1] = '\0';
+  strncpy(error_message, message.c_str(), sizeof(error_message) - 1);
+  error_message[sizeof(error_message) - 1] = '\0';
+}
+
+// ===================================================================
+
+int MessageInfo::FindFieldByNumber(uint32_t number) const {
+  std::vector<uint32_t>::const_iterator it =
+      std::lower_bound(field_numbers.begin(), field_numbers.end(), number);
+  if (it == field_numbers.end() || *it != number) {
+    return -1;
+  }
+  return static_cast<int>(it - field_numbers.begin());
+}
+
+// ===================================================================
+
+DescriptorPool::DescriptorPool() {}
+
+DescriptorPool::~DescriptorPool() {
+  for (std::map<std::string, MessageInfo*>::iterator it = messages_.begin();
+       it != messages_.end(); ++it) {
+    delete it->second;
+  }
+  for (size_t i = 0; i < names_.size(); ++i) {
+    delete names_[i];
+  }
+}
+
+const MessageInfo* DescriptorPool::FindMessage(const mxArray* descriptor) {
+  return Load(descriptor, NULL);
+}
+
+const MessageInfo* DescriptorPool::FindMessageByFunction(
+    const mxArray* descriptor_function) {
+  if (descriptor_function == NULL ||
+      mxGetClassID(descriptor_function) != mxFUNCTION_CLASS) {
+    throw CodecError("proto:mex:descriptor",
+                     "Expected a descriptor_function handle.");
+  }
+  return Load(CallFunction(descriptor_function), descriptor_function);
+}
+
+MessageInfo* DescriptorPool::Load(const mxArray* descriptor,
+                                  const mxArray* descriptor_function) {
+  if (descriptor == NULL || !mxIsStruct(descriptor)) {
+    throw CodecError("proto:mex:descriptor", "Expected a descriptor struct.");
+  }
+  std::string full_name = GetString(GetField(descriptor, 0, "full_name"));
+  std::map<std::string, MessageInfo*>::iterator it = messages_.find(full_name);
+  if (it != messages_.end()) {
+    if (it->second->descriptor_function == NULL) {
+      it->second->descriptor_function = descriptor_function;
+    }
+    return it->second;
+  }
+
+  // Registered before the fields are loaded so recursive types find it.
+  MessageInfo* info = new MessageInfo;
+  messages_[full_name] = info;
+  info->full_name = full_name;
+  info->descriptor_function = descriptor_function;
+
+  const mxArray* fields = GetField(descriptor, 0, "fields");
+  size_t field_count = mxIsStruct(fields) ? mxGetNumberOfElements(fields) : 0;
+  info->fields.resize(field_count);
+  info->field_numbers.resize(field_count);
+  for (size_t i = 0; i < field_count; ++i) {
+    LoadField(fields, i, &info->fields[i]);
+    info->field_numbers[i] = info->fields[i].number;
+    if (i > 0 && info->field_numbers[i] <= info->field_numbers[i - 1]) {
+      throw CodecError("proto:mex:descriptor",
+                       "Fields of " + full_name +
+                       " are not ordered by number.");
+    }
+  }
+
+  info->struct_field_names.push_back("has_field");
+  for (size_t i = 0; i < field_count; ++i) {
+    names_.push_back(new std::string(info->fields[i].name));
+    info->struct_field_names.push_back(names_.back()->c_str());
+  }
+  info->struct_field_names.push_back("unknown_fields");
+  info->struct_field_names.push_back("descriptor_function");
+  return info;
+}
+
+void DescriptorPool::LoadField(const mxArray* fields, size_t index,
+                               FieldInfo* field) {
+  field->name = GetString(GetField(fields, index, "name"));
+  field->number = static_cast<uint32_t>(GetScalar(fields, index, "number"));
+  field->type = static_cast<int>(GetScalar(fields, index, "type"));
+  field->matlab_type = static_cast<int>(GetScalar(fields, index, "matlab_type"));
+  field->wire_type = static_cast<int>(GetScalar(fields, index, "wire_type"));
+  int label = static_cast<int>(GetScalar(fields, index, "label"));
+  field->repeated = label == kLabelRepeated;
+  field->required = label == kLabelRequired;
+  const mxArray* options = GetField(fields, index, "options");
+  field->packed = mxIsStruct(options) && GetScalar(options, 0, "packed") != 0;
+  // Descriptors generated before the option existed don't have it.
+  field->columns = mxIsStruct(options) &&
+      mxGetField(options, 0, "columns") != NULL &&
+      GetScalar(options, 0, "columns") != 0;
+  field->default_value = GetField(fields, index, "default_value");
+  field->message = NULL;
+
+  if (field->type == TYPE_GROUP) {
+    throw CodecError("proto:mex:descriptor",
+                     "Field " + field->name + " is a group, which is not "
+                     "supported.");
+  }
+  if (field->matlab_type == MATLAB_TYPE_MESSAGE) {
+    const mxArray* descriptor_function =
+        mxGetField(fields, index, "descriptor_function");
+    if (descriptor_function == NULL || mxIsEmpty(descriptor_function)) {
+      throw CodecError("proto:mex:descriptor",
+                       "Message field " + field->name + " has no "
+                       "descriptor_function. The descriptor must be "
+                       "regenerated.");
+    }
+    field->message = FindMessageByFunction(descriptor_function);
+  }
+}
+
+// ===================================================================
+
+Projection::Projection(const mxArray* projection, const MessageInfo& info) {
+  size_t field_count = info.fields.size();
+  const mxArray* wanted =
+      mxIsStruct(projection) ? mxGetField(projection, 0, "wanted") : NULL;
+  const mxArray* children =
+      mxIsStruct(projection) ? mxGetField(projection, 0, "children") : NULL;
+  if (wanted == NULL || !mxIsLogical(wanted) ||
+      mxGetNumberOfElements(wanted) != field_count ||
+      children == NULL || !mxIsCell(children) ||
+      mxGetNumberOfElements(children) != field_count) {
+    throw CodecError("proto:mex:usage",
+                     "Expected a projection of " + info.full_name +
+                     " made by pblib_field_projection.");
+  }
+  const mxLogical* flags = mxGetLogicals(wanted);
+  wanted_.assign(flags, flags + field_count);
+  children_.resize(field_count, NULL);
+  try {
+    for (size_t i = 0; i < field_count; ++i) {
+      const mxArray* child = mxGetCell(children, i);
+      if (child != NULL && !mxIsEmpty(child) &&
+          info.fields[i].message != NULL) {
+        children_[i] = new Projection(child, *info.fields[i].message);
+      }
+    }
+  } catch (...) {
+    // The destructor doesn't run for a constructor that throws.
+    for (size_t i = 0; i < field_count; ++i) {
+      delete children_[i];
+    }
+    throw;
+  }
+}
+
+Projection::~Projection() {
+  for (size_t i = 0; i < children_.size(); ++i) {
+    delete children_[i];
+  }
+}
+
+// Parses tasks on several threads.  Consecutive tasks are grouped into
+// chunks of about the same size, each parsed by a parser of its own.
+class ParseWork : public ParallelWork {
+ public:
+  ParseWork(const Parser& parser, std::vector<ParseTask>* tasks, int depth,
+            size_t total)
+      : tasks_(tasks), depth_(depth) {
+    size_t chunk_size = total / (ThreadCount() * 4);
+    if (chunk_size < kMinChunkSize) chunk_size = kMinChunkSize;
+    size_t size = 0;
+    chunk_begins_.push_back(0);
+    for (size_t i = 0; i < tasks->size(); ++i) {
+      size += (*tasks)[i].end - (*tasks)[i].begin;
+      if (size >= chunk_size && i + 1 < tasks->size()) {
+        chunk_begins_.push_back(i + 1);
+        size = 0;
+      }
+    }
+    chunk_begins_.push_back(tasks->size());
+    for (size_t i = 0; i < chunk_count(); ++i) {
+      parsers_.push_back(new Parser(parser.buffer(), parser.size()));
+    }
+  }
+  ~ParseWork() {
+    for (size_t i = 0; i < parsers_.size(); ++i) {
+      delete parsers_[i];
+    }
+  }
+
+  size_t chunk_count() const { return chunk_begins_.size() - 1; }
+
+  void Run(size_t chunk) {
+    Parser* parser = parsers_[chunk];
+    for (size_t i = chunk_begins_[chunk]; i < chunk_begins_[chunk + 1]; ++i) {
+      ParseTask& task = (*tasks_)[i];
+      task.index = parser->Parse(*task.info, task.begin, task.end, depth_,
+                                 task.projection, NULL);
+    }
+  }
+
+  // Moves the parsed messages of all chunks to parser, in order, and
+  // updates the indices of the tasks to match.
+  void Collect(Parser* parser) {
+    size_t count = parser->messages_.size();
+    for (size_t i = 0; i < parsers_.size(); ++i) {
+      count += parsers_[i]->messages_.size();
+    }
+    parser->messages_.reserve(count);
+    for (size_t chunk = 0; chunk < chunk_count(); ++chunk) {
+      size_t offset = parser->Append(parsers_[chunk]);
+      for (size_t i = chunk_begins_[chunk]; i < chunk_begins_[chunk + 1];
+           ++i) {
+        (*tasks_)[i].index += offset;
+      }
+    }
+  }
+
+ private:
+  std::vector<ParseTask>* tasks_;
+  int depth_;
+  std::vector<size_t> chunk_begins_;
+  std::vector<Parser*> parsers_;
+};
+
+namespace {
+
+// Parses the whole buffer of each parser, one parser per piece.
+class BufferWork : public ParallelWork {
+ public:
+  BufferWork(const MessageInfo& info, const std::vector<Parser*>& parsers,
+             std::vector<size_t>* indices)
+      : info_(info), parsers_(parsers), indices_(indices) {}
+
+  void Run(size_t index) {
+    Parser* parser = parsers_[index];
+    (*indices_)[index] = parser->Parse(info_, 0, parser->size());
+  }
+
+ private:
+  const MessageInfo& info_;
+  const std::vector<Parser*>& parsers_;
+  std::vector<size_t>* indices_;
+};
+
+}  // namespace
+
+Parser::Parser(const uint8_t* buffer, size_t size)
+    : buffer_(buffer), size_(size), parallel_(true) {}
+
+size_t Parser::Parse(const MessageInfo& info, size_t begin, size_t end,
+                     const Projection* projection) {
+  if (begin > end || end > size_) {
+    throw CodecError("proto:mex:usage", "Buffer range is out of bounds.");
+  }
+  if (!parallel_ || end - begin < kMinParallelSize || ThreadCount() < 2) {
+    return Parse(info, begin, end, 0, projection, NULL);
+  }
+  std::vector<ParseTask> nested;
+  size_t index = Parse(info, begin, end, 0, projection, &nested);
+  ParseAll(&nested, 1);
+  // Point the values of the message fields at the parsed messages, they are
+  // in the same order.
+  std::vector<WireValue>& values = messages_[index].values;
+  size_t next = 0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (values[i].field >= 0 &&
+        info.fields[values[i].field].matlab_type == MATLAB_TYPE_MESSAGE) {
+      values[i].value = nested[next++].index;
+    }
+  }
+  return index;
+}
+
+void Parser::ParseAll(std::vector<ParseTask>* tasks) {
+  for (size_t i = 0; i < tasks->size(); ++i) {
+    const ParseTask& task = (*tasks)[i];
+    if (task.begin > task.end || task.end > size_) {
+      throw CodecError("proto:mex:usage", "Buffer range is out of bounds.");
+    }
+  }
+  ParseAll(tasks, 0);
+}
+
+void Parser::ParseAll(std::vector<ParseTask>* tasks, int depth) {
+  size_t total = 0;
+  for (size_t i = 0; i < tasks->size(); ++i) {
+    total += (*tasks)[i].end - (*tasks)[i].begin;
+  }
+  if (!parallel_ || tasks->size() < 2 || total < kMinParallelSize ||
+      ThreadCount() < 2) {
+    for (size_t i = 0; i < tasks->size(); ++i) {
+      ParseTask& task = (*tasks)[i];
+      task.index = Parse(*task.info, task.begin, task.end, depth,
+                         task.projection, NULL);
+    }
+    return;
+  }
+  ParseWork work(*this, tasks, depth, total);
+  RunParallel(&work, work.chunk_count());
+  work.Collect(this);
+}
+
+size_t Parser::Append(Parser* other) {
+  size_t offset = messages_.size();
+  messages_.resize(offset + other->messages_.size());
+  for (size_t i = 0; i < other->messages_.size(); ++i) {
+    ParsedMessage& message = messages_[offset + i];
+    message.info = other->messages_[i].info;
+    message.projected = other->messages_[i].projected;
+    message.values.swap(other->messages_[i].values);
+    for (size_t j = 0; j < message.values.size(); ++j) {
+      WireValue& value = message.values[j];
+      if (value.field >= 0 &&
+          message.info->fields[value.field].matlab_type ==
+              MATLAB_TYPE_MESSAGE) {
+        value.value += offset;
+      }
+    }
+  }
+  other->messages_.clear();
+  return offset;
+}
+
+size_t Parser::Parse(const MessageInfo& info, size_t begin, size_t end,
+                     int depth, const Projection* projection,
+                     std::vector<ParseTask>* deferred) {
+  if (depth > kMaxRecursionDepth) {
+    throw CodecError("proto:mex:malformed",
+                     "Messages are nested too deeply.");
+  }
+  size_t index = messages_.size();
+  messages_.push_back(ParsedMessage());
+  messages_[index].info = &info;
+  messages_[index].projected = projection != NULL;
+
+  // Nested messages are appended to messages_ while parsing, so the values
+  // are collected separately and moved in at the end.
+  std::vector<WireValue> values;
+  size_t position = begin;
+  while (position < end) {
+    size_t tag_begin = position;
+    uint64_t tag;
+    position = ReadVarint(buffer_, position, end, &tag);
+    uint32_t number = static_cast<uint32_t>(tag >> 3);
+
+    WireValue value;
+    value.wire_type = static_cast<int>(tag & 7);
+    value.value = 0;
+    switch (value.wire_type) {
+      case WIRE_TYPE_VARINT:
+        value.begin = position;
+        position = ReadVarint(buffer_, position, end, &value.value);
+        value.end = position;
+        break;
+      case WIRE_TYPE_FIXED64:
+      case WIRE_TYPE_FIXED32: {
+        size_t size = value.wire_type == WIRE_TYPE_FIXED64 ? 8 : 4;
+        if (end - position < size) {
+          throw CodecError("proto:mex:truncated",
+                           "Buffer ends in the middle of a fixed width value.");
+        }
+        value.value = ReadLittleEndian(buffer_ + position, size);
+        value.begin = position;
+        position += size;
+        value.end = position;
+        break;
+      }
+      case WIRE_TYPE_LENGTH_DELIMITED: {
+        uint64_t length;
+        position = ReadVarint(buffer_, position, end, &length);
+        if (end - position < length) {
+          throw CodecError("proto:mex:truncated",
+                           "Buffer ends in the middle of a length delimited "
+                           "value.");
+        }
+        value.begin = position;
+        position += length;
+        value.end = position;
+        break;
+      }
+      case WIRE_TYPE_START_GROUP:
+        throw CodecError("proto:lib:read_wire_type",
+                         "Start Group not implemented.");
+      case WIRE_TYPE_END_GROUP:
+        throw CodecError("proto:lib:read_wire_type",
+                         "End Group not implemented.");
+      default:
+        throw CodecError("proto:lib:read_wire_type",
+                         "Invalid wire value. This is likely due to a "
+                         "malformed message.");
+    }
+
+    value.field = info.FindFieldByNumber(number);
+    if (projection != NULL &&
+        (value.field < 0 || !projection->wanted(value.field))) {
+      continue;
+    }
+    if (value.field < 0) {
+      value.begin = tag_begin;
+    } else {
+      const FieldInfo& field = info.fields[value.field];
+      bool packed_run = field.repeated && IsPackable(field) &&
+          value.wire_type == WIRE_TYPE_LENGTH_DELIMITED;
+      if (value.wire_type != field.wire_type && !packed_run) {
+        throw CodecError("proto:read:wire_type_mismatch",
+                         "Wire type mismatch while reading " + field.name +
+                         ".");
+      }
+      if (field.matlab_type == MATLAB_TYPE_MESSAGE) {
+        const Projection* child =
+            projection ? projection->child(value.field) : NULL;
+        if (deferred != NULL) {
+          ParseTask task = {field.message, value.begin, value.end, child, 0};
+          deferred->push_back(task);
+        } else {
+          value.value = Parse(*field.message, value.begin, value.end,
+                              depth + 1, child, NULL);
+        }
+      }
+    }
+    values.push_back(value);
+  }
+  messages_[index].values.swap(values);
+  return index;
+}
+
+void ParseBuffers(const MessageInfo& info, const std::vector<Parser*>& parsers,
+                  std::vector<size_t>* indices) {
+  indices->resize(parsers.size());
+  size_t total = 0;
+  for (size_t i = 0; i < parsers.size(); ++i) {
+    total += parsers[i]->size();
+  }
+  if (parsers.size() < 2 || total < kMinParallelSize || ThreadCount() < 2) {
+    for (size_t i = 0; i < parsers.size(); ++i) {
+      (*indices)[i] = parsers[i]->Parse(info, 0, parsers[i]->size());
+    }
+    return;
+  }
+  for (size_t i = 0; i < parsers.size(); ++i) {
+    parsers[i]->set_parallel(false);
+  }
+  BufferWork work(info, parsers, indices);
+  RunParallel(&work, parsers.size());
+}
+
+// ===================================================================
+
+MessageBuilder::MessageBuilder(const Parser& parser) : parser_(parser) {}
+
+mxArray* MessageBuilder::Build(size_t index) {
+  const MessageInfo& info = *parser_.message(index).info;
+  // Leaves out descriptor_function, which is last.
+  int field_count = static_cast<int>(info.struct_field_names.size()) - 1;
+  mxArray* array = mxCreateStructMatrix(
+      1, 1, field_count,
+      const_cast<const char**>(&info.struct_field_names[0]));
+  Fill(array, 0, index, false);
+  return array;
+}
+
+void MessageBuilder::BuildElement(mxArray* array, size_t element,
+                                  size_t index) {
+  Fill(array, element, index, true);
+}
+
+void MessageBuilder::Fill(mxArray* array, size_t element, size_t index,
+                          bool with_descriptor_function) {
+  const ParsedMessage& message = parser_.message(index);
+  const MessageInfo& info = *message.info;
+  size_t field_count = info.fields.size();
+
+  // Find the last value of every singular field and the number of elements
+  // of every repeated one.
+  std::vector<size_t> counts(field_count, 0);
+  std::vector<int> last(field_count, -1);
+  size_t unknown_count = 0;
+  for (size_t i = 0; i < message.values.size(); ++i) {
+    const WireValue& value = message.values[i];
+    if (value.field < 0) {
+      ++unknown_count;
+      continue;
+    }
+    const FieldInfo& field = info.fields[value.field];
+    if (field.repeated && value.wire_type != field.wire_type) {
+      counts[value.field] += CountPacked(field, parser_.buffer(),
+                                         value.begin, value.end);
+    } else {
+      ++counts[value.field];
+    }
+    last[value.field] = static_cast<int>(i);
+  }
+
+  std::vector<bool> has_field(field_count);
+  for (size_t f = 0; f < field_count; ++f) {
+    const FieldInfo& field = info.fields[f];
+    mxArray* field_value;
+    has_field[f] = last[f] >= 0;
+    if (!has_field[f]) {
+      field_value = mxDuplicateArray(field.default_value);
+    } else if (field.columns) {
+      field_value = CreateColumns(message, static_cast<int>(f), counts[f]);
+    } else if (field.repeated) {
+      field_value = CreateRepeated(message, static_cast<int>(f), counts[f]);
+    } else {
+      field_value = CreateSingular(field, message.values[last[f]]);
+    }
+    mxSetFieldByNumber(array, element, static_cast<int>(f) + 1, field_value);
+    if (field.required && !has_field[f] && !message.projected) {
+      mexWarnMsgIdAndTxt("proto:read:required_enforcement",
+                         "Required field not set while parsing. "
+                         "This is an error.");
+    }
+  }
+  mxSetFieldByNumber(array, element, 0, CreateHasField(has_field));
+  mxSetFieldByNumber(array, element, static_cast<int>(field_count) + 1,
+                     CreateUnknownFields(message, unknown_count));
+  if (with_descriptor_function) {
+    mxSetFieldByNumber(array, element, static_cast<int>(field_count) + 2,
+                       mxDuplicateArray(info.descriptor_function));
+  }
+}
+
+mxArray* MessageBuilder::CreateSingular(const FieldInfo& field,
+                                        const WireValue& value) {
+  const uint8_t* buffer = parser_.buffer();
+  switch (field.matlab_type) {
+    case MATLAB_TYPE_STRING:
+      return CreateString(buffer + value.begin, value.end - value.begin);
+    case MATLAB_TYPE_BYTES:
+      return CreateBytes(buffer + value.begin, value.end - value.begin);
+    case MATLAB_TYPE_MESSAGE: {
+      const MessageInfo& info = *field.message;
+      mxArray* array = mxCreateStructMatrix(
+          1, 1, static_cast<int>(info.struct_field_names.size()),
+          const_cast<const char**>(&info.struct_field_names[0]));
+      Fill(array, 0, static_cast<size_t>(value.value), true);
+      return array;
+    }
+    default: {
+      mxArray* array = mxCreateNumericMatrix(1, 1, ClassOf(field), mxREAL);
+      StoreNumeric(field, value.value, mxGetData(array), 0);
+      return array;
+    }
+  }
+}
+
+mxArray* MessageBuilder::CreateRepeated(const ParsedMessage& message,
+                                        int field_index, size_t count) {
+  const FieldInfo& field = message.info->fields[field_index];
+  const uint8_t* buffer = parser_.buffer();
+  mxArray* array;
+  void* data = NULL;
+  switch (field.matlab_type) {
+    case MATLAB_TYPE_STRING:
+    case MATLAB_TYPE_BYTES:
+      array = mxCreateCellMatrix(1, count);
+      break;
+    case MATLAB_TYPE_MESSAGE: {
+      const MessageInfo& info = *field.message;
+      array = mxCreateStructMatrix(
+          1, count, static_cast<int>(info.struct_field_names.size()),
+          const_cast<const char**>(&info.struct_field_names[0]));
+      break;
+    }
+    default:
+      array = mxCreateNumericMatrix(1, count, ClassOf(field), mxREAL);
+      data = mxGetData(array);
+      break;
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < message.values.size() && n < count; ++i) {
+    const WireValue& value = message.values[i];
+    if (value.field != field_index) {
+      continue;
+    }
+    switch (field.matlab_type) {
+      case MATLAB_TYPE_STRING:
+        mxSetCell(array, n++,
+                  CreateString(buffer + value.begin, value.end - value.begin));
+        break;
+      case MATLAB_TYPE_BYTES:
+        mxSetCell(array, n++,
+                  CreateBytes(buffer + value.begin, value.end - value.begin));
+        break;
+      case MATLAB_TYPE_MESSAGE:
+        Fill(array, n++, static_cast<size_t>(value.value), true);
+        break;
+      default:
+        if (value.wire_type != field.wire_type) {
+          n += StorePacked(field, buffer, value.begin, value.end, data, n);
+        } else {
+          StoreNumeric(field, value.value, data, n++);
+        }
+        break;
+    }
+  }
+  return array;
+}
+
+mxArray* MessageBuilder::CreateColumns(const ParsedMessage& message,
+                                       int field_index, size_t count) {
+  const FieldInfo& field = message.info->fields[field_index];
+  CheckColumns(field);
+  const MessageInfo& info = *field.message;
+  size_t column_count = info.fields.size();
+  // The field names of the columns are those of the message fields, which
+  // follow has_field.
+  mxArray* array = mxCreateStructMatrix(
+      1, 1, static_cast<int>(column_count),
+      const_cast<const char**>(&info.struct_field_names[1]));
+  std::vector<void*> data(column_count);
+  for (size_t f = 0; f < column_count; ++f) {
+    const FieldInfo& column = info.fields[f];
+    mxArray* values = mxCreateNumericMatrix(1, count, ClassOf(column), mxREAL);
+    mxSetFieldByNumber(array, 0, static_cast<int>(f), values);
+    data[f] = mxGetData(values);
+    // Rows of messages without the field get its default value.
+    uint64_t default_value = EncodeNumeric(column, column.default_value, 0);
+    for (size_t n = 0; n < count; ++n) {
+      StoreNumeric(column, default_value, data[f], n);
+    }
+  }
+
+  size_t n = 0;
+  for (size_t i = 0; i < message.values.size() && n < count; ++i) {
+    const WireValue& value = message.values[i];
+    if (value.field != field_index) {
+      continue;
+    }
+    // Values are stored in order, so the last one of a field wins, and
+    // unknown fields of the rows are dropped.
+    const ParsedMessage& row = parser_.message(static_cast<size_t>(value.value));
+    for (size_t j = 0; j < row.values.size(); ++j) {
+      const WireValue& row_value = row.values[j];
+      if (row_value.field >= 0) {
+        StoreNumeric(info.fields[row_value.field], row_value.value,
+                     data[row_value.field], n);
+      }
+    }
+    ++n;
+  }
+  return array;
+}
+
+mxArray* MessageBuilder::CreateHasField(const std::vector<bool>& has_field) {
+  mxArray* array = mxCreateLogicalMatrix(1, has_field.size());
+  mxLogical* data = mxGetLogicals(array);
+  for (size_t f = 0; f < has_field.size(); ++f) {
+    data[f] = has_field[f];
+  }
+  return array;
+}
+
+mxArray* MessageBuilder::CreateUnknownFields(const ParsedMessage& message,
+                                             size_t count) {
+  if (count == 0) {
+    return mxCreateDoubleMatrix(0, 0, mxREAL);
+  }
+  static const char* kNames[] = {"number", "wire_type", "raw_data"};
+  mxArray* array = mxCreateStructMatrix(1, count, 3, kNames);
+  const uint8_t* buffer = parser_.buffer();
+  size_t n = 0;
+  for (size_t i = 0; i < message.values.size(); ++i) {
+    const WireValue& value = message.values[i];
+    if (value.field >= 0) {
+      continue;
+    }
+    uint64_t tag;
+    ReadVarint(buffer, value.begin, value.end, &tag);
+    mxSetFieldByNumber(array, n, 0,
+                       CreateUint32(static_cast<uint32_t>(tag >> 3)));
+    mxSetFieldByNumber(array, n, 1,
+                       CreateUint32(static_cast<uint32_t>(value.wire_type)));
+    mxSetFieldByNumber(array, n, 2, CreateBytes(buffer + value.begin,
+                                                value.end - value.begin));
+    ++n;
+  }
+  return array;
+}
+
+// ===================================================================
+
+Serializer::Serializer(DescriptorPool* pool) : pool_(pool), next_size_(0) {}
+
+mxArray* Serializer::Serialize(const mxArray* msg) {
+  if (msg == NULL || !mxIsStruct(msg) || mxIsEmpty(msg)) {
+    throw CodecError("proto:mex:value", "Expected a message struct.");
+  }
+  return Serialize(
+      *pool_->FindMessageByFunction(GetField(msg, 0, "descriptor_function")),
+      msg);
+}
+
+mxArray* Serializer::Serialize(const MessageInfo& info, const mxArray* msg) {
+  if (msg == NULL || !mxIsStruct(msg) || mxIsEmpty(msg)) {
+    throw CodecError("proto:mex:value", "Expected a message struct.");
+  }
+  sizes_.clear();
+  size_t size = ComputeSize(info, msg, 0);
+  mxArray* buffer = mxCreateNumericMatrix(1, size, mxUINT8_CLASS, mxREAL);
+  uint8_t* begin = static_cast<uint8_t*>(mxGetData(buffer));
+  next_size_ = 0;
+  uint8_t* end = Write(info, msg, 0, begin);
+  if (static_cast<size_t>(end - begin) != size) {
+    throw CodecError("proto:pblib_generic_serialize_to_string",
+                     "Number of bytes written is different from the "
+                     "precalculated length.");
+  }
+  return buffer;
+}
+
+mxArray* Serializer::SerializeDelimited(const mxArray* msgs) {
+  if (msgs == NULL || !mxIsStruct(msgs)) {
+    throw CodecError("proto:mex:value", "Expected a message struct array.");
+  }
+  size_t count = mxGetNumberOfElements(msgs);
+  if (count == 0) {
+    return mxCreateNumericMatrix(1, 0, mxUINT8_CLASS, mxREAL);
+  }
+  // The elements of a struct array all have the type of the first one.
+  const MessageInfo& info =
+      *pool_->FindMessageByFunction(GetField(msgs, 0, "descriptor_function"));
+  sizes_.clear();
+  size_t size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    size_t length = ComputeSize(info, msgs, i);
+    size += VarintSize(length) + length;
+  }
+  mxArray* buffer = mxCreateNumericMatrix(1, size, mxUINT8_CLASS, mxREAL);
+  uint8_t* begin = static_cast<uint8_t*>(mxGetData(buffer));
+  uint8_t* target = begin;
+  next_size_ = 0;
+  for (size_t i = 0; i < count; ++i) {
+    // Write consumes the size of the message itself first.
+    target = WriteVarint(sizes_[next_size_], target);
+    target = Write(info, msgs, i, target);
+  }
+  if (static_cast<size_t>(target - begin) != size) {
+    throw CodecError("proto:pblib_generic_serialize_to_string",
+                     "Number of bytes written is different from the "
+                     "precalculated length.");
+  }
+  return buffer;
+}
+
+size_t Serializer::ComputeSize(const MessageInfo& info, const mxArray* msg,
+                               size_t element) {
+  size_t slot = sizes_.size();
+  sizes_.push_back(0);
+  size_t size = 0;
+  for (size_t f = 0; f < info.fields.size(); ++f) {
+    const FieldInfo& field = info.fields[f];
+    const mxArray* value = GetField(msg, element, field.name.c_str());
+    if (mxIsEmpty(value) || !HasField(msg, element, f)) {
+      continue;
+    }
+    size += ComputeFieldSize(field, value);
+  }
+  const mxArray* unknown_fields = mxGetField(msg, element, "unknown_fields");
+  if (unknown_fields != NULL && mxIsStruct(unknown_fields)) {
+    for (size_t i = 0; i < mxGetNumberOfElements(unknown_fields); ++i) {
+      size += mxGetNumberOfElements(
+          GetField(unknown_fields, i, "raw_data"));
+    }
+  }
+  sizes_[slot] = size;
+  return size;
+}
+
+size_t Serializer::ComputeFieldSize(const FieldInfo& field,
+                                    const mxArray* value) {
+  if (field.columns) {
+    return ComputeColumnsSize(field, value);
+  }
+  size_t count = field.repeated ? mxGetNumberOfElements(value) : 1;
+  if (field.repeated && field.packed) {
+    size_t payload = PackedPayloadSize(field, value);
+    return VarintSize(MakeTag(field.number, WIRE_TYPE_LENGTH_DELIMITED)) +
+           VarintSize(payload) + payload;
+  }
+
+  size_t size = count * VarintSize(MakeTag(field.number, field.wire_type));
+  switch (field.matlab_type) {
+    case MATLAB_TYPE_STRING:
+    case MATLAB_TYPE_BYTES:
+      for (size_t j = 0; j < count; ++j) {
+        size_t length =
+            BytesSize(field.repeated ? GetCell(field, value, j) : value);
+        size += VarintSize(length) + length;
+      }
+      break;
+    case MATLAB_TYPE_MESSAGE:
+      CheckStruct(field, value);
+      count = mxGetNumberOfElements(value);
+      size = count * VarintSize(MakeTag(field.number, field.wire_type));
+      for (size_t j = 0; j < count; ++j) {
+        // A placeholder takes no slot in sizes_, its bytes are copied.
+        size_t length;
+        if (IsLazy(value)) {
+          GetLazyBytes(value, j, &length);
+        } else {
+          length = ComputeSize(*field.message, value, j);
+        }
+        size += VarintSize(length) + length;
+      }
+      break;
+    default:
+      for (size_t j = 0; j < count; ++j) {
+        size += NumericSize(field, EncodeNumeric(field, value, j));
+      }
+      break;
+  }
+  return size;
+}
+
+size_t Serializer::ComputeColumnsSize(const FieldInfo& field,
+                                      const mxArray* value) {
+  std::vector<const mxArray*> columns;
+  size_t count = GetColumns(field, value, &columns);
+  size_t size = count * VarintSize(MakeTag(field.number, field.wire_type));
+  for (size_t j = 0; j < count; ++j) {
+    // Each row is a message of its own and takes a slot in sizes_.
+    size_t length = ColumnsRowSize(*field.message, columns, j);
+    sizes_.push_back(length);
+    size += VarintSize(length) + length;
+  }
+  return size;
+}
+
+uint8_t* Serializer::Write(const MessageInfo& info, const mxArray* msg,
+                           size_t element, uint8_t* target) {
+  ++next_size_;
+  for (size_t f = 0; f < info.fields.size(); ++f) {
+    const FieldInfo& field = info.fields[f];
+    const mxArray* value = GetField(msg, element, field.name.c_str());
+    if (mxIsEmpty(value) || !HasField(msg, element, f)) {
+      continue;
+    }
+    target = WriteField(field, value, target);
+  }
+  const mxArray* unknown_fields = mxGetField(msg, element, "unknown_fields");
+  if (unknown_fields != NULL && mxIsStruct(unknown_fields)) {
+    for (size_t i = 0; i < mxGetNumberOfElements(unknown_fields); ++i) {
+      target = WriteBytes(GetField(unknown_fields, i, "raw_data"), target);
+    }
+  }
+  return target;
+}
+
+uint8_t* Serializer::WriteField(const FieldInfo& field, const mxArray* value,
+                                uint8_t* target) {
+  if (field.columns) {
+    return WriteColumns(field, value, target);
+  }
+  size_t count = field.repeated ? mxGetNumberOfElements(value) : 1;
+  if (field.repeated && field.packed) {
+    target = WriteVarint(MakeTag(field.number, WIRE_TYPE_LENGTH_DELIMITED),
+                         target);
+    target = WriteVarint(PackedPayloadSize(field, value), target);
+    return WritePackedPayload(field, value, target);
+  }
+
+  uint32_t tag = MakeTag(field.number, field.wire_type);
+  switch (field.matlab_type) {
+    case MATLAB_TYPE_STRING:
+    case MATLAB_TYPE_BYTES:
+      for (size_t j = 0; j < count; ++j) {
+        const mxArray* element =
+            field.repeated ? GetCell(field, value, j) : value;
+        target = WriteVarint(tag, target);
+        target = WriteVarint(BytesSize(element), target);
+        target = WriteBytes(element, target);
+      }
+      break;
+    case MATLAB_TYPE_MESSAGE:
+      count = mxGetNumberOfElements(value);
+      for (size_t j = 0; j < count; ++j) {
+        target = WriteVarint(tag, target);
+        if (IsLazy(value)) {
+          target = WriteLazyBytes(value, j, target);
+        } else {
+          target = WriteVarint(sizes_[next_size_], target);
+          target = Write(*field.message, value, j, target);
+        }
+      }
+      break;
+    default:
+      for (size_t j = 0; j < count; ++j) {
+        target = WriteVarint(tag, target);
+        target = WriteNumeric(field, EncodeNumeric(field, value, j), target);
+      }
+      break;
+  }
+  return target;
+}
+
+uint8_t* Serializer::WriteColumns(const FieldInfo& field, const mxArray* value,
+                                  uint8_t* target) {
+  std::vector<const mxArray*> columns;
+  size_t count = GetColumns(field, value, &columns);
+  const MessageInfo& info = *field.message;
+  uint32_t tag = MakeTag(field.number, field.wire_type);
+  for (size_t j = 0; j < count; ++j) {
+    target = WriteVarint(tag, target);
+    target = WriteVarint(sizes_[next_size_++], target);
+    for (size_t f = 0; f < info.fields.size(); ++f) {
+      const FieldInfo& column = info.fields[f];
+      target = WriteVarint(MakeTag(column.number, column.wire_type), target);
+      target = WriteNumeric(column, EncodeNumeric(column, columns[f], j),
+                            target);
+    }
+  }
+  return target;
+}
+
+// ===================================================================
+
+ColumnExtractor::ColumnExtractor(const MessageInfo& info,
+                                 const std::vector<std::vector<int> >& paths,
+                                 size_t row_count)
+    : info_(info), paths_(paths) {
+  try {
+    for (size_t p = 0; p < paths_.size(); ++p) {
+      const std::vector<int>& path = paths_[p];
+      const MessageInfo* message = &info_;
+      const FieldInfo* field = NULL;
+      for (size_t level = 0; level < path.size(); ++level) {
+        if (field != NULL) {
+          if (field->matlab_type != MATLAB_TYPE_MESSAGE || field->repeated) {
+            throw CodecError("proto:mex:usage",
+                             "Field " + field->name + " is not a singular "
+                             "message.");
+          }
+          message = field->message;
+        }
+        if (path[level] < 0 ||
+            static_cast<size_t>(path[level]) >= message->fields.size()) {
+          throw CodecError("proto:mex:usage",
+                           "Field index out of range for " +
+                           message->full_name + ".");
+        }
+        field = &message->fields[path[level]];
+      }
+      if (field == NULL || field->repeated) {
+        throw CodecError("proto:mex:usage",
+                         "Columns must end in a singular numeric field.");
+      }
+      mxClassID class_id = ClassOf(*field);
+      mxArray* column = mxCreateNumericMatrix(1, row_count, class_id, mxREAL);
+      columns_.push_back(column);
+      leaves_.push_back(field);
+      if (mxGetClassID(field->default_value) == class_id &&
+          mxGetNumberOfElements(field->default_value) == 1) {
+        size_t element_size = ElementSize(class_id);
+        char* data = static_cast<char*>(mxGetData(column));
+        for (size_t row = 0; row < row_count; ++row) {
+          memcpy(data + row * element_size, mxGetData(field->default_value),
+                 element_size);
+        }
+      }
+    }
+  } catch (...) {
+    // The destructor doesn't run for a constructor that throws.
+    for (size_t i = 0; i < columns_.size(); ++i) {
+      mxDestroyArray(columns_[i]);
+    }
+    throw;
+  }
+}
+
+ColumnExtractor::~ColumnExtractor() {
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    mxDestroyArray(columns_[i]);
+  }
+}
+
+void ColumnExtractor::Extract(const uint8_t* buffer, size_t size,
+                              size_t begin, size_t end,
+                              const Projection* projection, size_t row) {
+  Parser parser(buffer, size);
+  size_t root = parser.Parse(info_, begin, end, projection);
+  for (size_t p = 0; p < paths_.size(); ++p) {
+    const ParsedMessage* message = &parser.message(root);
+    const WireValue* value = NULL;
+    for (size_t level = 0; level < paths_[p].size(); ++level) {
+      if (value != NULL) {
+        message = &parser.message(static_cast<size_t>(value->value));
+      }
+      // The last occurrence of a singular field wins.
+      value = NULL;
+      for (size_t i = message->values.size(); i > 0; --i) {
+        if (message->values[i - 1].field == paths_[p][level]) {
+          value = &message->values[i - 1];
+          break;
+        }
+      }
+      if (value == NULL) {
+        break;
+      }
+    }
+    if (value != NULL) {
+      StoreNumeric(*leaves_[p], value->value, mxGetData(columns_[p]), row);
+    }
+  }
+}
+
+mxArray* ColumnExtractor::Release() {
+  mxArray* cell = mxCreateCellMatrix(1, columns_.size());
+  for (size_t i = 0; i < columns_.size(); ++i) {
+    mxSetCell(cell, i, columns_[i]);
+  }
+  columns_.clear();
+  return cell;
+}
+
+// ===================================================================
+
+mxArray* ParsePacked(const FieldInfo& field, const uint8_t* buffer,
+                     size_t begin, size_t end) {
+  if (!IsPackable(field) || field.matlab_type == MATLAB_TYPE_MESSAGE) {
+    throw CodecError("proto:mex:descriptor",
+                     "Field " + field.name + " can not be packed.");
+  }
+  size_t count = CountPacked(field, buffer, begin, end);
+  mxArray* array = mxCreateNumericMatrix(1, count, ClassOf(field), mxREAL);
+  try {
+    StorePacked(field, buffer, begin, end, mxGetData(array), 0);
+  } catch (...) {
+    mxDestroyArray(array);
+    throw;
+  }
+  return array;
+}
+
+size_t PackedSize(const FieldInfo& field, const mxArray* values) {
+  if (!IsPackable(field) || field.matlab_type == MATLAB_TYPE_MESSAGE) {
+    throw CodecError("proto:mex:descriptor",
+                     "Field " + field.name + " can not be packed.");
+  }
+  return PackedPayloadSize(field, values);
+}
+
+mxArray* SerializePacked(const FieldInfo& field, const mxArray* values) {
+  size_t size = PackedSize(field, values);
+  mxArray* buffer = mxCreateNumericMatrix(1, size, mxUINT8_CLASS, mxREAL);
+  WritePackedPayload(field, values, static_cast<uint8_t*>(mxGetData(buffer)));
+  return buffer;
+}
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
@@ -0,0 +1,450 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Native implementation of pblib_generic_parse_from_string and
+// pblib_generic_serialize_to_string for the pblib_mex_codec MEX function.
+//
+// Both directions are driven by the descriptor structs the generated
+// pb_descriptor_* functions return, so the codec works for any message
+// without being regenerated.  Parsing is done in two passes: the buffer is
+// first scanned into a tree of ParsedMessages which record where every field
+// value lives, and then the Matlab structs are created in one go with every
+// repeated field allocated at its final size.  Serializing likewise computes
+// the sizes of all nested messages up front so that the output buffer is
+// allocated once and written front to back.
+
+#ifndef FARSOUNDER_PROTOBUF_MATLAB_CODEC_H__
+#define FARSOUNDER_PROTOBUF_MATLAB_CODEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <mex.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+// Must match MatlabGenerator::MatlabType and pblib_matlab_type_to_string.
+enum MatlabType {
+  MATLAB_TYPE_INT32 = 1,
+  MATLAB_TYPE_INT64 = 2,
+  MATLAB_TYPE_UINT32 = 3,
+  MATLAB_TYPE_UINT64 = 4,
+  MATLAB_TYPE_DOUBLE = 5,
+  MATLAB_TYPE_SINGLE = 6,
+  MATLAB_TYPE_STRING = 7,
+  MATLAB_TYPE_BYTES = 8,
+  MATLAB_TYPE_MESSAGE = 9,
+  MATLAB_TYPE_ENUM = 10
+};
+
+// Must match FieldDescriptor::Type, which is what the descriptors store.
+enum FieldType {
+  TYPE_DOUBLE = 1,
+  TYPE_FLOAT = 2,
+  TYPE_INT64 = 3,
+  TYPE_UINT64 = 4,
+  TYPE_INT32 = 5,
+  TYPE_FIXED64 = 6,
+  TYPE_FIXED32 = 7,
+  TYPE_BOOL = 8,
+  TYPE_STRING = 9,
+  TYPE_GROUP = 10,
+  TYPE_MESSAGE = 11,
+  TYPE_BYTES = 12,
+  TYPE_UINT32 = 13,
+  TYPE_ENUM = 14,
+  TYPE_SFIXED32 = 15,
+  TYPE_SFIXED64 = 16,
+  TYPE_SINT32 = 17,
+  TYPE_SINT64 = 18
+};
+
+enum WireType {
+  WIRE_TYPE_VARINT = 0,
+  WIRE_TYPE_FIXED64 = 1,
+  WIRE_TYPE_LENGTH_DELIMITED = 2,
+  WIRE_TYPE_START_GROUP = 3,
+  WIRE_TYPE_END_GROUP = 4,
+  WIRE_TYPE_FIXED32 = 5
+};
+
+// Thrown for malformed input or descriptors.  The MEX gateway turns it into a
+// Matlab error once everything on the C++ side has been cleaned up.
+class CodecError {
+ public:
+  CodecError(const std::string& id, const std::string& message)
+      : id_(id), message_(message) {}
+
+  const std::string& id() const { return id_; }
+  const std::string& message() const { return message_; }
+
+ private:
+  std::string id_;
+  std::string message_;
+};
+
+// Shared by pblib_mex_codec and the codecs written with codec=generated.
+
+// Converts a 1 based, inclusive Matlab index argument.
+size_t GetIndex(const mxArray* array);
+
+// Error details are copied here so no C++ object is alive when
+// mexErrMsgIdAndTxt jumps back into Matlab.
+extern char error_id[128];
+extern char error_message[1024];
+
+void SetError(const std::string& id, const std::string& message);
+
+struct MessageInfo;
+
+// The parts of a field entry of a Matlab descriptor the codec needs.
+struct FieldInfo {
+  std::string name;
+  uint32_t number;
+  int type;         // FieldType
+  int matlab_type;  // MatlabType
+  int wire_type;    // WireType
+  bool repeated;
+  bool required;
+  bool packed;
+  // Repeated message field read into a struct with a row vector per field of
+  // the message, see pblib_columns_to_struct.
+  bool columns;
+  const mxArray* default_value;
+  const MessageInfo* message;  // Only set for message fields.
+};
+
+// The parts of a Matlab descriptor the codec needs.
+struct MessageInfo {
+  std::string full_name;
+  // The pb_descriptor_* handle stored in nested message structs.  NULL until
+  // the message has been seen as the type of a message field.
+  const mxArray* descriptor_function;
+  // Ordered by field number, as the generator writes them.
+  std::vector<FieldInfo> fields;
+  std::vector<uint32_t> field_numbers;
+  // has_field, the fields, unknown_fields and descriptor_function, in the
+  // order pblib_generic_parse_from_string creates them.
+  std::vector<const char*> struct_field_names;
+
+  // Returns the index of the field with the given number or -1.
+  int FindFieldByNumber(uint32_t number) const;
+};
+
+// Converts Matlab descriptors into MessageInfos.  Descriptors of nested
+// message types are loaded through the descriptor_function of the fields
+// referring to them.  A pool should not outlive the MEX call which created
+// it, since it holds on to arrays Matlab frees when the call returns.
+class DescriptorPool {
+ public:
+  DescriptorPool();
+  ~DescriptorPool();
+
+  // Returns the info for the given descriptor struct.
+  const MessageInfo* FindMessage(const mxArray* descriptor);
+  // Calls the given pb_descriptor_* handle and returns the info for the
+  // descriptor it returns.
+  const MessageInfo* FindMessageByFunction(const mxArray* descriptor_function);
+  // Fills field from entry index of the fields array of a descriptor.
+  void LoadField(const mxArray* fields, size_t index, FieldInfo* field);
+
+ private:
+  MessageInfo* Load(const mxArray* descriptor,
+                    const mxArray* descriptor_function);
+
+  std::map<std::string, MessageInfo*> messages_;
+  // Owns the strings struct_field_names point to.
+  std::vector<std::string*> names_;
+};
+
+// A field value as found in the buffer.  For varint and fixed width values
+// the value itself is kept, for length delimited values only its position.
+struct WireValue {
+  int field;  // Index into MessageInfo::fields, -1 for unknown fields.
+  int wire_type;
+  // The decoded varint or the raw bits of a fixed width value.  For message
+  // fields, the index of the nested message in Parser::message().
+  uint64_t value;
+  // The value bytes of length delimited fields, or the complete tag and
+  // value of unknown fields.
+  size_t begin;
+  size_t end;
+};
+
+struct ParsedMessage {
+  const MessageInfo* info;
+  std::vector<WireValue> values;
+  // Whether only some of the fields were parsed, in which case missing
+  // required fields are expected.
+  bool projected;
+};
+
+// The fields to parse of a message, read from a projection struct as
+// pblib_field_projection creates them.
+class Projection {
+ public:
+  Projection(const mxArray* projection, const MessageInfo& info);
+  ~Projection();
+
+  bool wanted(int field) const { return wanted_[field]; }
+  // The projection of a message field, NULL if all of it is wanted.
+  const Projection* child(int field) const { return children_[field]; }
+
+ private:
+  std::vector<bool> wanted_;
+  std::vector<Projection*> children_;
+
+  // Not copyable.
+  Projection(const Projection&);
+  Projection& operator=(const Projection&);
+};
+
+// A message for Parser::ParseAll to parse, buffer[begin, end) as a message
+// of type info.  index is set to the index of the result.
+struct ParseTask {
+  const MessageInfo* info;
+  size_t begin;
+  size_t end;
+  const Projection* projection;
+  size_t index;
+};
+
+// First pass of parsing: splits a buffer into its field values, recursing
+// into nested messages.  Large inputs are split over several threads, see
+// parallel.h; the first pass only reads the buffer and the MessageInfos, so
+// any number of parsers may run at once.
+class Parser {
+ public:
+  Parser(const uint8_t* buffer, size_t size);
+
+  // Parses buffer[begin, end) as a message of the given type and returns the
+  // index of the result.  With a projection, all other fields are skipped
+  // over, as are unknown fields.  If the message is large, its message
+  // fields are parsed in parallel.
+  size_t Parse(const MessageInfo& info, size_t begin, size_t end,
+               const Projection* projection = NULL);
+  // Parses each of the tasks, in parallel if there is enough to parse.
+  void ParseAll(std::vector<ParseTask>* tasks);
+  // Whether Parse and ParseAll may use more than the calling thread, true
+  // unless set otherwise.  Parsers which already run on threads of their own
+  // should not start more.
+  void set_parallel(bool parallel) { parallel_ = parallel; }
+
+  const ParsedMessage& message(size_t index) const {
+    return messages_[index];
+  }
+  const uint8_t* buffer() const { return buffer_; }
+  size_t size() const { return size_; }
+
+ private:
+  friend class ParseWork;
+
+  // Parses a message at the given nesting depth.  If deferred isn't NULL,
+  // the values of message fields are added to it instead of being parsed.
+  size_t Parse(const MessageInfo& info, size_t begin, size_t end, int depth,
+               const Projection* projection,
+               std::vector<ParseTask>* deferred);
+  void ParseAll(std::vector<ParseTask>* tasks, int depth);
+  // Moves the messages of other to the end of messages_ and returns the
+  // index the first of them now has.
+  size_t Append(Parser* other);
+
+  const uint8_t* buffer_;
+  size_t size_;
+  bool parallel_;
+  std::vector<ParsedMessage> messages_;
+};
+
+// Parses the whole buffer of each parser as a message of type info and
+// stores the index of the result in indices, running several parsers at once
+// if there is enough to parse.
+void ParseBuffers(const MessageInfo& info, const std::vector<Parser*>& parsers,
+                  std::vector<size_t>* indices);
+
+// Second pass of parsing: creates the Matlab structs for parsed messages.
+class MessageBuilder {
+ public:
+  explicit MessageBuilder(const Parser& parser);
+
+  // Returns a 1x1 struct for the parsed message.  Like the result of
+  // pblib_generic_parse_from_string, it has no descriptor_function field.
+  mxArray* Build(size_t index);
+  // Fills element of array, a struct array with the struct_field_names of
+  // the message's type, with the parsed message.  The descriptor_function of
+  // the type is stored in it too.
+  void BuildElement(mxArray* array, size_t element, size_t index);
+
+ private:
+  void Fill(mxArray* array, size_t element, size_t index,
+            bool with_descriptor_function);
+  mxArray* CreateSingular(const FieldInfo& field, const WireValue& value);
+  mxArray* CreateRepeated(const ParsedMessage& message, int field_index,
+                          size_t count);
+  mxArray* CreateColumns(const ParsedMessage& message, int field_index,
+                         size_t count);
+  mxArray* CreateHasField(const std::vector<bool>& has_field);
+  mxArray* CreateUnknownFields(const ParsedMessage& message, size_t count);
+
+  const Parser& parser_;
+};
+
+// Serializes message structs into uint8 row vectors.
+class Serializer {
+ public:
+  explicit Serializer(DescriptorPool* pool);
+
+  // Serializes element 0 of msg, using its descriptor_function to find its
+  // type.
+  mxArray* Serialize(const mxArray* msg);
+  // Serializes element 0 of msg as a message of the given type.
+  mxArray* Serialize(const MessageInfo& info, const mxArray* msg);
+  // Serializes every element of the struct array msgs into one buffer, each
+  // preceded by its length as a varint, as writeDelimitedTo writes them.  The
+  // sizes of all messages are computed before the buffer is allocated.
+  mxArray* SerializeDelimited(const mxArray* msgs);
+
+ private:
+  size_t ComputeSize(const MessageInfo& info, const mxArray* msg,
+                     size_t element);
+  size_t ComputeFieldSize(const FieldInfo& field, const mxArray* value);
+  size_t ComputeColumnsSize(const FieldInfo& field, const mxArray* value);
+  uint8_t* Write(const MessageInfo& info, const mxArray* msg, size_t element,
+                 uint8_t* target);
+  uint8_t* WriteField(const FieldInfo& field, const mxArray* value,
+                      uint8_t* target);
+  uint8_t* WriteColumns(const FieldInfo& field, const mxArray* value,
+                        uint8_t* target);
+
+  DescriptorPool* pool_;
+  // The size of every message, in the order ComputeSize visits them.  Write
+  // visits them in the same order.
+  std::vector<size_t> sizes_;
+  size_t next_size_;
+};
+
+// Collects a singular numeric field, reached through singular message
+// fields, of many messages into one column, without creating the message
+// structs.
+class ColumnExtractor {
+ public:
+  // Each path holds the 0 based indices into the fields of info and of the
+  // messages nested in it, the last of which is the numeric field.  The
+  // columns are rows of row_count values, initialized to the default values
+  // of the fields.
+  ColumnExtractor(const MessageInfo& info,
+                  const std::vector<std::vector<int> >& paths,
+                  size_t row_count);
+  ~ColumnExtractor();
+
+  // Parses buffer[begin, end) and stores the values at the paths as element
+  // row of the columns.  Rows of messages without the field keep the
+  // default.
+  void Extract(const uint8_t* buffer, size_t size, size_t begin, size_t end,
+               const Projection* projection, size_t row);
+  // Returns the columns in a cell array and gives up ownership of them.
+  mxArray* Release();
+
+ private:
+  const MessageInfo& info_;
+  std::vector<std::vector<int> > paths_;
+  std::vector<const FieldInfo*> leaves_;
+  std::vector<mxArray*> columns_;
+
+  // Not copyable.
+  ColumnExtractor(const ColumnExtractor&);
+  ColumnExtractor& operator=(const ColumnExtractor&);
+};
+
+// Building blocks shared with the codecs MatlabGenerator writes with
+// codec=generated, see generated_codec.h.
+
+// Matlab arrays for length delimited values and the uint32s of
+// unknown_fields, as the read_function of each type creates them.
+mxArray* CreateString(const uint8_t* data, size_t size);
+mxArray* CreateBytes(const uint8_t* data, size_t size);
+mxArray* CreateUint32(uint32_t value);
+
+// Element index of array converted the way Matlab's conversion functions do
+// it: rounded to nearest with ties away from zero, saturated, NaN to 0.
+// Throws CodecError for arrays which aren't numeric, logical or char.
+int32_t ConvertToInt32(const mxArray* array, size_t index);
+int64_t ConvertToInt64(const mxArray* array, size_t index);
+uint32_t ConvertToUint32(const mxArray* array, size_t index);
+uint64_t ConvertToUint64(const mxArray* array, size_t index);
+float ConvertToSingle(const mxArray* array, size_t index);
+double ConvertToDouble(const mxArray* array, size_t index);
+
+// Messages and bytes read with lazy=true are placeholder structs holding the
+// lazy_buffer they were read from and the range lazy_start:lazy_end of their
+// bytes in it, see pblib_get.  They are written as those bytes, unchanged.
+// Returns whether array is such a struct array.
+bool IsLazy(const mxArray* array);
+// Returns the bytes element of the placeholder array refers to and sets *size
+// to their number.
+const uint8_t* GetLazyBytes(const mxArray* array, size_t element, size_t* size);
+// Writes the bytes of element of the placeholder array as a length delimited
+// value and returns the end of the written bytes.
+uint8_t* WriteLazyBytes(const mxArray* array, size_t element, uint8_t* target);
+
+// Returns the number of bytes WriteBytes writes for array.
+size_t BytesSize(const mxArray* array);
+// Writes uint8(array), which is the write_function of strings and bytes, or
+// the bytes of a placeholder, and returns the end of the written bytes.
+uint8_t* WriteBytes(const mxArray* array, uint8_t* target);
+
+// Returns element index of the has_field of element of msg.  has_field is a
+// logical row with one element per field, in the order of the descriptor's
+// fields.
+bool HasField(const mxArray* msg, size_t element, size_t index);
+
+// Packed runs on their own, for the .m code paths which handle the rest of
+// the message themselves.  The values are row vectors of the Matlab class of
+// the field, as read_packed_field in pblib_generic_parse_from_string returns
+// them.
+
+// Decodes the packed values in buffer[begin, end).
+mxArray* ParsePacked(const FieldInfo& field, const uint8_t* buffer,
+                     size_t begin, size_t end);
+// Returns the number of bytes the values take up as a packed run, without
+// the tag and the length.
+size_t PackedSize(const FieldInfo& field, const mxArray* values);
+// Encodes the values as a packed run, without the tag and the length.
+mxArray* SerializePacked(const FieldInfo& field, const mxArray* values);
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
+
+#endif  // FARSOUNDER_PROTOBUF_MATLAB_CODEC_H__
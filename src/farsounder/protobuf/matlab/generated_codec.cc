@@ -0,0 +1,416 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <farsounder/protobuf/matlab/generated_codec.h>
+
+#include <new>
+#include <string>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+namespace {
+
+// Same limit as codec.cc.
+const int kMaxRecursionDepth = 100;
+
+// The caches of DuplicateFunctionHandle, emptied when the MEX function is
+// cleared.
+std::vector<mxArray**> function_handles;
+
+void DestroyFunctionHandles() {
+  for (size_t i = 0; i < function_handles.size(); ++i) {
+    mxDestroyArray(*function_handles[i]);
+    *function_handles[i] = NULL;
+  }
+  function_handles.clear();
+}
+
+const mxArray* GetField(const mxArray* array, size_t element,
+                        const char* name) {
+  const mxArray* value = mxGetField(array, element, name);
+  if (value == NULL) {
+    throw CodecError("proto:mex:value",
+                     std::string("Message struct has no field ") + name +
+                     ".");
+  }
+  return value;
+}
+
+const GeneratedMessage& FindMessage(const GeneratedMessage* messages,
+                                    size_t message_count,
+                                    const mxArray* full_name) {
+  if (!mxIsChar(full_name)) {
+    throw CodecError("proto:mex:usage",
+                     "The second argument must be a message name.");
+  }
+  char* chars = mxArrayToString(full_name);
+  std::string name(chars);
+  mxFree(chars);
+  for (size_t i = 0; i < message_count; ++i) {
+    if (name == messages[i].full_name) {
+      return messages[i];
+    }
+  }
+  throw CodecError("proto:mex:usage",
+                   "The codec has no message " + name + ".");
+}
+
+void Read(const GeneratedMessage* messages, size_t message_count, int nlhs,
+          mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  if ((nrhs != 2 && nrhs != 4) || nlhs > 1) {
+    throw CodecError("proto:mex:usage",
+                     "Usage: msg = codec('read', full_name, buffer, "
+                     "buffer_start, buffer_end)");
+  }
+  const GeneratedMessage& message =
+      FindMessage(messages, message_count, prhs[0]);
+  const mxArray* buffer = prhs[1];
+  if (mxGetClassID(buffer) != mxUINT8_CLASS || mxIsComplex(buffer)) {
+    throw CodecError("proto:mex:usage", "buffer must be a uint8 array.");
+  }
+  size_t size = mxGetNumberOfElements(buffer);
+  size_t begin = 0;
+  size_t end = size;
+  if (nrhs == 4) {
+    begin = GetIndex(prhs[2]);
+    end = GetIndex(prhs[3]);
+    if (begin == 0 || end > size || end + 1 < begin) {
+      throw CodecError("proto:mex:usage", "Buffer range is out of bounds.");
+    }
+    --begin;
+  }
+  mxArray* msg = mxCreateStructMatrix(
+      1, 1, message.struct_field_count,
+      const_cast<const char**>(message.struct_field_names));
+  message.read(static_cast<const uint8_t*>(mxGetData(buffer)), begin, end, 0,
+               msg, 0);
+  plhs[0] = msg;
+}
+
+void Write(const GeneratedMessage* messages, size_t message_count, int nlhs,
+           mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  if (nrhs != 2 || nlhs > 1) {
+    throw CodecError("proto:mex:usage",
+                     "Usage: buffer = codec('write', full_name, msg)");
+  }
+  const GeneratedMessage& message =
+      FindMessage(messages, message_count, prhs[0]);
+  const mxArray* msg = prhs[1];
+  if (!mxIsStruct(msg) || mxIsEmpty(msg)) {
+    throw CodecError("proto:mex:value", "Expected a message struct.");
+  }
+  std::vector<size_t> sizes;
+  size_t size = message.size(msg, 0, &sizes);
+  mxArray* buffer = mxCreateNumericMatrix(1, size, mxUINT8_CLASS, mxREAL);
+  uint8_t* begin = static_cast<uint8_t*>(mxGetData(buffer));
+  const size_t* next_size = &sizes[0];
+  uint8_t* end = message.write(msg, 0, &next_size, begin);
+  if (static_cast<size_t>(end - begin) != size) {
+    throw CodecError("proto:pblib_generic_serialize_to_string",
+                     "Number of bytes written is different from the "
+                     "precalculated length.");
+  }
+  plhs[0] = buffer;
+}
+
+}  // namespace
+
+void RunGeneratedCodec(const GeneratedMessage* messages, size_t message_count,
+                       int nlhs, mxArray* plhs[], int nrhs,
+                       const mxArray* prhs[]) {
+  bool failed = false;
+  try {
+    if (nrhs < 1 || !mxIsChar(prhs[0])) {
+      throw CodecError("proto:mex:usage",
+                       "The first argument must be a command.");
+    }
+    char* command_chars = mxArrayToString(prhs[0]);
+    std::string command(command_chars);
+    mxFree(command_chars);
+    if (command == "read") {
+      Read(messages, message_count, nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "write") {
+      Write(messages, message_count, nlhs, plhs, nrhs - 1, prhs + 1);
+    } else {
+      throw CodecError("proto:mex:usage", "Unknown command " + command + ".");
+    }
+  } catch (const CodecError& e) {
+    SetError(e.id(), e.message());
+    failed = true;
+  } catch (const std::bad_alloc&) {
+    SetError("proto:mex:out_of_memory", "Out of memory.");
+    failed = true;
+  }
+  if (failed) {
+    mexErrMsgIdAndTxt(error_id, "%s", error_message);
+  }
+}
+
+// ===================================================================
+
+void CheckDepth(int depth) {
+  if (depth > kMaxRecursionDepth) {
+    throw CodecError("proto:mex:malformed",
+                     "Messages are nested too deeply.");
+  }
+}
+
+void ThrowWireTypeMismatch(const uint8_t* buffer, size_t position,
+                           size_t end, uint64_t tag, const char* field_name) {
+  SkipValue(buffer, position, end, static_cast<int>(tag & 7));
+  throw CodecError("proto:read:wire_type_mismatch",
+                   std::string("Wire type mismatch while reading ") +
+                   field_name + ".");
+}
+
+size_t SkipValue(const uint8_t* buffer, size_t position, size_t end,
+                 int wire_type) {
+  uint64_t value;
+  Range range;
+  switch (wire_type) {
+    case WIRE_TYPE_VARINT:
+      return ReadVarint(buffer, position, end, &value);
+    case WIRE_TYPE_FIXED64:
+      return ReadFixed(buffer, position, end, 8, &value);
+    case WIRE_TYPE_FIXED32:
+      return ReadFixed(buffer, position, end, 4, &value);
+    case WIRE_TYPE_LENGTH_DELIMITED:
+      return ReadLengthDelimited(buffer, position, end, &range);
+    case WIRE_TYPE_START_GROUP:
+      throw CodecError("proto:lib:read_wire_type",
+                       "Start Group not implemented.");
+    case WIRE_TYPE_END_GROUP:
+      throw CodecError("proto:lib:read_wire_type",
+                       "End Group not implemented.");
+    default:
+      throw CodecError("proto:lib:read_wire_type",
+                       "Invalid wire value. This is likely due to a "
+                       "malformed message.");
+  }
+}
+
+size_t SkipUnknownField(const uint8_t* buffer, size_t tag_begin,
+                        size_t position, size_t end, uint64_t tag,
+                        std::vector<UnknownField>* unknown_fields) {
+  UnknownField field;
+  field.number = static_cast<uint32_t>(tag >> 3);
+  field.wire_type = static_cast<int>(tag & 7);
+  field.begin = tag_begin;
+  field.end = SkipValue(buffer, position, end, field.wire_type);
+  unknown_fields->push_back(field);
+  return field.end;
+}
+
+void ThrowPackedTruncated(const char* field_name) {
+  throw CodecError("proto:mex:truncated",
+                   std::string("Packed field ") + field_name +
+                   " is truncated.");
+}
+
+// ===================================================================
+
+mxArray* CreateStringCell(const uint8_t* buffer,
+                          const std::vector<Range>& ranges) {
+  mxArray* array = mxCreateCellMatrix(1, ranges.size());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    mxSetCell(array, i, CreateString(buffer + ranges[i].begin,
+                                     ranges[i].end - ranges[i].begin));
+  }
+  return array;
+}
+
+mxArray* CreateBytesCell(const uint8_t* buffer,
+                         const std::vector<Range>& ranges) {
+  mxArray* array = mxCreateCellMatrix(1, ranges.size());
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    mxSetCell(array, i, CreateBytes(buffer + ranges[i].begin,
+                                    ranges[i].end - ranges[i].begin));
+  }
+  return array;
+}
+
+mxArray* CreateEmpty(mxClassID class_id) {
+  switch (class_id) {
+    case mxCHAR_CLASS: {
+      mwSize dims[2] = {0, 0};
+      return mxCreateCharArray(2, dims);
+    }
+    case mxSTRUCT_CLASS:
+      return mxCreateStructMatrix(0, 0, 0, NULL);
+    default:
+      return mxCreateNumericMatrix(0, 0, class_id, mxREAL);
+  }
+}
+
+mxArray* CreateDefaultString(const char* value, size_t size) {
+  if (size == 0) {
+    return CreateEmpty(mxCHAR_CLASS);
+  }
+  return CreateString(reinterpret_cast<const uint8_t*>(value), size);
+}
+
+mxArray* CreateDefaultBytes(const char* value, size_t size) {
+  if (size == 0) {
+    return CreateEmpty(mxUINT8_CLASS);
+  }
+  return CreateBytes(reinterpret_cast<const uint8_t*>(value), size);
+}
+
+mxArray* CreateUnknownFields(const uint8_t* buffer,
+                             const std::vector<UnknownField>& fields) {
+  if (fields.empty()) {
+    return mxCreateDoubleMatrix(0, 0, mxREAL);
+  }
+  static const char* kNames[] = {"number", "wire_type", "raw_data"};
+  mxArray* array = mxCreateStructMatrix(1, fields.size(), 3, kNames);
+  for (size_t i = 0; i < fields.size(); ++i) {
+    const UnknownField& field = fields[i];
+    mxSetFieldByNumber(array, i, 0, CreateUint32(field.number));
+    mxSetFieldByNumber(array, i, 1,
+                       CreateUint32(static_cast<uint32_t>(field.wire_type)));
+    mxSetFieldByNumber(array, i, 2, CreateBytes(buffer + field.begin,
+                                                field.end - field.begin));
+  }
+  return array;
+}
+
+mxArray* DuplicateFunctionHandle(const char* name, mxArray** cache) {
+  if (*cache == NULL) {
+    mxArray* input = mxCreateString(name);
+    mxArray* handle = NULL;
+    mxArray* exception = mexCallMATLABWithTrap(1, &handle, 1, &input,
+                                               "str2func");
+    mxDestroyArray(input);
+    if (exception != NULL) {
+      throw CodecError("proto:mex:descriptor",
+                       std::string("Cannot create a handle to ") + name +
+                       ".");
+    }
+    mexMakeArrayPersistent(handle);
+    if (function_handles.empty()) {
+      mexAtExit(DestroyFunctionHandles);
+    }
+    function_handles.push_back(cache);
+    *cache = handle;
+  }
+  return mxDuplicateArray(*cache);
+}
+
+void WarnRequiredFieldMissing() {
+  mexWarnMsgIdAndTxt("proto:read:required_enforcement",
+                     "Required field not set while parsing. "
+                     "This is an error.");
+}
+
+// ===================================================================
+
+const mxArray* GetFieldToWrite(const mxArray* msg, size_t element,
+                               const char* name, size_t index) {
+  const mxArray* value = GetField(msg, element, name);
+  if (mxIsEmpty(value) || !HasField(msg, element, index)) {
+    return NULL;
+  }
+  return value;
+}
+
+void CheckMessageStruct(const mxArray* value, const char* field_name) {
+  if (!mxIsStruct(value)) {
+    throw CodecError("proto:mex:value",
+                     std::string("Field ") + field_name +
+                     " must be a message struct.");
+  }
+}
+
+const mxArray* GetStringCell(const mxArray* value, const char* field_name,
+                             size_t index) {
+  if (!mxIsCell(value)) {
+    throw CodecError("proto:mex:value",
+                     std::string("Repeated field ") + field_name +
+                     " must be a cell array.");
+  }
+  const mxArray* cell = mxGetCell(value, index);
+  if (cell == NULL) {
+    throw CodecError("proto:mex:value",
+                     std::string("Repeated field ") + field_name +
+                     " has an empty cell.");
+  }
+  return cell;
+}
+
+size_t UnknownFieldsSize(const mxArray* msg, size_t element) {
+  const mxArray* unknown_fields = mxGetField(msg, element, "unknown_fields");
+  size_t size = 0;
+  if (unknown_fields != NULL && mxIsStruct(unknown_fields)) {
+    for (size_t i = 0; i < mxGetNumberOfElements(unknown_fields); ++i) {
+      size += mxGetNumberOfElements(GetField(unknown_fields, i, "raw_data"));
+    }
+  }
+  return size;
+}
+
+uint8_t* WriteUnknownFields(const mxArray* msg, size_t element,
+                            uint8_t* target) {
+  const mxArray* unknown_fields = mxGetField(msg, element, "unknown_fields");
+  if (unknown_fields != NULL && mxIsStruct(unknown_fields)) {
+    for (size_t i = 0; i < mxGetNumberOfElements(unknown_fields); ++i) {
+      target = WriteBytes(GetField(unknown_fields, i, "raw_data"), target);
+    }
+  }
+  return target;
+}
+
+size_t GetColumns(const mxArray* value, const char* field_name,
+                  const char* const* names, size_t count,
+                  const mxArray** columns) {
+  CheckMessageStruct(value, field_name);
+  size_t length = 0;
+  for (size_t f = 0; f < count; ++f) {
+    columns[f] = mxGetField(value, 0, names[f]);
+    if (columns[f] == NULL) {
+      throw CodecError("proto:mex:value",
+                       std::string("Field ") + field_name +
+                       " has no column " + names[f] + ".");
+    }
+    if (f == 0) {
+      length = mxGetNumberOfElements(columns[f]);
+    } else if (mxGetNumberOfElements(columns[f]) != length) {
+      throw CodecError("proto:mex:value",
+                       std::string("The columns of field ") + field_name +
+                       " differ in length.");
+    }
+  }
+  return length;
+}
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
@@ -0,0 +1,292 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Support code for the codecs MatlabGenerator writes with codec=generated.
+//
+// A generated codec is the source of a MEX function for the messages of one
+// .proto file.  For every message it has a read function, which parses a
+// buffer straight into a Matlab struct with the field number dispatch, the
+// wire type checks and the conversions written out for the message, and a
+// size and a write function which serialize a struct the same way.  The
+// structs and bytes are the same as those of pblib_mex_codec, only no
+// descriptor is looked at.  What doesn't depend on the message is here.
+
+#ifndef FARSOUNDER_PROTOBUF_MATLAB_GENERATED_CODEC_H__
+#define FARSOUNDER_PROTOBUF_MATLAB_GENERATED_CODEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits>
+#include <vector>
+
+#include <mex.h>
+
+#include <farsounder/protobuf/matlab/codec.h>
+#include <farsounder/protobuf/matlab/varint.h>
+#include <farsounder/protobuf/matlab/wire_format.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+// Parses buffer[begin, end) into element of array, a struct array with the
+// struct_field_names of the message.  depth is the nesting depth of the
+// message, 0 for the outermost one.
+typedef void (*ReadFunction)(const uint8_t* buffer, size_t begin, size_t end,
+                             int depth, mxArray* array, size_t element);
+// Returns the serialized size of element of msg, without its tag and
+// length, and appends the sizes of it and all messages nested in it to
+// sizes, in the order the write function needs them.
+typedef size_t (*SizeFunction)(const mxArray* msg, size_t element,
+                               std::vector<size_t>* sizes);
+// Writes element of msg to target.  *next_size points at the entry of sizes
+// for the message and is advanced past those of all messages written.
+typedef uint8_t* (*WriteFunction)(const mxArray* msg, size_t element,
+                                  const size_t** next_size, uint8_t* target);
+
+// A message type of a generated codec.
+struct GeneratedMessage {
+  const char* full_name;
+  // has_field, the fields in the order of their numbers, unknown_fields and
+  // descriptor_function.
+  const char* const* struct_field_names;
+  int struct_field_count;
+  ReadFunction read;
+  SizeFunction size;
+  WriteFunction write;
+};
+
+// The mexFunction of a generated codec, for the given message types:
+//
+//   msg = codec('read', full_name, buffer, buffer_start, buffer_end)
+//     Same as pblib_mex_codec('parse', ...), buffer must be uint8 and the
+//     range is optional.  Unlike it, msg has a descriptor_function.
+//
+//   buffer = codec('write', full_name, msg)
+//     Same as pblib_mex_codec('serialize', msg).
+void RunGeneratedCodec(const GeneratedMessage* messages, size_t message_count,
+                       int nlhs, mxArray* plhs[], int nrhs,
+                       const mxArray* prhs[]);
+
+// ------------------------------------------------------------------
+// Reading
+
+// The position of a length delimited value in the buffer.
+struct Range {
+  size_t begin;
+  size_t end;
+};
+
+// A field the message type doesn't have, kept with its tag.
+struct UnknownField {
+  uint32_t number;
+  int wire_type;
+  size_t begin;
+  size_t end;
+};
+
+// Throws unless a message at the given depth may still be parsed.
+void CheckDepth(int depth);
+
+// Reads the fixed width value of the given size at buffer[position] and
+// returns the position after it.
+inline size_t ReadFixed(const uint8_t* buffer, size_t position, size_t end,
+                        int size, uint64_t* value) {
+  if (end - position < static_cast<size_t>(size)) {
+    throw CodecError("proto:mex:truncated",
+                     "Buffer ends in the middle of a fixed width value.");
+  }
+  *value = ReadLittleEndian(buffer + position, size);
+  return position + size;
+}
+
+// Reads the length of a length delimited value at buffer[position] and
+// returns the position after the value.
+inline size_t ReadLengthDelimited(const uint8_t* buffer, size_t position,
+                                  size_t end, Range* range) {
+  uint64_t length;
+  position = ReadVarint(buffer, position, end, &length);
+  if (end - position < length) {
+    throw CodecError("proto:mex:truncated",
+                     "Buffer ends in the middle of a length delimited "
+                     "value.");
+  }
+  range->begin = position;
+  range->end = position + static_cast<size_t>(length);
+  return range->end;
+}
+
+// Skips the value of the given wire type at buffer[position] and returns
+// the position after it.
+size_t SkipValue(const uint8_t* buffer, size_t position, size_t end,
+                 int wire_type);
+// Skips the value of an unknown field, whose tag starts at tag_begin and
+// ends at position, and adds it to unknown_fields.  Returns the position
+// after the value.
+size_t SkipUnknownField(const uint8_t* buffer, size_t tag_begin,
+                        size_t position, size_t end, uint64_t tag,
+                        std::vector<UnknownField>* unknown_fields);
+
+// Throws for a value of field_name with the wrong wire type, whose tag ends
+// at position.  A value that is malformed itself is reported as such, like
+// pblib_mex_codec does.
+void ThrowWireTypeMismatch(const uint8_t* buffer, size_t position,
+                           size_t end, uint64_t tag, const char* field_name);
+void ThrowPackedTruncated(const char* field_name);
+
+// Reads the packed run at buffer[position] of a field of the given
+// FieldType and appends its values, of the C type of the field's Matlab
+// class, to values.  Returns the position after the run.
+template <typename T>
+size_t ReadPacked(int type, const char* field_name, const uint8_t* buffer,
+                  size_t position, size_t end, std::vector<T>* values) {
+  Range range;
+  position = ReadLengthDelimited(buffer, position, end, &range);
+  const uint8_t* data = buffer + range.begin;
+  size_t size = range.end - range.begin;
+  size_t old_count = values->size();
+  if (IsVarintType(type)) {
+    size_t count = CountVarints(data, size);
+    if (count > 0) {
+      values->resize(old_count + count);
+      DecodeVarints(type, data, size, &(*values)[old_count]);
+    } else if (size > 0) {
+      throw CodecError("proto:mex:truncated",
+                       "Buffer ends in the middle of a varint.");
+    }
+  } else {
+    // Fixed width values are laid out like the elements of a Matlab array.
+    if (size % sizeof(T) != 0) {
+      ThrowPackedTruncated(field_name);
+    }
+    if (size > 0) {
+      values->resize(old_count + size / sizeof(T));
+      memcpy(&(*values)[old_count], data, size);
+    }
+  }
+  return position;
+}
+
+inline float FloatFromBits(uint64_t bits) {
+  uint32_t bits32 = static_cast<uint32_t>(bits);
+  float value;
+  memcpy(&value, &bits32, sizeof(value));
+  return value;
+}
+
+inline double DoubleFromBits(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// ------------------------------------------------------------------
+// Creating the struct
+
+template <typename T>
+mxArray* CreateScalar(mxClassID class_id, T value) {
+  mxArray* array = mxCreateNumericMatrix(1, 1, class_id, mxREAL);
+  *static_cast<T*>(mxGetData(array)) = value;
+  return array;
+}
+
+template <typename T>
+mxArray* CreateRow(mxClassID class_id, const std::vector<T>& values) {
+  mxArray* array = mxCreateNumericMatrix(1, values.size(), class_id, mxREAL);
+  if (!values.empty()) {
+    memcpy(mxGetData(array), &values[0], values.size() * sizeof(T));
+  }
+  return array;
+}
+
+// 1xN cell arrays of the strings or bytes in the ranges.
+mxArray* CreateStringCell(const uint8_t* buffer,
+                          const std::vector<Range>& ranges);
+mxArray* CreateBytesCell(const uint8_t* buffer,
+                         const std::vector<Range>& ranges);
+
+// The default values the descriptors hold.  Empty values, and the values of
+// repeated fields, are 0x0 arrays of the field's class; structs have no
+// fields.
+mxArray* CreateEmpty(mxClassID class_id);
+mxArray* CreateDefaultString(const char* value, size_t size);
+mxArray* CreateDefaultBytes(const char* value, size_t size);
+
+mxArray* CreateUnknownFields(const uint8_t* buffer,
+                             const std::vector<UnknownField>& fields);
+
+// Returns a copy of a handle to the named function.  The handle is created
+// once, on first use, and kept in *cache until the MEX function is cleared.
+mxArray* DuplicateFunctionHandle(const char* name, mxArray** cache);
+
+void WarnRequiredFieldMissing();
+
+// ------------------------------------------------------------------
+// Writing
+
+// Returns field name of element of msg, or NULL if it isn't to be written
+// because it's empty or the entry index of has_field isn't set.
+const mxArray* GetFieldToWrite(const mxArray* msg, size_t element,
+                               const char* name, size_t index);
+void CheckMessageStruct(const mxArray* value, const char* field_name);
+// Returns element index of the cell array of a repeated string or bytes
+// field.
+const mxArray* GetStringCell(const mxArray* value, const char* field_name,
+                             size_t index);
+
+size_t UnknownFieldsSize(const mxArray* msg, size_t element);
+uint8_t* WriteUnknownFields(const mxArray* msg, size_t element,
+                            uint8_t* target);
+
+// Collects the columns with the given names from value, the struct of
+// columns of a field read with repeated_messages=columns, and returns their
+// common length.
+size_t GetColumns(const mxArray* value, const char* field_name,
+                  const char* const* names, size_t count,
+                  const mxArray** columns);
+
+inline uint32_t FloatBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline uint64_t DoubleBits(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
+
+#endif  // FARSOUNDER_PROTOBUF_MATLAB_GENERATED_CODEC_H__
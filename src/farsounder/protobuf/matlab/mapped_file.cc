@@ -0,0 +1,126 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <farsounder/protobuf/matlab/mapped_file.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <farsounder/protobuf/matlab/codec.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+    : data_(NULL), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(NULL) {
+  file_ = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                      OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file_ == INVALID_HANDLE_VALUE) {
+    throw CodecError("proto:mex:cannot_open",
+                     "Cannot open " + filename + " for reading.");
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file_, &size)) {
+    CloseHandle(file_);
+    throw CodecError("proto:mex:cannot_open", "Cannot stat " + filename + ".");
+  }
+  size_ = static_cast<size_t>(size.QuadPart);
+  if (size_ == 0) {
+    return;
+  }
+  mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (mapping_ != NULL) {
+    data_ = static_cast<const uint8_t*>(
+        MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (data_ == NULL) {
+    if (mapping_ != NULL) {
+      CloseHandle(mapping_);
+    }
+    CloseHandle(file_);
+    throw CodecError("proto:mex:cannot_map", "Cannot map " + filename + ".");
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != NULL) {
+    UnmapViewOfFile(data_);
+    CloseHandle(mapping_);
+  }
+  CloseHandle(file_);
+}
+
+#else  // _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+    : data_(NULL), size_(0), fd_(-1) {
+  fd_ = open(filename.c_str(), O_RDONLY);
+  if (fd_ < 0) {
+    throw CodecError("proto:mex:cannot_open",
+                     "Cannot open " + filename + " for reading.");
+  }
+  struct stat info;
+  if (fstat(fd_, &info) != 0) {
+    close(fd_);
+    throw CodecError("proto:mex:cannot_open", "Cannot stat " + filename + ".");
+  }
+  size_ = static_cast<size_t>(info.st_size);
+  if (size_ == 0) {
+    return;
+  }
+  void* data = mmap(NULL, size_, PROT_READ, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    close(fd_);
+    throw CodecError("proto:mex:cannot_map", "Cannot map " + filename + ".");
+  }
+  data_ = static_cast<const uint8_t*>(data);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != NULL) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  close(fd_);
+}
+
+#endif  // _WIN32
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
@@ -0,0 +1,223 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <farsounder/protobuf/matlab/parallel.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#include <new>
+#include <string>
+#include <vector>
+
+#include <farsounder/protobuf/matlab/codec.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+namespace {
+
+// 0 until set, meaning one thread per processor.
+int thread_count = 0;
+
+#ifdef _WIN32
+
+int ProcessorCount() {
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return static_cast<int>(info.dwNumberOfProcessors);
+}
+
+class Mutex {
+ public:
+  Mutex() { InitializeCriticalSection(&section_); }
+  ~Mutex() { DeleteCriticalSection(&section_); }
+  void Lock() { EnterCriticalSection(&section_); }
+  void Unlock() { LeaveCriticalSection(&section_); }
+
+ private:
+  CRITICAL_SECTION section_;
+};
+
+#else  // _WIN32
+
+int ProcessorCount() {
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? static_cast<int>(count) : 1;
+}
+
+class Mutex {
+ public:
+  Mutex() { pthread_mutex_init(&mutex_, NULL); }
+  ~Mutex() { pthread_mutex_destroy(&mutex_); }
+  void Lock() { pthread_mutex_lock(&mutex_); }
+  void Unlock() { pthread_mutex_unlock(&mutex_); }
+
+ private:
+  pthread_mutex_t mutex_;
+};
+
+#endif  // _WIN32
+
+// What the threads of one RunParallel call share: the next piece to hand
+// out and the first error thrown.
+class Run {
+ public:
+  Run(ParallelWork* work, size_t count)
+      : work_(work), count_(count), next_(0), failed_(false),
+        out_of_memory_(false) {}
+
+  // Runs pieces until there are none left or one of them failed.
+  void Work() {
+    while (true) {
+      mutex_.Lock();
+      if (failed_ || next_ == count_) {
+        mutex_.Unlock();
+        return;
+      }
+      size_t index = next_++;
+      mutex_.Unlock();
+      try {
+        work_->Run(index);
+      } catch (const CodecError& e) {
+        Fail(false, e.id(), e.message());
+      } catch (const std::bad_alloc&) {
+        Fail(true, "", "");
+      }
+    }
+  }
+
+  // Rethrows the first error, if any.
+  void Check() const {
+    if (!failed_) return;
+    if (out_of_memory_) throw std::bad_alloc();
+    throw CodecError(id_, message_);
+  }
+
+ private:
+  void Fail(bool out_of_memory, const std::string& id,
+            const std::string& message) {
+    mutex_.Lock();
+    if (!failed_) {
+      failed_ = true;
+      out_of_memory_ = out_of_memory;
+      id_ = id;
+      message_ = message;
+    }
+    mutex_.Unlock();
+  }
+
+  ParallelWork* work_;
+  size_t count_;
+  Mutex mutex_;
+  size_t next_;
+  bool failed_;
+  bool out_of_memory_;
+  std::string id_;
+  std::string message_;
+};
+
+#ifdef _WIN32
+
+DWORD WINAPI ThreadMain(void* run) {
+  static_cast<Run*>(run)->Work();
+  return 0;
+}
+
+// Runs run->Work() on up to extra more threads besides the calling one.
+void RunThreads(Run* run, int extra) {
+  std::vector<HANDLE> threads;
+  for (int i = 0; i < extra; ++i) {
+    HANDLE thread = CreateThread(NULL, 0, ThreadMain, run, 0, NULL);
+    // Fewer threads only make the work slower.
+    if (thread == NULL) break;
+    threads.push_back(thread);
+  }
+  run->Work();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    WaitForSingleObject(threads[i], INFINITE);
+    CloseHandle(threads[i]);
+  }
+}
+
+#else  // _WIN32
+
+extern "C" void* ThreadMain(void* run) {
+  static_cast<Run*>(run)->Work();
+  return NULL;
+}
+
+// Runs run->Work() on up to extra more threads besides the calling one.
+void RunThreads(Run* run, int extra) {
+  std::vector<pthread_t> threads;
+  for (int i = 0; i < extra; ++i) {
+    pthread_t thread;
+    // Fewer threads only make the work slower.
+    if (pthread_create(&thread, NULL, ThreadMain, run) != 0) break;
+    threads.push_back(thread);
+  }
+  run->Work();
+  for (size_t i = 0; i < threads.size(); ++i) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
+#endif  // _WIN32
+
+}  // namespace
+
+int ThreadCount() {
+  return thread_count > 0 ? thread_count : ProcessorCount();
+}
+
+void SetThreadCount(int count) {
+  thread_count = count > 0 ? count : 0;
+}
+
+void RunParallel(ParallelWork* work, size_t count) {
+  size_t threads = ThreadCount();
+  if (threads > count) threads = count;
+  Run run(work, count);
+  if (threads <= 1) {
+    run.Work();
+  } else {
+    RunThreads(&run, static_cast<int>(threads) - 1);
+  }
+  run.Check();
+}
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
@@ -0,0 +1,71 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Runs independent pieces of the codec's work on several threads.  The
+// Matlab API may only be called from the thread Matlab called the MEX
+// function on, so the pieces handed out here must not create or change any
+// mxArray.  Threads are started for each RunParallel call and joined before
+// it returns, nothing is left running between MEX calls.
+
+#ifndef FARSOUNDER_PROTOBUF_MATLAB_PARALLEL_H__
+#define FARSOUNDER_PROTOBUF_MATLAB_PARALLEL_H__
+
+#include <stddef.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+class ParallelWork {
+ public:
+  virtual ~ParallelWork() {}
+
+  // Does piece index of the work.  May run on any thread, at the same time
+  // as other pieces.
+  virtual void Run(size_t index) = 0;
+};
+
+// The number of threads RunParallel uses, by default the number of
+// processors.
+int ThreadCount();
+// Sets the number of threads RunParallel uses, 0 restores the default.
+void SetThreadCount(int count);
+
+// Runs work->Run(0) to work->Run(count - 1) on up to ThreadCount() threads,
+// the calling one included, and returns once all of them are done.  The
+// first CodecError or std::bad_alloc a piece throws is rethrown here, pieces
+// which haven't started by then are skipped.
+void RunParallel(ParallelWork* work, size_t count);
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
+
+#endif  // FARSOUNDER_PROTOBUF_MATLAB_PARALLEL_H__
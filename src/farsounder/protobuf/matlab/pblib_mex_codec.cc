@@ -0,0 +1,852 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// MEX gateway of the native codec.
+//
+//   msg = pblib_mex_codec('parse', buffer, descriptor, buffer_start, buffer_end,
+//                         projection)
+//     Same as pblib_generic_parse_from_string(buffer, descriptor,
+//     buffer_start, buffer_end, false, projection).  buffer must be uint8,
+//     the range and the projection are optional.
+//
+//   buffer = pblib_mex_codec('serialize', msg, descriptor)
+//     Same as pblib_generic_serialize_to_string(msg).  The descriptor is
+//     optional, msg.descriptor_function is used without it.
+//
+//   buffer = pblib_mex_codec('serialize_batch', msgs)
+//     Serializes every message of the struct array msgs into one buffer, each
+//     preceded by its length, as pblib_write_batch(msgs).
+//
+//   values = pblib_mex_codec('parse_packed', buffer, field, buffer_start,
+//                            buffer_end)
+//     Decodes the packed run buffer(buffer_start : buffer_end) of field, an
+//     entry of the fields array of a descriptor, into a row vector.
+//
+//   wire_values = pblib_mex_codec('serialize_packed', values, field)
+//     Encodes values as a packed run of field, without the tag and length.
+//
+//   len = pblib_mex_codec('packed_size', values, field)
+//     The number of bytes serialize_packed would return.
+//
+//   msgs = pblib_mex_codec('parse_file', filename, descriptor, buffer_starts,
+//                          buffer_ends)
+//     Memory maps the file and parses the bytes buffer_starts(i) :
+//     buffer_ends(i) of it, 1 based like the range of 'parse', into msgs{i}.
+//     Only the pages holding the messages are read from disk.
+//
+//   msgs = pblib_mex_codec('parse_batch', source, descriptor_function,
+//                          buffer_starts, buffer_ends)
+//     Parses many messages of the type of descriptor_function into a 1xN
+//     struct array, with descriptor_function set in each.  source is either
+//     a cell array of uint8 buffers, each holding one message, or a uint8
+//     buffer with buffer_starts and buffer_ends giving the range of each
+//     message in it like for 'parse_file'.
+//
+//   columns = pblib_mex_codec('extract_columns', source, descriptor,
+//                             projection, field_indices, buffer_starts,
+//                             buffer_ends)
+//     Parses every message of source with the projection and returns a cell
+//     array with one row per field_indices{i}, a path of 1 based field
+//     indices ending in a singular numeric field, holding its value in each
+//     message.  source is either a cell array of uint8 buffers, each holding
+//     one message, or the name of a file to map, with buffer_starts and
+//     buffer_ends giving the range of each message like for 'parse_file'.
+//
+//   previous = pblib_mex_codec('threads', count)
+//     Sets the number of threads large inputs are parsed on, by default the
+//     number of processors, and returns the number used before.  A count of
+//     0 restores the default, without a count nothing is changed.  'parse',
+//     'parse_file' and 'parse_batch' split a megabyte or more of input over
+//     the threads, the Matlab arrays are always created on the calling
+//     thread.
+//
+//   [ring, position, count] = pblib_mex_codec('ring_open', name)
+//     Maps the shared memory ring name, laid out as described in
+//     ring_buffer.h, and returns a handle to it along with the position and
+//     count of a reader which only sees messages written from now on.  The
+//     ring stays mapped until 'ring_close' or until the MEX function is
+//     cleared.
+//
+//   [msgs, position, count, dropped] = pblib_mex_codec('ring_read', ring,
+//       descriptor_function, position, count, max_count)
+//     Parses up to max_count messages of the type of descriptor_function
+//     from the ring, starting at the reader's position and count, into a
+//     1xN struct array like 'parse_batch'.  The messages go from the shared
+//     memory into the structs without passing through Matlab arrays.
+//     Returns the reader's new position and count and the number of messages
+//     the producer overwrote before they could be read.
+//
+//   pblib_mex_codec('ring_close', ring)
+//     Unmaps a ring opened with 'ring_open' or 'ring_create'.
+//
+//   ring = pblib_mex_codec('ring_create', name, capacity)
+//     Creates the shared memory ring name with a data area of capacity
+//     bytes, replacing any ring of that name, and returns a handle to write
+//     to it, e.g. to feed readers in other Matlab sessions or to test them.
+//
+//   pblib_mex_codec('ring_write', ring, buffer)
+//     Appends the message held by the uint8 buffer to a ring created with
+//     'ring_create', overwriting the oldest messages as needed.
+//
+//   pblib_mex_codec('ring_unlink', name)
+//     Removes the name of a shared memory ring.  Rings already mapped stay
+//     usable until they are closed.
+//
+//   stream = pblib_mex_codec('stream_open', filename, chunk_size,
+//                            queue_depth, advise)
+//     Opens the file and starts reading it on a background thread,
+//     chunk_size bytes at a time, keeping up to queue_depth chunks ready
+//     ahead of 'stream_next'.  Unless advise is false, the operating system
+//     is asked to fetch the following chunks too, where posix_fadvise is
+//     available.  The thread runs until 'stream_close', and until then the
+//     MEX function is locked so that clearing it doesn't unload the thread's
+//     code.
+//
+//   chunk = pblib_mex_codec('stream_next', stream)
+//     Waits for the next chunk of the file and returns it as a uint8 row
+//     vector, which is shorter than chunk_size only at the end of the file
+//     and empty after it.
+//
+//   pblib_mex_codec('stream_close', stream)
+//     Stops reading a file opened with 'stream_open' and closes it.
+//
+// Build it with pblib_build_mex.
+
+#include <string.h>
+#include <map>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <mex.h>
+
+#include <farsounder/protobuf/matlab/codec.h>
+#include <farsounder/protobuf/matlab/mapped_file.h>
+#include <farsounder/protobuf/matlab/parallel.h>
+#include <farsounder/protobuf/matlab/prefetch_reader.h>
+#include <farsounder/protobuf/matlab/ring_buffer.h>
+
+using farsounder::protobuf::matlab::CodecError;
+using farsounder::protobuf::matlab::ColumnExtractor;
+using farsounder::protobuf::matlab::DescriptorPool;
+using farsounder::protobuf::matlab::FieldInfo;
+using farsounder::protobuf::matlab::GetIndex;
+using farsounder::protobuf::matlab::MappedFile;
+using farsounder::protobuf::matlab::MessageBuilder;
+using farsounder::protobuf::matlab::MessageInfo;
+using farsounder::protobuf::matlab::PackedSize;
+using farsounder::protobuf::matlab::ParseBuffers;
+using farsounder::protobuf::matlab::ParsePacked;
+using farsounder::protobuf::matlab::ParseTask;
+using farsounder::protobuf::matlab::Parser;
+using farsounder::protobuf::matlab::PrefetchReader;
+using farsounder::protobuf::matlab::Projection;
+using farsounder::protobuf::matlab::RingBuffer;
+using farsounder::protobuf::matlab::RingCursor;
+using farsounder::protobuf::matlab::RingRecord;
+using farsounder::protobuf::matlab::SerializePacked;
+using farsounder::protobuf::matlab::Serializer;
+using farsounder::protobuf::matlab::SetError;
+using farsounder::protobuf::matlab::SetThreadCount;
+using farsounder::protobuf::matlab::ThreadCount;
+using farsounder::protobuf::matlab::error_id;
+using farsounder::protobuf::matlab::error_message;
+
+namespace {
+
+void CheckArguments(bool condition, const char* usage) {
+  if (!condition) {
+    throw CodecError("proto:mex:usage", std::string("Usage: ") + usage);
+  }
+}
+
+const uint8_t* GetBuffer(const mxArray* buffer) {
+  if (mxGetClassID(buffer) != mxUINT8_CLASS || mxIsComplex(buffer)) {
+    throw CodecError("proto:mex:usage", "buffer must be a uint8 array.");
+  }
+  return static_cast<const uint8_t*>(mxGetData(buffer));
+}
+
+// Converts a 1 based, inclusive Matlab range of buffer into [*begin, *end).
+void GetRange(const mxArray* buffer, const mxArray* start,
+              const mxArray* stop, size_t* begin, size_t* end) {
+  size_t size = mxGetNumberOfElements(buffer);
+  *begin = GetIndex(start);
+  *end = GetIndex(stop);
+  if (*begin == 0 || *end > size || *end + 1 < *begin) {
+    throw CodecError("proto:mex:usage", "Buffer range is out of bounds.");
+  }
+  --*begin;
+}
+
+// Converts a vector of 1 based, inclusive Matlab indices.
+std::vector<size_t> GetIndices(const mxArray* array) {
+  if (!mxIsDouble(array) || mxIsComplex(array)) {
+    throw CodecError("proto:mex:usage", "Buffer indices must be doubles.");
+  }
+  const double* values = mxGetPr(array);
+  std::vector<size_t> indices(mxGetNumberOfElements(array));
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (values[i] < 0 ||
+        values[i] != static_cast<double>(static_cast<size_t>(values[i]))) {
+      throw CodecError("proto:mex:usage",
+                       "Buffer indices must be non-negative integers.");
+    }
+    indices[i] = static_cast<size_t>(values[i]);
+  }
+  return indices;
+}
+
+// Converts 1 based, inclusive Matlab ranges of a buffer of the given size
+// into tasks parsing them as messages of type info.
+std::vector<ParseTask> GetTasks(const MessageInfo& info, size_t size,
+                                const mxArray* starts_array,
+                                const mxArray* ends_array,
+                                const char* usage) {
+  std::vector<size_t> starts = GetIndices(starts_array);
+  std::vector<size_t> ends = GetIndices(ends_array);
+  CheckArguments(starts.size() == ends.size(), usage);
+  std::vector<ParseTask> tasks(starts.size());
+  for (size_t i = 0; i < starts.size(); ++i) {
+    if (starts[i] == 0 || ends[i] > size || ends[i] + 1 < starts[i]) {
+      throw CodecError("proto:mex:usage", "Buffer range is out of bounds.");
+    }
+    ParseTask task = {&info, starts[i] - 1, ends[i], NULL, 0};
+    tasks[i] = task;
+  }
+  return tasks;
+}
+
+void GetField(DescriptorPool* pool, const mxArray* field, FieldInfo* info) {
+  if (!mxIsStruct(field) || mxGetNumberOfElements(field) != 1) {
+    throw CodecError("proto:mex:usage", "field must be a descriptor field.");
+  }
+  pool->LoadField(field, 0, info);
+}
+
+void Parse(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage =
+      "msg = pblib_mex_codec('parse', buffer, descriptor, buffer_start, "
+      "buffer_end, projection)";
+  CheckArguments(nrhs == 2 || nrhs == 4 || nrhs == 5, usage);
+  CheckArguments(nlhs <= 1, usage);
+  const mxArray* buffer = prhs[0];
+  const uint8_t* data = GetBuffer(buffer);
+  size_t size = mxGetNumberOfElements(buffer);
+  size_t begin = 0;
+  size_t end = size;
+  if (nrhs >= 4) {
+    GetRange(buffer, prhs[2], prhs[3], &begin, &end);
+  }
+
+  DescriptorPool pool;
+  const MessageInfo* info = pool.FindMessage(prhs[1]);
+  Parser parser(data, size);
+  size_t index;
+  if (nrhs == 5) {
+    // Only needed while parsing.
+    Projection projection(prhs[4], *info);
+    index = parser.Parse(*info, begin, end, &projection);
+  } else {
+    index = parser.Parse(*info, begin, end);
+  }
+  MessageBuilder builder(parser);
+  plhs[0] = builder.Build(index);
+}
+
+void Serialize(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage =
+      "buffer = pblib_mex_codec('serialize', msg, descriptor)";
+  CheckArguments((nrhs == 1 || nrhs == 2) && nlhs <= 1, usage);
+  DescriptorPool pool;
+  Serializer serializer(&pool);
+  if (nrhs == 2) {
+    plhs[0] = serializer.Serialize(*pool.FindMessage(prhs[1]), prhs[0]);
+  } else {
+    plhs[0] = serializer.Serialize(prhs[0]);
+  }
+}
+
+void SerializeBatch(int nlhs, mxArray* plhs[], int nrhs,
+                    const mxArray* prhs[]) {
+  const char* usage = "buffer = pblib_mex_codec('serialize_batch', msgs)";
+  CheckArguments(nrhs == 1 && nlhs <= 1, usage);
+  DescriptorPool pool;
+  Serializer serializer(&pool);
+  plhs[0] = serializer.SerializeDelimited(prhs[0]);
+}
+
+void ParsePackedField(int nlhs, mxArray* plhs[], int nrhs,
+                      const mxArray* prhs[]) {
+  const char* usage =
+      "values = pblib_mex_codec('parse_packed', buffer, field, buffer_start, "
+      "buffer_end)";
+  CheckArguments(nrhs == 4 && nlhs <= 1, usage);
+  const uint8_t* data = GetBuffer(prhs[0]);
+  size_t begin;
+  size_t end;
+  GetRange(prhs[0], prhs[2], prhs[3], &begin, &end);
+  DescriptorPool pool;
+  FieldInfo field;
+  GetField(&pool, prhs[1], &field);
+  plhs[0] = ParsePacked(field, data, begin, end);
+}
+
+void SerializePackedField(int nlhs, mxArray* plhs[], int nrhs,
+                          const mxArray* prhs[]) {
+  const char* usage =
+      "wire_values = pblib_mex_codec('serialize_packed', values, field)";
+  CheckArguments(nrhs == 2 && nlhs <= 1, usage);
+  DescriptorPool pool;
+  FieldInfo field;
+  GetField(&pool, prhs[1], &field);
+  plhs[0] = SerializePacked(field, prhs[0]);
+}
+
+void PackedFieldSize(int nlhs, mxArray* plhs[], int nrhs,
+                     const mxArray* prhs[]) {
+  const char* usage = "len = pblib_mex_codec('packed_size', values, field)";
+  CheckArguments(nrhs == 2 && nlhs <= 1, usage);
+  DescriptorPool pool;
+  FieldInfo field;
+  GetField(&pool, prhs[1], &field);
+  plhs[0] = mxCreateDoubleScalar(
+      static_cast<double>(PackedSize(field, prhs[0])));
+}
+
+void ParseFile(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage =
+      "msgs = pblib_mex_codec('parse_file', filename, descriptor, "
+      "buffer_starts, buffer_ends)";
+  CheckArguments(nrhs == 4 && nlhs <= 1 && mxIsChar(prhs[0]), usage);
+
+  char* filename_chars = mxArrayToString(prhs[0]);
+  std::string filename(filename_chars);
+  mxFree(filename_chars);
+  MappedFile file(filename);
+
+  DescriptorPool pool;
+  const MessageInfo* info = pool.FindMessage(prhs[1]);
+  std::vector<ParseTask> tasks =
+      GetTasks(*info, file.size(), prhs[2], prhs[3], usage);
+  Parser parser(file.data(), file.size());
+  parser.ParseAll(&tasks);
+  MessageBuilder builder(parser);
+  plhs[0] = mxCreateCellMatrix(1, tasks.size());
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    mxSetCell(plhs[0], i, builder.Build(tasks[i].index));
+  }
+}
+
+void ParseBatch(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage =
+      "msgs = pblib_mex_codec('parse_batch', source, descriptor_function, "
+      "buffer_starts, buffer_ends)";
+  CheckArguments(nlhs <= 1 && nrhs >= 2, usage);
+  bool from_cell = mxIsCell(prhs[0]);
+  CheckArguments(from_cell ? nrhs == 2 : nrhs == 4, usage);
+
+  // The descriptors are loaded once for the whole batch.
+  DescriptorPool pool;
+  const MessageInfo* info = pool.FindMessageByFunction(prhs[1]);
+  const char** names = const_cast<const char**>(&info->struct_field_names[0]);
+  int name_count = static_cast<int>(info->struct_field_names.size());
+  mxArray* msgs;
+  if (from_cell) {
+    // Every buffer gets a parser of its own, and all of them are scanned,
+    // possibly in parallel, before any struct is created.
+    size_t count = mxGetNumberOfElements(prhs[0]);
+    std::vector<Parser> parsers;
+    parsers.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      const mxArray* buffer = mxGetCell(prhs[0], i);
+      CheckArguments(buffer != NULL, usage);
+      parsers.push_back(
+          Parser(GetBuffer(buffer), mxGetNumberOfElements(buffer)));
+    }
+    std::vector<Parser*> parser_pointers(count);
+    for (size_t i = 0; i < count; ++i) {
+      parser_pointers[i] = &parsers[i];
+    }
+    std::vector<size_t> indices;
+    ParseBuffers(*info, parser_pointers, &indices);
+    msgs = mxCreateStructMatrix(1, count, name_count, names);
+    for (size_t i = 0; i < count; ++i) {
+      MessageBuilder builder(parsers[i]);
+      builder.BuildElement(msgs, i, indices[i]);
+    }
+  } else {
+    const uint8_t* data = GetBuffer(prhs[0]);
+    size_t size = mxGetNumberOfElements(prhs[0]);
+    std::vector<ParseTask> tasks =
+        GetTasks(*info, size, prhs[2], prhs[3], usage);
+    // All messages are scanned before any struct is created, so that a
+    // malformed message fails the batch before most of the work is done.
+    Parser parser(data, size);
+    parser.ParseAll(&tasks);
+    msgs = mxCreateStructMatrix(1, tasks.size(), name_count, names);
+    MessageBuilder builder(parser);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      builder.BuildElement(msgs, i, tasks[i].index);
+    }
+  }
+  plhs[0] = msgs;
+}
+
+void ExtractColumns(int nlhs, mxArray* plhs[], int nrhs,
+                    const mxArray* prhs[]) {
+  const char* usage =
+      "columns = pblib_mex_codec('extract_columns', source, descriptor, "
+      "projection, field_indices, buffer_starts, buffer_ends)";
+  CheckArguments(nlhs <= 1 && nrhs >= 4 && mxIsCell(prhs[3]), usage);
+  bool from_file = mxIsChar(prhs[0]);
+  CheckArguments(from_file ? nrhs == 6 : (nrhs == 4 && mxIsCell(prhs[0])),
+                 usage);
+
+  std::vector<std::vector<int> > paths(mxGetNumberOfElements(prhs[3]));
+  for (size_t i = 0; i < paths.size(); ++i) {
+    const mxArray* path = mxGetCell(prhs[3], i);
+    CheckArguments(path != NULL && mxIsDouble(path), usage);
+    std::vector<size_t> indices = GetIndices(path);
+    for (size_t j = 0; j < indices.size(); ++j) {
+      paths[i].push_back(static_cast<int>(indices[j]) - 1);
+    }
+  }
+
+  DescriptorPool pool;
+  const MessageInfo* info = pool.FindMessage(prhs[1]);
+  Projection projection(prhs[2], *info);
+  if (from_file) {
+    std::vector<size_t> starts = GetIndices(prhs[4]);
+    std::vector<size_t> ends = GetIndices(prhs[5]);
+    CheckArguments(starts.size() == ends.size(), usage);
+    char* filename_chars = mxArrayToString(prhs[0]);
+    std::string filename(filename_chars);
+    mxFree(filename_chars);
+    MappedFile file(filename);
+    ColumnExtractor extractor(*info, paths, starts.size());
+    for (size_t i = 0; i < starts.size(); ++i) {
+      if (starts[i] == 0 || ends[i] > file.size() || ends[i] + 1 < starts[i]) {
+        throw CodecError("proto:mex:usage", "Buffer range is out of bounds.");
+      }
+      extractor.Extract(file.data(), file.size(), starts[i] - 1, ends[i],
+                        &projection, i);
+    }
+    plhs[0] = extractor.Release();
+  } else {
+    size_t count = mxGetNumberOfElements(prhs[0]);
+    ColumnExtractor extractor(*info, paths, count);
+    for (size_t i = 0; i < count; ++i) {
+      const mxArray* buffer = mxGetCell(prhs[0], i);
+      CheckArguments(buffer != NULL, usage);
+      size_t size = mxGetNumberOfElements(buffer);
+      extractor.Extract(GetBuffer(buffer), size, 0, size, &projection, i);
+    }
+    plhs[0] = extractor.Release();
+  }
+}
+
+void Threads(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage = "previous = pblib_mex_codec('threads', count)";
+  CheckArguments(nrhs <= 1 && nlhs <= 1, usage);
+  int previous = ThreadCount();
+  if (nrhs == 1) {
+    CheckArguments(mxIsNumeric(prhs[0]) &&
+                   mxGetNumberOfElements(prhs[0]) == 1, usage);
+    double count = mxGetScalar(prhs[0]);
+    if (count < 0 || count > 1024 || count != static_cast<int>(count)) {
+      throw CodecError("proto:mex:usage",
+                       "The thread count must be an integer from 0 to "
+                       "1024.");
+    }
+    SetThreadCount(static_cast<int>(count));
+  }
+  plhs[0] = mxCreateDoubleScalar(previous);
+}
+
+// Matlab keeps only the function last passed to mexAtExit, so a single one
+// closes the rings and the streams.  It is registered on their first use.
+void RegisterCloseAll();
+
+// Rings opened with 'ring_open' or 'ring_create', by handle.
+std::map<int, RingBuffer*> rings;
+int next_ring_handle = 1;
+
+void CloseRings() {
+  for (std::map<int, RingBuffer*>::iterator it = rings.begin();
+       it != rings.end(); ++it) {
+    delete it->second;
+  }
+  rings.clear();
+}
+
+std::map<int, RingBuffer*>::iterator GetRing(const mxArray* ring) {
+  std::map<int, RingBuffer*>::iterator it = rings.end();
+  if (mxIsDouble(ring) && mxGetNumberOfElements(ring) == 1) {
+    it = rings.find(static_cast<int>(mxGetScalar(ring)));
+  }
+  if (it == rings.end()) {
+    throw CodecError("proto:mex:ring_not_open", "The ring is not open.");
+  }
+  return it;
+}
+
+// Converts a ring position or message count, which Matlab holds as a double.
+uint64_t GetCounter(const mxArray* array) {
+  if (!mxIsDouble(array) || mxGetNumberOfElements(array) != 1) {
+    throw CodecError("proto:mex:usage",
+                     "Ring positions and counts must be scalar doubles.");
+  }
+  double value = mxGetScalar(array);
+  if (value < 0 || value >= 9007199254740992.0 ||
+      value != static_cast<double>(static_cast<uint64_t>(value))) {
+    throw CodecError("proto:mex:usage",
+                     "Ring positions and counts must be non-negative "
+                     "integers.");
+  }
+  return static_cast<uint64_t>(value);
+}
+
+// The number of leading records the producer has overwritten since they
+// were found.
+size_t CountOverwritten(const RingBuffer& ring,
+                        const std::vector<RingRecord>& records) {
+  size_t count = 0;
+  while (count < records.size() &&
+         ring.Overwritten(records[count].position)) {
+    ++count;
+  }
+  return count;
+}
+
+std::string GetRingName(const mxArray* array) {
+  char* name_chars = mxArrayToString(array);
+  std::string name(name_chars);
+  mxFree(name_chars);
+  return name;
+}
+
+void RingOpen(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage =
+      "[ring, position, count] = pblib_mex_codec('ring_open', name)";
+  CheckArguments(nrhs == 1 && nlhs <= 3 && mxIsChar(prhs[0]), usage);
+  std::string name = GetRingName(prhs[0]);
+
+  RingBuffer* ring = new RingBuffer;
+  std::string error;
+  if (!ring->Open(name, &error)) {
+    delete ring;
+    throw CodecError("proto:mex:cannot_open", error);
+  }
+  RingCursor cursor;
+  if (!ring->End(&cursor, &error)) {
+    delete ring;
+    throw CodecError("proto:mex:ring_corrupt", error);
+  }
+  RegisterCloseAll();
+  int handle = next_ring_handle++;
+  rings[handle] = ring;
+  plhs[0] = mxCreateDoubleScalar(handle);
+  if (nlhs > 1) {
+    plhs[1] = mxCreateDoubleScalar(static_cast<double>(cursor.position));
+  }
+  if (nlhs > 2) {
+    plhs[2] = mxCreateDoubleScalar(static_cast<double>(cursor.count));
+  }
+}
+
+void RingRead(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage =
+      "[msgs, position, count, dropped] = pblib_mex_codec('ring_read', ring, "
+      "descriptor_function, position, count, max_count)";
+  CheckArguments(nrhs == 5 && nlhs <= 4, usage);
+  const RingBuffer& ring = *GetRing(prhs[0])->second;
+  DescriptorPool pool;
+  const MessageInfo* info = pool.FindMessageByFunction(prhs[1]);
+  const char** names = const_cast<const char**>(&info->struct_field_names[0]);
+  int name_count = static_cast<int>(info->struct_field_names.size());
+  RingCursor cursor = {GetCounter(prhs[2]), GetCounter(prhs[3])};
+  size_t max_count = GetIndex(prhs[4]);
+
+  std::vector<RingRecord> records;
+  uint64_t dropped = 0;
+  std::string error;
+  if (!ring.Next(&cursor, max_count, &records, &dropped, &error)) {
+    throw CodecError("proto:mex:ring_corrupt", error);
+  }
+  // The producer may overwrite messages at any time, and the parser reads
+  // its input more than once, so the messages are copied out of the ring
+  // before they are parsed.  Those overwritten before the copy was complete
+  // are dropped.
+  std::vector<uint8_t> bytes;
+  std::vector<size_t> offsets(records.size() + 1, 0);
+  for (size_t i = 0; i < records.size(); ++i) {
+    offsets[i + 1] = offsets[i] + records[i].end - records[i].begin;
+  }
+  bytes.resize(offsets.back());
+  for (size_t i = 0; i < records.size(); ++i) {
+    if (offsets[i + 1] > offsets[i]) {
+      memcpy(&bytes[offsets[i]], ring.data() + records[i].begin,
+             offsets[i + 1] - offsets[i]);
+    }
+  }
+  size_t overwritten = CountOverwritten(ring, records);
+  dropped += overwritten;
+  std::vector<ParseTask> tasks(records.size() - overwritten);
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    ParseTask task = {info, offsets[overwritten + i],
+                      offsets[overwritten + i + 1], NULL, 0};
+    tasks[i] = task;
+  }
+  Parser parser(bytes.empty() ? NULL : &bytes[0], bytes.size());
+  parser.ParseAll(&tasks);
+  mxArray* msgs = mxCreateStructMatrix(1, tasks.size(), name_count, names);
+  MessageBuilder builder(parser);
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    builder.BuildElement(msgs, i, tasks[i].index);
+  }
+  plhs[0] = msgs;
+  if (nlhs > 1) {
+    plhs[1] = mxCreateDoubleScalar(static_cast<double>(cursor.position));
+  }
+  if (nlhs > 2) {
+    plhs[2] = mxCreateDoubleScalar(static_cast<double>(cursor.count));
+  }
+  if (nlhs > 3) {
+    plhs[3] = mxCreateDoubleScalar(static_cast<double>(dropped));
+  }
+}
+
+void RingClose(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage = "pblib_mex_codec('ring_close', ring)";
+  CheckArguments(nrhs == 1 && nlhs == 0, usage);
+  std::map<int, RingBuffer*>::iterator it = GetRing(prhs[0]);
+  delete it->second;
+  rings.erase(it);
+}
+
+void RingCreate(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage = "ring = pblib_mex_codec('ring_create', name, capacity)";
+  CheckArguments(nrhs == 2 && nlhs <= 1 && mxIsChar(prhs[0]), usage);
+  std::string name = GetRingName(prhs[0]);
+  size_t capacity = GetIndex(prhs[1]);
+
+  RingBuffer* ring = new RingBuffer;
+  std::string error;
+  if (!ring->Create(name, capacity, &error)) {
+    delete ring;
+    throw CodecError("proto:mex:cannot_open", error);
+  }
+  RegisterCloseAll();
+  int handle = next_ring_handle++;
+  rings[handle] = ring;
+  plhs[0] = mxCreateDoubleScalar(handle);
+}
+
+void RingWrite(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage = "pblib_mex_codec('ring_write', ring, buffer)";
+  CheckArguments(nrhs == 2 && nlhs == 0, usage);
+  RingBuffer* ring = GetRing(prhs[0])->second;
+  const uint8_t* buffer = GetBuffer(prhs[1]);
+  if (!ring->Write(buffer, mxGetNumberOfElements(prhs[1]))) {
+    throw CodecError("proto:mex:usage",
+                     "The ring wasn't created with 'ring_create' or the "
+                     "message doesn't fit in it.");
+  }
+}
+
+void RingUnlink(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage = "pblib_mex_codec('ring_unlink', name)";
+  CheckArguments(nrhs == 1 && nlhs == 0 && mxIsChar(prhs[0]), usage);
+  std::string error;
+  if (!RingBuffer::Unlink(GetRingName(prhs[0]), &error)) {
+    throw CodecError("proto:mex:cannot_open", error);
+  }
+}
+
+// Files opened with 'stream_open', by handle.
+std::map<int, PrefetchReader*> streams;
+int next_stream_handle = 1;
+// The chunk last returned by 'stream_next', kept so that its storage is
+// reused for later chunks.
+std::vector<uint8_t> stream_chunk;
+
+void CloseStreams() {
+  for (std::map<int, PrefetchReader*>::iterator it = streams.begin();
+       it != streams.end(); ++it) {
+    delete it->second;
+  }
+  streams.clear();
+}
+
+void CloseAll() {
+  CloseRings();
+  CloseStreams();
+}
+
+bool close_all_registered = false;
+
+void RegisterCloseAll() {
+  if (!close_all_registered) {
+    mexAtExit(CloseAll);
+    close_all_registered = true;
+  }
+}
+
+std::map<int, PrefetchReader*>::iterator GetStream(const mxArray* stream) {
+  std::map<int, PrefetchReader*>::iterator it = streams.end();
+  if (mxIsDouble(stream) && mxGetNumberOfElements(stream) == 1) {
+    it = streams.find(static_cast<int>(mxGetScalar(stream)));
+  }
+  if (it == streams.end()) {
+    throw CodecError("proto:mex:stream_not_open", "The stream is not open.");
+  }
+  return it;
+}
+
+void StreamOpen(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage =
+      "stream = pblib_mex_codec('stream_open', filename, chunk_size, "
+      "queue_depth, advise)";
+  CheckArguments((nrhs == 3 || nrhs == 4) && nlhs <= 1 &&
+                 mxIsChar(prhs[0]), usage);
+  char* filename_chars = mxArrayToString(prhs[0]);
+  std::string filename(filename_chars);
+  mxFree(filename_chars);
+  size_t chunk_size = GetIndex(prhs[1]);
+  size_t queue_depth = GetIndex(prhs[2]);
+  bool advise = true;
+  if (nrhs == 4) {
+    CheckArguments(mxGetNumberOfElements(prhs[3]) == 1 &&
+                   (mxIsLogical(prhs[3]) || mxIsNumeric(prhs[3])), usage);
+    advise = mxGetScalar(prhs[3]) != 0;
+  }
+
+  PrefetchReader* stream =
+      new PrefetchReader(filename, chunk_size, queue_depth, advise);
+  RegisterCloseAll();
+  int handle = next_stream_handle++;
+  try {
+    streams[handle] = stream;
+  } catch (...) {
+    delete stream;
+    throw;
+  }
+  // Clearing the MEX function would unload the code the thread runs, so it
+  // stays loaded while any stream is open.
+  mexLock();
+  plhs[0] = mxCreateDoubleScalar(handle);
+}
+
+void StreamNext(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  const char* usage = "chunk = pblib_mex_codec('stream_next', stream)";
+  CheckArguments(nrhs == 1 && nlhs <= 1, usage);
+  GetStream(prhs[0])->second->Next(&stream_chunk);
+  plhs[0] = mxCreateNumericMatrix(1, stream_chunk.size(), mxUINT8_CLASS,
+                                  mxREAL);
+  if (!stream_chunk.empty()) {
+    memcpy(mxGetData(plhs[0]), &stream_chunk[0], stream_chunk.size());
+  }
+}
+
+void StreamClose(int nlhs, mxArray* plhs[], int nrhs,
+                 const mxArray* prhs[]) {
+  const char* usage = "pblib_mex_codec('stream_close', stream)";
+  CheckArguments(nrhs == 1 && nlhs == 0, usage);
+  std::map<int, PrefetchReader*>::iterator it = GetStream(prhs[0]);
+  delete it->second;
+  streams.erase(it);
+  mexUnlock();
+}
+
+}  // namespace
+
+void mexFunction(int nlhs, mxArray* plhs[], int nrhs, const mxArray* prhs[]) {
+  bool failed = false;
+  try {
+    if (nrhs < 1 || !mxIsChar(prhs[0])) {
+      throw CodecError("proto:mex:usage",
+                       "The first argument must be a command.");
+    }
+    char* command_chars = mxArrayToString(prhs[0]);
+    std::string command(command_chars);
+    mxFree(command_chars);
+    if (command == "parse") {
+      Parse(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "serialize") {
+      Serialize(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "serialize_batch") {
+      SerializeBatch(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "parse_packed") {
+      ParsePackedField(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "serialize_packed") {
+      SerializePackedField(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "packed_size") {
+      PackedFieldSize(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "parse_file") {
+      ParseFile(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "parse_batch") {
+      ParseBatch(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "extract_columns") {
+      ExtractColumns(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "threads") {
+      Threads(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "ring_open") {
+      RingOpen(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "ring_read") {
+      RingRead(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "ring_close") {
+      RingClose(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "ring_create") {
+      RingCreate(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "ring_write") {
+      RingWrite(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "ring_unlink") {
+      RingUnlink(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "stream_open") {
+      StreamOpen(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "stream_next") {
+      StreamNext(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else if (command == "stream_close") {
+      StreamClose(nlhs, plhs, nrhs - 1, prhs + 1);
+    } else {
+      throw CodecError("proto:mex:usage", "Unknown command " + command + ".");
+    }
+  } catch (const CodecError& e) {
+    SetError(e.id(), e.message());
+    failed = true;
+  } catch (const std::bad_alloc&) {
+    SetError("proto:mex:out_of_memory", "Out of memory.");
+    failed = true;
+  }
+  if (failed) {
+    mexErrMsgIdAndTxt(error_id, "%s", error_message);
+  }
+}
@@ -0,0 +1,355 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <farsounder/protobuf/matlab/prefetch_reader.h>
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#endif
+
+#include <deque>
+#include <new>
+
+#include <farsounder/protobuf/matlab/codec.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+struct PrefetchState {
+  PrefetchState(const std::string& filename, FILE* file, size_t chunk_size,
+                size_t queue_depth, bool advise);
+  ~PrefetchState();
+
+  void Lock();
+  void Unlock();
+  // Wait with the lock held until the other thread signals.
+  void WaitNotEmpty();
+  void WaitNotFull();
+  void SignalNotEmpty();
+  void SignalNotFull();
+  // Starts Read on a new thread, returns false if it couldn't be started.
+  bool Start();
+  void Join();
+
+  // Body of the background thread.
+  void Read();
+  // Asks the operating system to fetch size bytes from offset on in the
+  // background.
+  void Advise(uint64_t offset, uint64_t size);
+
+  const std::string filename;
+  FILE* const file;
+  const size_t chunk_size;
+  const size_t queue_depth;
+  const bool advise;
+
+  // Guarded by the lock.
+  std::deque<std::vector<uint8_t> > queue;
+  // Storage of chunks already taken, for reuse.
+  std::vector<std::vector<uint8_t> > spare;
+  bool done;
+  bool stop;
+  std::string error;
+  // Set instead of letting std::bad_alloc escape the thread, which would end
+  // Matlab.  Next throws it on the calling thread.
+  bool out_of_memory;
+
+#ifdef _WIN32
+  CRITICAL_SECTION section;
+  CONDITION_VARIABLE not_empty;
+  CONDITION_VARIABLE not_full;
+  HANDLE thread;
+#else
+  pthread_mutex_t mutex;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+  pthread_t thread;
+#endif
+};
+
+namespace {
+
+#ifdef _WIN32
+
+DWORD WINAPI PrefetchThreadMain(void* state) {
+  static_cast<PrefetchState*>(state)->Read();
+  return 0;
+}
+
+#else  // _WIN32
+
+extern "C" void* PrefetchThreadMain(void* state) {
+  static_cast<PrefetchState*>(state)->Read();
+  return NULL;
+}
+
+#endif  // _WIN32
+
+}  // namespace
+
+#ifdef _WIN32
+
+PrefetchState::PrefetchState(const std::string& filename, FILE* file,
+                             size_t chunk_size, size_t queue_depth,
+                             bool advise)
+    : filename(filename), file(file), chunk_size(chunk_size),
+      queue_depth(queue_depth), advise(advise), done(false), stop(false),
+      out_of_memory(false), thread(NULL) {
+  InitializeCriticalSection(&section);
+  InitializeConditionVariable(&not_empty);
+  InitializeConditionVariable(&not_full);
+}
+
+PrefetchState::~PrefetchState() {
+  DeleteCriticalSection(&section);
+  fclose(file);
+}
+
+void PrefetchState::Lock() { EnterCriticalSection(&section); }
+void PrefetchState::Unlock() { LeaveCriticalSection(&section); }
+void PrefetchState::WaitNotEmpty() {
+  SleepConditionVariableCS(&not_empty, &section, INFINITE);
+}
+void PrefetchState::WaitNotFull() {
+  SleepConditionVariableCS(&not_full, &section, INFINITE);
+}
+void PrefetchState::SignalNotEmpty() { WakeConditionVariable(&not_empty); }
+void PrefetchState::SignalNotFull() { WakeConditionVariable(&not_full); }
+
+bool PrefetchState::Start() {
+  thread = CreateThread(NULL, 0, PrefetchThreadMain, this, 0, NULL);
+  return thread != NULL;
+}
+
+void PrefetchState::Join() {
+  WaitForSingleObject(thread, INFINITE);
+  CloseHandle(thread);
+}
+
+void PrefetchState::Advise(uint64_t offset, uint64_t size) {
+}
+
+#else  // _WIN32
+
+PrefetchState::PrefetchState(const std::string& filename, FILE* file,
+                             size_t chunk_size, size_t queue_depth,
+                             bool advise)
+    : filename(filename), file(file), chunk_size(chunk_size),
+      queue_depth(queue_depth), advise(advise), done(false), stop(false),
+      out_of_memory(false) {
+  pthread_mutex_init(&mutex, NULL);
+  pthread_cond_init(&not_empty, NULL);
+  pthread_cond_init(&not_full, NULL);
+}
+
+PrefetchState::~PrefetchState() {
+  pthread_cond_destroy(&not_full);
+  pthread_cond_destroy(&not_empty);
+  pthread_mutex_destroy(&mutex);
+  fclose(file);
+}
+
+void PrefetchState::Lock() { pthread_mutex_lock(&mutex); }
+void PrefetchState::Unlock() { pthread_mutex_unlock(&mutex); }
+void PrefetchState::WaitNotEmpty() { pthread_cond_wait(&not_empty, &mutex); }
+void PrefetchState::WaitNotFull() { pthread_cond_wait(&not_full, &mutex); }
+void PrefetchState::SignalNotEmpty() { pthread_cond_signal(&not_empty); }
+void PrefetchState::SignalNotFull() { pthread_cond_signal(&not_full); }
+
+bool PrefetchState::Start() {
+  return pthread_create(&thread, NULL, PrefetchThreadMain, this) == 0;
+}
+
+void PrefetchState::Join() {
+  pthread_join(thread, NULL);
+}
+
+void PrefetchState::Advise(uint64_t offset, uint64_t size) {
+#ifdef POSIX_FADV_WILLNEED
+  posix_fadvise(fileno(file), static_cast<off_t>(offset),
+                static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+#endif
+}
+
+#endif  // _WIN32
+
+void PrefetchState::Read() {
+#ifdef POSIX_FADV_SEQUENTIAL
+  if (advise) {
+    // Makes the kernel's own readahead window larger.
+    posix_fadvise(fileno(file), 0, 0, POSIX_FADV_SEQUENTIAL);
+  }
+#endif
+  uint64_t offset = 0;
+  bool finished = false;
+  while (!finished) {
+    std::vector<uint8_t> chunk;
+    Lock();
+    while (!stop && queue.size() >= queue_depth) {
+      WaitNotFull();
+    }
+    if (stop) {
+      Unlock();
+      return;
+    }
+    if (!spare.empty()) {
+      chunk.swap(spare.back());
+      spare.pop_back();
+    }
+    Unlock();
+
+    bool allocated = true;
+    try {
+      chunk.resize(chunk_size);
+    } catch (const std::bad_alloc&) {
+      allocated = false;
+    }
+    size_t count = 0;
+    if (allocated) {
+      count = fread(&chunk[0], 1, chunk_size, file);
+      chunk.resize(count);
+    }
+    offset += count;
+    finished = !allocated || count < chunk_size;
+    if (advise && !finished) {
+      // The chunks after the queue, so they are on their way once there is
+      // room for them.
+      Advise(offset, static_cast<uint64_t>(chunk_size) * queue_depth);
+    }
+
+    Lock();
+    if (!allocated) {
+      out_of_memory = true;
+    } else if (finished && ferror(file)) {
+      error = "Cannot read " + filename + ".";
+    }
+    if (count > 0) {
+      try {
+        queue.push_back(std::vector<uint8_t>());
+        queue.back().swap(chunk);
+      } catch (const std::bad_alloc&) {
+        out_of_memory = true;
+        finished = true;
+      }
+    }
+    done = finished;
+    SignalNotEmpty();
+    Unlock();
+  }
+}
+
+PrefetchReader::PrefetchReader(const std::string& filename,
+                               size_t chunk_size, size_t queue_depth,
+                               bool advise)
+    : state_(NULL) {
+  if (chunk_size == 0 || queue_depth == 0) {
+    throw CodecError("proto:mex:usage",
+                     "The chunk size and queue depth must be positive.");
+  }
+  // At most queue_depth chunks are queued, one is being read and one is held
+  // by the caller, so with room for that many spare chunks Next never
+  // allocates.  The first chunk is allocated here too, so that a chunk size
+  // too large for memory fails on the calling thread.
+  std::vector<uint8_t> first_chunk;
+  std::vector<std::vector<uint8_t> > spare;
+  if (chunk_size > first_chunk.max_size() ||
+      queue_depth > spare.max_size() - 2) {
+    throw CodecError("proto:mex:usage",
+                     "The chunk size or queue depth is too large.");
+  }
+  first_chunk.reserve(chunk_size);
+  spare.reserve(queue_depth + 2);
+  spare.push_back(std::vector<uint8_t>());
+  spare.back().swap(first_chunk);
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == NULL) {
+    throw CodecError("proto:mex:cannot_open",
+                     "Cannot open " + filename + " for reading.");
+  }
+  // Every read is a whole chunk, buffering would only add a copy.
+  setvbuf(file, NULL, _IONBF, 0);
+  state_ = new PrefetchState(filename, file, chunk_size, queue_depth, advise);
+  state_->spare.swap(spare);
+  if (!state_->Start()) {
+    delete state_;
+    throw CodecError("proto:mex:thread",
+                     "Cannot start a thread to read " + filename + ".");
+  }
+}
+
+PrefetchReader::~PrefetchReader() {
+  state_->Lock();
+  state_->stop = true;
+  state_->SignalNotFull();
+  state_->Unlock();
+  state_->Join();
+  delete state_;
+}
+
+void PrefetchReader::Next(std::vector<uint8_t>* chunk) {
+  state_->Lock();
+  while (state_->queue.empty() && !state_->done) {
+    state_->WaitNotEmpty();
+  }
+  if (state_->queue.empty()) {
+    std::string error = state_->error;
+    bool out_of_memory = state_->out_of_memory;
+    state_->Unlock();
+    if (out_of_memory) {
+      throw std::bad_alloc();
+    }
+    if (!error.empty()) {
+      throw CodecError("proto:mex:cannot_read", error);
+    }
+    chunk->clear();
+    return;
+  }
+  std::vector<uint8_t>& front = state_->queue.front();
+  chunk->swap(front);
+  // front now holds the old storage of *chunk.
+  if (front.capacity() > 0) {
+    state_->spare.push_back(std::vector<uint8_t>());
+    state_->spare.back().swap(front);
+  }
+  state_->queue.pop_front();
+  state_->SignalNotFull();
+  state_->Unlock();
+}
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
@@ -0,0 +1,85 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Sequential reading of a file on a background thread, so that reading the
+// next chunks overlaps with decoding the current one.  Unlike the threads of
+// RunParallel, the thread keeps running between MEX calls until the reader
+// is destroyed.  It never touches the Matlab API, the chunks it reads are
+// handed over on the calling thread.
+
+#ifndef FARSOUNDER_PROTOBUF_MATLAB_PREFETCH_READER_H__
+#define FARSOUNDER_PROTOBUF_MATLAB_PREFETCH_READER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+// The file, the queue and the thread shared by a PrefetchReader.
+struct PrefetchState;
+
+class PrefetchReader {
+ public:
+  // Opens the named file and starts reading it chunk_size bytes at a time,
+  // keeping up to queue_depth chunks ready ahead of Next.  With advise, the
+  // operating system is told that the file is read sequentially and asked to
+  // fetch the bytes after the queued chunks in the background too, where
+  // posix_fadvise is available.  Throws a CodecError if the file can't be
+  // opened, or std::bad_alloc if not even one chunk fits in memory.
+  PrefetchReader(const std::string& filename, size_t chunk_size,
+                 size_t queue_depth, bool advise);
+  // Stops the thread, dropping any chunks not taken yet, and closes the
+  // file.
+  ~PrefetchReader();
+
+  // Waits for the next chunk and swaps it into *chunk, whose old storage is
+  // reused for a later chunk.  Every chunk but the last one of the file is
+  // chunk_size bytes long, *chunk is empty once the whole file has been
+  // returned.  Throws a CodecError if reading the file failed, or
+  // std::bad_alloc if the thread ran out of memory for a chunk.
+  void Next(std::vector<uint8_t>* chunk);
+
+ private:
+  PrefetchState* state_;
+
+  // Not copyable.
+  PrefetchReader(const PrefetchReader&);
+  PrefetchReader& operator=(const PrefetchReader&);
+};
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
+
+#endif  // FARSOUNDER_PROTOBUF_MATLAB_PREFETCH_READER_H__
@@ -0,0 +1,350 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <farsounder/protobuf/matlab/ring_buffer.h>
+
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+// The header as laid out in ring_buffer.h.
+struct RingHeader {
+  char magic[8];
+  volatile uint64_t capacity;
+  volatile uint64_t sequence;
+  volatile uint64_t write_position;
+  volatile uint64_t reserve_position;
+  volatile uint64_t last_position;
+  volatile uint64_t message_count;
+  uint64_t reserved[9];
+};
+
+namespace {
+
+const char kMagic[8] = {'P', 'B', 'R', 'I', 'N', 'G', '1', '\0'};
+const uint32_t kWrapMarker = 0xFFFFFFFFu;
+// Snapshot gives up after this many attempts, which only happens if the
+// producer died while publishing a message.
+const int kMaxSnapshotAttempts = 1 << 20;
+const char kTornSnapshot[] =
+    "The ring's producer stopped while publishing a message.";
+
+inline void Barrier() {
+#ifdef _WIN32
+  MemoryBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+inline uint64_t Padded(uint64_t size) {
+  return (size + 3) & ~static_cast<uint64_t>(3);
+}
+
+}  // namespace
+
+RingBuffer::RingBuffer()
+    : header_(NULL), data_(NULL), capacity_(0), mapped_size_(0),
+      writable_(false) {
+}
+
+RingBuffer::~RingBuffer() {
+  Close();
+}
+
+#ifdef _WIN32
+
+bool RingBuffer::Create(const std::string& name, size_t capacity,
+                        std::string* error) {
+  *error = "Shared memory rings are only supported on POSIX systems.";
+  return false;
+}
+
+bool RingBuffer::Open(const std::string& name, std::string* error) {
+  *error = "Shared memory rings are only supported on POSIX systems.";
+  return false;
+}
+
+void RingBuffer::Close() {
+}
+
+bool RingBuffer::Unlink(const std::string& name, std::string* error) {
+  *error = "Shared memory rings are only supported on POSIX systems.";
+  return false;
+}
+
+#else  // _WIN32
+
+bool RingBuffer::Create(const std::string& name, size_t capacity,
+                        std::string* error) {
+  Close();
+  capacity = static_cast<size_t>(Padded(capacity));
+  if (capacity < 8) {
+    *error = "The capacity of a ring must be at least 8 bytes.";
+    return false;
+  }
+  // Readers still attached to a previous ring of the same name keep it until
+  // they close it.
+  shm_unlink(name.c_str());
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) {
+    *error = "Cannot create shared memory " + name + ": " + strerror(errno);
+    return false;
+  }
+  size_t size = kHeaderSize + capacity;
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+    *error = "Cannot resize shared memory " + name + ": " + strerror(errno);
+    close(fd);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  void* mapping = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    *error = "Cannot map shared memory " + name + ": " + strerror(errno);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  header_ = static_cast<RingHeader*>(mapping);
+  data_ = static_cast<uint8_t*>(mapping) + kHeaderSize;
+  capacity_ = capacity;
+  mapped_size_ = size;
+  writable_ = true;
+  // ftruncate zeroed everything, the magic is written last so that readers
+  // never see a ring without its capacity.
+  header_->capacity = capacity;
+  Barrier();
+  memcpy(header_->magic, kMagic, sizeof(kMagic));
+  return true;
+}
+
+bool RingBuffer::Open(const std::string& name, std::string* error) {
+  Close();
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) {
+    *error = "Cannot open shared memory " + name + ": " + strerror(errno);
+    return false;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    *error = "Cannot stat shared memory " + name + ": " + strerror(errno);
+    close(fd);
+    return false;
+  }
+  size_t size = static_cast<size_t>(info.st_size);
+  if (size <= kHeaderSize) {
+    *error = "Shared memory " + name + " is not a ring.";
+    close(fd);
+    return false;
+  }
+  void* mapping = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    *error = "Cannot map shared memory " + name + ": " + strerror(errno);
+    return false;
+  }
+  RingHeader* header = static_cast<RingHeader*>(mapping);
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+      header->capacity != size - kHeaderSize || header->capacity % 4 != 0) {
+    *error = "Shared memory " + name + " is not a ring.";
+    munmap(mapping, size);
+    return false;
+  }
+  header_ = header;
+  data_ = static_cast<uint8_t*>(mapping) + kHeaderSize;
+  capacity_ = size - kHeaderSize;
+  mapped_size_ = size;
+  writable_ = false;
+  return true;
+}
+
+void RingBuffer::Close() {
+  if (header_ != NULL) {
+    munmap(header_, mapped_size_);
+  }
+  header_ = NULL;
+  data_ = NULL;
+  capacity_ = 0;
+  mapped_size_ = 0;
+  writable_ = false;
+}
+
+bool RingBuffer::Unlink(const std::string& name, std::string* error) {
+  if (shm_unlink(name.c_str()) != 0) {
+    *error = "Cannot remove shared memory " + name + ": " + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+#endif  // _WIN32
+
+bool RingBuffer::Write(const uint8_t* message, size_t size) {
+  uint64_t padded = Padded(size);
+  if (!writable_ || size >= kWrapMarker || padded + 4 > capacity_) {
+    return false;
+  }
+  uint64_t position = header_->write_position;
+  size_t offset = static_cast<size_t>(position % capacity_);
+  uint64_t start = position;
+  if (offset + 4 + padded > capacity_) {
+    start = position - offset + capacity_;
+  }
+  uint64_t end = start + 4 + padded;
+  header_->reserve_position = end;
+  Barrier();
+  if (start != position) {
+    memcpy(data_ + offset, &kWrapMarker, 4);
+  }
+  uint8_t* record = data_ + static_cast<size_t>(start % capacity_);
+  uint32_t prefix = static_cast<uint32_t>(size);
+  memcpy(record, &prefix, 4);
+  memcpy(record + 4, message, size);
+  Barrier();
+  uint64_t sequence = header_->sequence;
+  header_->sequence = sequence + 1;
+  Barrier();
+  header_->write_position = end;
+  header_->last_position = start;
+  header_->message_count = header_->message_count + 1;
+  Barrier();
+  header_->sequence = sequence + 2;
+  return true;
+}
+
+bool RingBuffer::Snapshot(uint64_t* write_position, uint64_t* last_position,
+                          uint64_t* message_count) const {
+  for (int attempt = 0; attempt < kMaxSnapshotAttempts; ++attempt) {
+    uint64_t sequence = header_->sequence;
+    Barrier();
+    *write_position = header_->write_position;
+    *last_position = header_->last_position;
+    *message_count = header_->message_count;
+    Barrier();
+    if (sequence % 2 == 0 && header_->sequence == sequence) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RingBuffer::End(RingCursor* cursor, std::string* error) const {
+  uint64_t last_position;
+  if (!Snapshot(&cursor->position, &last_position, &cursor->count)) {
+    *error = kTornSnapshot;
+    return false;
+  }
+  return true;
+}
+
+bool RingBuffer::Next(RingCursor* cursor, size_t max_count,
+                      std::vector<RingRecord>* records, uint64_t* dropped,
+                      std::string* error) const {
+  uint64_t write_position;
+  uint64_t last_position;
+  uint64_t message_count;
+  if (!Snapshot(&write_position, &last_position, &message_count)) {
+    *error = kTornSnapshot;
+    return false;
+  }
+  if (cursor->position > write_position || cursor->count > message_count) {
+    *error = "The reader is ahead of the ring's producer.";
+    return false;
+  }
+  bool lapped = Overwritten(cursor->position);
+  size_t found = 0;
+  while (found < max_count) {
+    if (lapped) {
+      // Skip to the newest message, or past it if even that one is being
+      // overwritten.
+      if (!Snapshot(&write_position, &last_position, &message_count)) {
+        *error = kTornSnapshot;
+        return false;
+      }
+      *dropped += message_count - 1 - cursor->count;
+      cursor->position = last_position;
+      cursor->count = message_count - 1;
+      if (Overwritten(last_position)) {
+        ++*dropped;
+        cursor->position = write_position;
+        cursor->count = message_count;
+      }
+      lapped = false;
+    }
+    if (cursor->position >= write_position) {
+      break;
+    }
+    size_t offset = static_cast<size_t>(cursor->position % capacity_);
+    uint32_t size;
+    memcpy(&size, const_cast<const uint8_t*>(data_) + offset, 4);
+    if (size == kWrapMarker) {
+      cursor->position += capacity_ - offset;
+      continue;
+    }
+    uint64_t padded = Padded(size);
+    if (offset + 4 + padded > capacity_ ||
+        cursor->position + 4 + padded > write_position) {
+      // A torn size is only expected if the producer overwrote it.
+      lapped = Overwritten(cursor->position);
+      if (!lapped) {
+        *error = "The ring holds a message which doesn't fit in it.";
+        return false;
+      }
+      continue;
+    }
+    RingRecord record = {cursor->position, offset + 4, offset + 4 + size};
+    records->push_back(record);
+    ++found;
+    cursor->position += 4 + padded;
+    ++cursor->count;
+  }
+  return true;
+}
+
+bool RingBuffer::Overwritten(uint64_t position) const {
+  Barrier();
+  return header_->reserve_position > position + capacity_;
+}
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
@@ -0,0 +1,160 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Ring buffer in POSIX shared memory through which a producer process, e.g.
+// a live acquisition program, hands messages to Matlab without going through
+// files.  The producer never waits for readers: it overwrites the oldest
+// messages, and every reader keeps its own position and notices when it has
+// been lapped.  This file doesn't depend on Matlab, so producers can be built
+// from it alone.
+//
+// The shared memory object, named like "/pings", starts with a 128 byte
+// header of 64 bit unsigned integers in the byte order of the machine:
+//
+//   offset  0  magic, the 8 characters "PBRING1\0"
+//   offset  8  capacity, the size of the data area in bytes, a multiple of 4
+//   offset 16  sequence, odd while the producer updates the fields below
+//   offset 24  write_position, where the next message will be written
+//   offset 32  reserve_position, the end of the bytes written so far
+//   offset 40  last_position, the position of the newest message
+//   offset 48  message_count, the number of messages ever written
+//
+// The rest of the header is zero.  The data area follows it.  Positions count
+// bytes from the creation of the ring and never wrap, position p lives at
+// byte p % capacity of the data area.  Each message is written at a multiple
+// of 4 as its size, a uint32 in machine byte order, followed by its bytes and
+// padded to a multiple of 4.  A message never wraps around the end of the
+// data area: if it doesn't fit before the end, the size 0xFFFFFFFF is written
+// instead and the message starts at the beginning of the data area.
+//
+// To write a message the producer first advances reserve_position past it,
+// then writes its bytes, and finally publishes it by making sequence odd,
+// updating write_position, last_position and message_count and making
+// sequence even again, with memory barriers between the steps.  Everything
+// before write_position can be read, and the byte at position p is intact as
+// long as reserve_position <= p + capacity.
+
+#ifndef FARSOUNDER_PROTOBUF_MATLAB_RING_BUFFER_H__
+#define FARSOUNDER_PROTOBUF_MATLAB_RING_BUFFER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+struct RingHeader;
+
+// A message found by RingBuffer::Next.
+struct RingRecord {
+  uint64_t position;
+  // The message bytes are data()[begin, end).
+  size_t begin;
+  size_t end;
+};
+
+// A reader's place in the ring: the position of the next message and the
+// number of messages written before it.
+struct RingCursor {
+  uint64_t position;
+  uint64_t count;
+};
+
+class RingBuffer {
+ public:
+  static const size_t kHeaderSize = 128;
+
+  RingBuffer();
+  ~RingBuffer();
+
+  // Creates the named shared memory object with a data area of capacity
+  // bytes, rounded up to a multiple of 4, for a producer to write to.  An
+  // existing object of the same name is replaced.  Returns false with a
+  // description in *error on failure.
+  bool Create(const std::string& name, size_t capacity, std::string* error);
+  // Maps an existing ring read only, for reading.
+  bool Open(const std::string& name, std::string* error);
+  // Unmaps the ring.  Close, or destroying the RingBuffer, leaves the shared
+  // memory object alone, Unlink removes its name.
+  void Close();
+  static bool Unlink(const std::string& name, std::string* error);
+
+  bool is_open() const { return header_ != NULL; }
+  size_t capacity() const { return capacity_; }
+  const uint8_t* data() const { return data_; }
+
+  // Appends a message, overwriting the oldest ones as needed.  Returns false
+  // if the ring isn't open for writing or the message is too large to fit.
+  bool Write(const uint8_t* message, size_t size);
+
+  // Sets *cursor just past the newest message, where a reader starts to only
+  // see messages written from now on.  Returns false with a description in
+  // *error if the producer stopped while publishing a message.
+  bool End(RingCursor* cursor, std::string* error) const;
+  // Appends the ranges of up to max_count messages at *cursor to records
+  // and advances the cursor past them.  If the producer has overwritten the
+  // message at the cursor, reading skips to the newest message instead and
+  // the number of messages skipped is added to *dropped.  Returns false with
+  // a description in *error if the ring holds something other than messages
+  // or the producer stopped while publishing one.
+  bool Next(RingCursor* cursor, size_t max_count,
+            std::vector<RingRecord>* records, uint64_t* dropped,
+            std::string* error) const;
+  // Whether the message at position may have been overwritten since its
+  // range was returned by Next.  Messages read from the ring are only known
+  // to be intact if this is false after they have been read.
+  bool Overwritten(uint64_t position) const;
+
+ private:
+  // Reads write_position, last_position and message_count as of the same
+  // message.  Returns false if they keep changing under it, which means the
+  // producer stopped half way through publishing a message.
+  bool Snapshot(uint64_t* write_position, uint64_t* last_position,
+                uint64_t* message_count) const;
+
+  RingHeader* header_;
+  uint8_t* data_;
+  size_t capacity_;
+  size_t mapped_size_;
+  bool writable_;
+
+  // Not copyable.
+  RingBuffer(const RingBuffer&);
+  RingBuffer& operator=(const RingBuffer&);
+};
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
+
+#endif  // FARSOUNDER_PROTOBUF_MATLAB_RING_BUFFER_H__
@@ -0,0 +1,137 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Reference producer of a shared memory ring, see ring_buffer.h.  It copies
+// the messages of a length delimited file, as written by
+// pblib_delimited_writer_write or the C++ and Java writeDelimitedTo, into a
+// newly created ring, optionally pausing between them to stand in for a live
+// source.  The ring is left in place when it exits.
+//
+//   ring_producer name capacity [filename [interval_ms [repeat]]]
+//
+// Reads standard input if filename is missing or "-".  Build it in this
+// directory with e.g.
+//
+//   g++ -O2 -I ../../.. ring_producer.cc ring_buffer.cc -lrt -o ring_producer
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include <farsounder/protobuf/matlab/ring_buffer.h>
+
+using farsounder::protobuf::matlab::RingBuffer;
+
+namespace {
+
+// Reads a varint from file into *value.  Returns false at the end of the
+// file, exits if it ends in the middle of the varint.
+bool ReadVarint(FILE* file, uint64_t* value) {
+  *value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = getc(file);
+    if (byte == EOF) {
+      if (shift == 0) {
+        return false;
+      }
+      fprintf(stderr, "The input ends in the middle of a message length.\n");
+      exit(1);
+    }
+    *value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (byte < 0x80) {
+      return true;
+    }
+  }
+  fprintf(stderr, "A message length is longer than 10 bytes.\n");
+  exit(1);
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  if (argc < 3 || argc > 6) {
+    fprintf(stderr, "Usage: %s name capacity [filename [interval_ms "
+            "[repeat]]]\n", argv[0]);
+    return 2;
+  }
+  std::string name = argv[1];
+  size_t capacity = static_cast<size_t>(strtoul(argv[2], NULL, 10));
+  bool from_stdin = argc < 4 || strcmp(argv[3], "-") == 0;
+  int interval_ms = argc > 4 ? atoi(argv[4]) : 0;
+  int repeat = argc > 5 ? atoi(argv[5]) : 1;
+
+  // The messages are read up front so that repeats and the pauses between
+  // messages aren't slowed down by the input.
+  FILE* file = from_stdin ? stdin : fopen(argv[3], "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Cannot open %s for reading.\n", argv[3]);
+    return 1;
+  }
+  std::vector<std::vector<uint8_t> > messages;
+  uint64_t size;
+  while (ReadVarint(file, &size)) {
+    messages.push_back(std::vector<uint8_t>(static_cast<size_t>(size)));
+    if (size > 0 &&
+        fread(&messages.back()[0], 1, messages.back().size(), file) != size) {
+      fprintf(stderr, "The input ends in the middle of a message.\n");
+      return 1;
+    }
+  }
+  if (!from_stdin) {
+    fclose(file);
+  }
+
+  RingBuffer ring;
+  std::string error;
+  if (!ring.Create(name, capacity, &error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  static const uint8_t kEmpty = 0;
+  for (int i = 0; i < repeat; ++i) {
+    for (size_t j = 0; j < messages.size(); ++j) {
+      const uint8_t* data = messages[j].empty() ? &kEmpty : &messages[j][0];
+      if (!ring.Write(data, messages[j].size())) {
+        fprintf(stderr, "Message %lu doesn't fit in the ring.\n",
+                static_cast<unsigned long>(j));
+        return 1;
+      }
+      if (interval_ms > 0) {
+        usleep(static_cast<useconds_t>(interval_ms) * 1000);
+      }
+    }
+  }
+  printf("Wrote %lu messages to %s.\n",
+         static_cast<unsigned long>(messages.size() * repeat), name.c_str());
+  return 0;
+}
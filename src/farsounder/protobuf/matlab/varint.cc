@@ -0,0 +1,514 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include <farsounder/protobuf/matlab/varint.h>
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FARSOUNDER_VARINT_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#define FARSOUNDER_VARINT_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__BMI2__)
+#define FARSOUNDER_VARINT_BMI2 1
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <farsounder/protobuf/matlab/codec.h>
+
+// The word at a time code below assumes a little endian host, which all
+// platforms Matlab runs on are.
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+namespace {
+
+const uint64_t kContinuationBits = 0x8080808080808080ULL;
+const uint64_t kPayloadBits = 0x7F7F7F7F7F7F7F7FULL;
+
+inline int CountTrailingZeros(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanForward64(&index, value);
+  return static_cast<int>(index);
+#elif defined(_MSC_VER)
+  unsigned long index;
+  if (_BitScanForward(&index, static_cast<uint32_t>(value))) {
+    return static_cast<int>(index);
+  }
+  _BitScanForward(&index, static_cast<uint32_t>(value >> 32));
+  return static_cast<int>(index) + 32;
+#else
+  return __builtin_ctzll(value);
+#endif
+}
+
+inline int CountLeadingZeros(uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return 63 - static_cast<int>(index);
+#elif defined(_MSC_VER)
+  unsigned long index;
+  if (_BitScanReverse(&index, static_cast<uint32_t>(value >> 32))) {
+    return 31 - static_cast<int>(index);
+  }
+  _BitScanReverse(&index, static_cast<uint32_t>(value));
+  return 63 - static_cast<int>(index);
+#else
+  return __builtin_clzll(value);
+#endif
+}
+
+inline int PopCount(uint32_t value) {
+#if defined(_MSC_VER)
+  value = value - ((value >> 1) & 0x55555555);
+  value = (value & 0x33333333) + ((value >> 2) & 0x33333333);
+  return static_cast<int>((((value + (value >> 4)) & 0x0F0F0F0F) *
+                           0x01010101) >> 24);
+#else
+  return __builtin_popcount(value);
+#endif
+}
+
+inline uint64_t LoadWord(const uint8_t* buffer) {
+  uint64_t word;
+  memcpy(&word, buffer, sizeof(word));
+  return word;
+}
+
+// Packs the low 7 bits of each byte of value into one integer.
+inline uint64_t CompactPayload(uint64_t value) {
+#ifdef FARSOUNDER_VARINT_BMI2
+  return _pext_u64(value, kPayloadBits);
+#else
+  value &= kPayloadBits;
+  value = ((value & 0x7F007F007F007F00ULL) >> 1) |
+          (value & 0x007F007F007F007FULL);
+  value = ((value & 0x3FFF00003FFF0000ULL) >> 2) |
+          (value & 0x00003FFF00003FFFULL);
+  value = ((value & 0x0FFFFFFF00000000ULL) >> 4) |
+          (value & 0x000000000FFFFFFFULL);
+  return value;
+#endif
+}
+
+// The reverse of CompactPayload for values below 2^56.
+inline uint64_t SpreadPayload(uint64_t value) {
+#ifdef FARSOUNDER_VARINT_BMI2
+  return _pdep_u64(value, kPayloadBits);
+#else
+  value = ((value & 0x00FFFFFFF0000000ULL) << 4) |
+          (value & 0x000000000FFFFFFFULL);
+  value = ((value & 0x0FFFC0000FFFC000ULL) << 2) |
+          (value & 0x00003FFF00003FFFULL);
+  value = ((value & 0x3F803F803F803F80ULL) << 1) |
+          (value & 0x007F007F007F007FULL);
+  return value;
+#endif
+}
+
+// Decodes one varint byte by byte, for the end of a buffer and for varints
+// longer than 8 bytes.
+const uint8_t* DecodeSlow(const uint8_t* position, const uint8_t* end,
+                          uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 70; shift += 7) {
+    if (position == end) {
+      throw CodecError("proto:mex:truncated",
+                       "Packed field ends in the middle of a varint.");
+    }
+    uint8_t byte = *position++;
+    result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if (byte < 0x80) {
+      *value = result;
+      return position;
+    }
+  }
+  throw CodecError("proto:mex:malformed", "Varint is longer than 10 bytes.");
+}
+
+inline uint32_t ZigZagEncode32(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^
+         static_cast<uint32_t>(value >> 31);
+}
+
+inline uint64_t ZigZagEncode64(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+// Conversions between wire values and Matlab values for each varint type.
+// Wire is the narrowest type holding every wire value of the type.
+struct Int32Traits {
+  typedef int32_t Value;
+  typedef uint32_t Wire;
+  static Value FromWire(uint64_t wire) {
+    return static_cast<int32_t>(static_cast<uint32_t>(wire));
+  }
+  static Wire ToWire(Value value) { return static_cast<uint32_t>(value); }
+};
+
+struct SInt32Traits {
+  typedef int32_t Value;
+  typedef uint32_t Wire;
+  static Value FromWire(uint64_t wire) {
+    uint32_t value = static_cast<uint32_t>(wire);
+    return static_cast<int32_t>((value >> 1) ^ (0U - (value & 1)));
+  }
+  static Wire ToWire(Value value) { return ZigZagEncode32(value); }
+};
+
+struct UInt32Traits {
+  typedef uint32_t Value;
+  typedef uint32_t Wire;
+  static Value FromWire(uint64_t wire) { return static_cast<uint32_t>(wire); }
+  static Wire ToWire(Value value) { return value; }
+};
+
+struct Int64Traits {
+  typedef int64_t Value;
+  typedef uint64_t Wire;
+  static Value FromWire(uint64_t wire) { return static_cast<int64_t>(wire); }
+  static Wire ToWire(Value value) { return static_cast<uint64_t>(value); }
+};
+
+struct SInt64Traits {
+  typedef int64_t Value;
+  typedef uint64_t Wire;
+  static Value FromWire(uint64_t wire) {
+    return static_cast<int64_t>((wire >> 1) ^ (0ULL - (wire & 1)));
+  }
+  static Wire ToWire(Value value) { return ZigZagEncode64(value); }
+};
+
+struct UInt64Traits {
+  typedef uint64_t Value;
+  typedef uint64_t Wire;
+  static Value FromWire(uint64_t wire) { return wire; }
+  static Wire ToWire(Value value) { return value; }
+};
+
+// Returns the bit mask of the bytes in buffer[0, 16) with the continuation
+// bit set.
+inline uint32_t ContinuationMask16(const uint8_t* buffer) {
+#ifdef FARSOUNDER_VARINT_SSE2
+  return static_cast<uint32_t>(_mm_movemask_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(buffer))));
+#else
+  uint64_t low = LoadWord(buffer) & kContinuationBits;
+  uint64_t high = LoadWord(buffer + 8) & kContinuationBits;
+  // Gather the top bit of every byte into the low 8 bits.
+  uint32_t mask = static_cast<uint32_t>((low * 0x02040810204081ULL) >> 56);
+  mask |= static_cast<uint32_t>((high * 0x02040810204081ULL) >> 56) << 8;
+  return mask;
+#endif
+}
+
+template <typename Traits>
+size_t DecodeRun(const uint8_t* position, const uint8_t* end,
+                 typename Traits::Value* values) {
+  typename Traits::Value* const first = values;
+  // Every load below stays within 24 bytes of position.
+  while (end - position >= 24) {
+#ifdef FARSOUNDER_VARINT_AVX2
+    if (end - position >= 32 &&
+        _mm256_movemask_epi8(_mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(position))) == 0) {
+      for (int i = 0; i < 32; ++i) {
+        values[i] = Traits::FromWire(position[i]);
+      }
+      values += 32;
+      position += 32;
+      continue;
+    }
+#endif
+    uint32_t continuation = ContinuationMask16(position);
+    if (continuation == 0) {
+      for (int i = 0; i < 16; ++i) {
+        values[i] = Traits::FromWire(position[i]);
+      }
+      values += 16;
+      position += 16;
+      continue;
+    }
+
+    // Decode every varint ending in this block of 16 bytes.
+    uint32_t ends = ~continuation & 0xFFFF;
+    if (ends == 0) {
+      throw CodecError("proto:mex:malformed",
+                       "Varint is longer than 10 bytes.");
+    }
+    int begin = 0;
+    while (ends != 0) {
+      int last = CountTrailingZeros(ends);
+      ends &= ends - 1;
+      int length = last - begin + 1;
+      if (length > 8) {
+        uint64_t value;
+        DecodeSlow(position + begin, end, &value);
+        *values++ = Traits::FromWire(value);
+      } else {
+        uint64_t word = LoadWord(position + begin) &
+            (~0ULL >> (64 - 8 * length));
+        *values++ = Traits::FromWire(CompactPayload(word));
+      }
+      begin = last + 1;
+    }
+    position += begin;
+  }
+  while (position < end) {
+    uint64_t value;
+    position = DecodeSlow(position, end, &value);
+    *values++ = Traits::FromWire(value);
+  }
+  return values - first;
+}
+
+inline size_t WireSize(uint32_t wire) {
+  // Written as comparisons so the compiler can vectorize loops over it.
+  return 1 + (wire >= (1U << 7)) + (wire >= (1U << 14)) +
+         (wire >= (1U << 21)) + (wire >= (1U << 28));
+}
+
+inline size_t WireSize(uint64_t wire) {
+  // Same as ceil(bits / 7) for bits = floor(log2(wire | 1)) + 1.
+  int log2 = 63 - CountLeadingZeros(wire | 1);
+  return static_cast<size_t>((log2 * 9 + 73) / 64);
+}
+
+template <typename Traits>
+size_t SizeRun(const typename Traits::Value* values, size_t count) {
+  size_t size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    size += WireSize(Traits::ToWire(values[i]));
+  }
+  return size;
+}
+
+// Writes one varint of at most 8 bytes as a single 8 byte store.  target
+// must have room for 8 bytes even if the varint is shorter.
+inline uint8_t* EncodeWord(uint64_t wire, uint8_t* target) {
+  // Spread the 7 bit groups over the bytes and set the continuation bit of
+  // all but the last one.
+  size_t size = WireSize(wire);
+  uint64_t word = SpreadPayload(wire) |
+      (kContinuationBits & ((1ULL << (8 * (size - 1))) - 1));
+  memcpy(target, &word, sizeof(word));
+  return target + size;
+}
+
+uint8_t* EncodeSlow(uint64_t wire, uint8_t* target) {
+  while (wire >= 0x80) {
+    *target++ = static_cast<uint8_t>(wire | 0x80);
+    wire >>= 7;
+  }
+  *target++ = static_cast<uint8_t>(wire);
+  return target;
+}
+
+template <typename Traits>
+uint8_t* EncodeRun(const typename Traits::Value* values, size_t count,
+                   uint8_t* target) {
+  size_t i = 0;
+  // While 24 or more values are left, every value is followed by at least 8
+  // more bytes, so EncodeWord can't write past the end of target.
+  while (count - i >= 24) {
+    // Blocks of values which are all single byte varints are narrowed in
+    // one go.
+    typename Traits::Wire any = 0;
+    for (int j = 0; j < 16; ++j) {
+      any |= Traits::ToWire(values[i + j]);
+    }
+    if (any < 0x80) {
+      for (int j = 0; j < 16; ++j) {
+        target[j] = static_cast<uint8_t>(Traits::ToWire(values[i + j]));
+      }
+      target += 16;
+      i += 16;
+      continue;
+    }
+    for (size_t end = i + 16; i < end; ++i) {
+      uint64_t wire = Traits::ToWire(values[i]);
+      if (wire < (1ULL << 56)) {
+        target = EncodeWord(wire, target);
+      } else {
+        target = EncodeSlow(wire, target);
+      }
+    }
+  }
+  for (; i < count; ++i) {
+    target = EncodeSlow(Traits::ToWire(values[i]), target);
+  }
+  return target;
+}
+
+void UnsupportedType(int type) {
+  (void) type;
+  throw CodecError("proto:mex:usage", "Type is not encoded as varints.");
+}
+
+}  // namespace
+
+bool IsVarintType(int type) {
+  switch (type) {
+    case TYPE_INT32:
+    case TYPE_INT64:
+    case TYPE_UINT32:
+    case TYPE_UINT64:
+    case TYPE_SINT32:
+    case TYPE_SINT64:
+    case TYPE_BOOL:
+    case TYPE_ENUM:
+      return true;
+    default:
+      return false;
+  }
+}
+
+size_t CountVarints(const uint8_t* buffer, size_t size) {
+  size_t count = 0;
+  size_t i = 0;
+#ifdef FARSOUNDER_VARINT_AVX2
+  for (; i + 32 <= size; i += 32) {
+    uint32_t continuation = static_cast<uint32_t>(_mm256_movemask_epi8(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(buffer + i))));
+    count += 32 - PopCount(continuation);
+  }
+#endif
+#ifdef FARSOUNDER_VARINT_SSE2
+  for (; i + 16 <= size; i += 16) {
+    count += 16 - PopCount(ContinuationMask16(buffer + i));
+  }
+#endif
+  for (; i < size; ++i) {
+    count += buffer[i] < 0x80;
+  }
+  return count;
+}
+
+size_t DecodeVarints(int type, const uint8_t* buffer, size_t size,
+                     void* values) {
+  const uint8_t* end = buffer + size;
+  switch (type) {
+    case TYPE_INT32:
+    case TYPE_ENUM:
+      return DecodeRun<Int32Traits>(buffer, end,
+                                    static_cast<int32_t*>(values));
+    case TYPE_SINT32:
+      return DecodeRun<SInt32Traits>(buffer, end,
+                                     static_cast<int32_t*>(values));
+    case TYPE_UINT32:
+    case TYPE_BOOL:
+      return DecodeRun<UInt32Traits>(buffer, end,
+                                     static_cast<uint32_t*>(values));
+    case TYPE_INT64:
+      return DecodeRun<Int64Traits>(buffer, end,
+                                    static_cast<int64_t*>(values));
+    case TYPE_SINT64:
+      return DecodeRun<SInt64Traits>(buffer, end,
+                                     static_cast<int64_t*>(values));
+    case TYPE_UINT64:
+      return DecodeRun<UInt64Traits>(buffer, end,
+                                     static_cast<uint64_t*>(values));
+    default:
+      UnsupportedType(type);
+      return 0;
+  }
+}
+
+size_t VarintsSize(int type, const void* values, size_t count) {
+  switch (type) {
+    case TYPE_INT32:
+    case TYPE_ENUM:
+      return SizeRun<Int32Traits>(static_cast<const int32_t*>(values), count);
+    case TYPE_SINT32:
+      return SizeRun<SInt32Traits>(static_cast<const int32_t*>(values),
+                                   count);
+    case TYPE_UINT32:
+    case TYPE_BOOL:
+      return SizeRun<UInt32Traits>(static_cast<const uint32_t*>(values),
+                                   count);
+    case TYPE_INT64:
+      return SizeRun<Int64Traits>(static_cast<const int64_t*>(values), count);
+    case TYPE_SINT64:
+      return SizeRun<SInt64Traits>(static_cast<const int64_t*>(values),
+                                   count);
+    case TYPE_UINT64:
+      return SizeRun<UInt64Traits>(static_cast<const uint64_t*>(values),
+                                   count);
+    default:
+      UnsupportedType(type);
+      return 0;
+  }
+}
+
+uint8_t* EncodeVarints(int type, const void* values, size_t count,
+                       uint8_t* target) {
+  switch (type) {
+    case TYPE_INT32:
+    case TYPE_ENUM:
+      return EncodeRun<Int32Traits>(static_cast<const int32_t*>(values),
+                                    count, target);
+    case TYPE_SINT32:
+      return EncodeRun<SInt32Traits>(static_cast<const int32_t*>(values),
+                                     count, target);
+    case TYPE_UINT32:
+    case TYPE_BOOL:
+      return EncodeRun<UInt32Traits>(static_cast<const uint32_t*>(values),
+                                     count, target);
+    case TYPE_INT64:
+      return EncodeRun<Int64Traits>(static_cast<const int64_t*>(values),
+                                    count, target);
+    case TYPE_SINT64:
+      return EncodeRun<SInt64Traits>(static_cast<const int64_t*>(values),
+                                     count, target);
+    case TYPE_UINT64:
+      return EncodeRun<UInt64Traits>(static_cast<const uint64_t*>(values),
+                                     count, target);
+    default:
+      UnsupportedType(type);
+      return target;
+  }
+}
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
@@ -0,0 +1,84 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// Bulk decoding and encoding of packed varint fields.
+//
+// The decoder finds varint boundaries from the continuation bits of a whole
+// block of bytes at a time rather than testing byte by byte.  Blocks made up
+// of single byte varints, which is what most index and count arrays contain,
+// are recognized 16 or 32 bytes at a time with SSE2 or AVX2 and widened
+// directly into the output.  In other blocks every varint is extracted from
+// a single unaligned 8 byte load, with BMI2's pext where available.  The
+// encoder does the reverse with pdep.  Without those instruction sets,
+// portable code is used which gives the same results.
+//
+// Values are converted the way the read_function and write_function of the
+// field type do it, including the ZigZag encoding of sint32 and sint64, and
+// are read from and written to arrays of the Matlab class of the field type
+// (int32, int64, uint32 or uint64).
+
+#ifndef FARSOUNDER_PROTOBUF_MATLAB_VARINT_H__
+#define FARSOUNDER_PROTOBUF_MATLAB_VARINT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+// Returns true if fields of the given FieldType are encoded as varints.
+bool IsVarintType(int type);
+
+// Returns the number of varints in buffer[0, size), that is the number of
+// bytes without the continuation bit.
+size_t CountVarints(const uint8_t* buffer, size_t size);
+
+// Decodes the varints in buffer[0, size) into values, which must have room
+// for CountVarints(buffer, size) elements of the Matlab class of type.
+// Returns the number of values decoded.  Throws CodecError if the buffer
+// ends in the middle of a varint or a varint is longer than 10 bytes.
+size_t DecodeVarints(int type, const uint8_t* buffer, size_t size,
+                     void* values);
+
+// Returns the number of bytes EncodeVarints writes for the given values.
+size_t VarintsSize(int type, const void* values, size_t count);
+
+// Encodes count values of the Matlab class of type into target, which must
+// have room for VarintsSize(type, values, count) bytes.  Returns the end of
+// the written bytes.
+uint8_t* EncodeVarints(int type, const void* values, size_t count,
+                       uint8_t* target);
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
+
+#endif  // FARSOUNDER_PROTOBUF_MATLAB_VARINT_H__
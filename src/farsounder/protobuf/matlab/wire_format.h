@@ -0,0 +1,121 @@
+// protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
+// Copyright (c) 2008, FarSounder Inc.  All rights reserved.
+// http://code.google.com/p/protobuf-matlab/
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+//     * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+//
+//     * Neither the name of the FarSounder Inc. nor the names of its
+// contributors may be used to endorse or promote products derived from this
+// software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+// The wire format primitives of the native codec, inline since they are
+// called for every value.  Shared by codec.cc and the codecs MatlabGenerator
+// writes with codec=generated.
+
+#ifndef FARSOUNDER_PROTOBUF_MATLAB_WIRE_FORMAT_H__
+#define FARSOUNDER_PROTOBUF_MATLAB_WIRE_FORMAT_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <farsounder/protobuf/matlab/codec.h>
+
+namespace farsounder {
+namespace protobuf {
+namespace matlab {
+
+const int kMaxVarintSize = 10;
+
+// Reads the varint at buffer[position], which must end before end, and
+// returns the position after it.
+inline size_t ReadVarint(const uint8_t* buffer, size_t position, size_t end,
+                         uint64_t* value) {
+  uint64_t result = 0;
+  for (int i = 0; i < kMaxVarintSize; ++i) {
+    if (position >= end) {
+      throw CodecError("proto:mex:truncated",
+                       "Buffer ends in the middle of a varint.");
+    }
+    uint8_t byte = buffer[position++];
+    result |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+    if (byte < 0x80) {
+      *value = result;
+      return position;
+    }
+  }
+  throw CodecError("proto:mex:malformed", "Varint is longer than 10 bytes.");
+}
+
+// Reads size bytes as a little endian integer.
+inline uint64_t ReadLittleEndian(const uint8_t* buffer, int size) {
+  uint64_t result = 0;
+  for (int i = size - 1; i >= 0; --i) {
+    result = (result << 8) | buffer[i];
+  }
+  return result;
+}
+
+inline size_t VarintSize(uint64_t value) {
+  size_t size = 1;
+  while (value >= 0x80) {
+    value >>= 7;
+    ++size;
+  }
+  return size;
+}
+
+inline uint8_t* WriteVarint(uint64_t value, uint8_t* target) {
+  while (value >= 0x80) {
+    *target++ = static_cast<uint8_t>(value | 0x80);
+    value >>= 7;
+  }
+  *target++ = static_cast<uint8_t>(value);
+  return target;
+}
+
+inline uint8_t* WriteLittleEndian(uint64_t value, int size,
+                                  uint8_t* target) {
+  for (int i = 0; i < size; ++i) {
+    *target++ = static_cast<uint8_t>(value >> (8 * i));
+  }
+  return target;
+}
+
+inline uint32_t MakeTag(uint32_t number, int wire_type) {
+  return (number << 3) | wire_type;
+}
+
+inline int64_t ZigZagDecode(uint64_t value) {
+  return static_cast<int64_t>((value >> 1) ^ (~(value & 1) + 1));
+}
+
+inline uint64_t ZigZagEncode(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+}  // namespace matlab
+}  // namespace protobuf
+}  // namespace farsounder
+
+#endif  // FARSOUNDER_PROTOBUF_MATLAB_WIRE_FORMAT_H__
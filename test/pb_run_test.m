@@ -6,6 +6,13 @@ function [msg, new_msg, buffer] = pb_run_test()
 %   is in no way a comprehensive test but just to catch obvious and common
 %   errors. It might report float roundoff errors due to the original being
 %   stored as doubles.
+%
+%   Run it with the output of protoc --matlab_out for test.proto on the path,
+%   once generated with the default options and once with read=specialized,
+%   so that both kinds of pb_read_* functions are checked.  Generated with
+%   codec=generated,repeated_messages=columns and with pb_codec_test.cc on
+%   the path too, the codec is built if needed and checked against
+%   pblib_mex_codec, including a field read as columns.
 
 %   protobuf-matlab - FarSounder's Protocol Buffer support for Matlab
 %   Copyright (c) 2008, FarSounder Inc.  All rights reserved.
@@ -59,6 +66,7 @@ function [msg, new_msg, buffer] = pb_run_test()
   msg.optional_nested_message = pblib_set(msg.optional_nested_message, 'bb', -2);
   msg = pblib_set(msg, 'optional_foreign_message', pb_read_test__ForeignMessage([]));
   msg.optional_foreign_message = pblib_set(msg.optional_foreign_message, 'c', 14098);
+  msg.optional_foreign_message = pblib_set(msg.optional_foreign_message, 'd', 77);
   msg = pblib_set(msg, 'optional_import_message', pb_read_test_import__ImportMessage([]));
   msg.optional_import_message = pblib_set(msg.optional_import_message, 'd', 98);
 
@@ -77,32 +85,313 @@ function [msg, new_msg, buffer] = pb_run_test()
   msg = pblib_set(msg, 'repeated_bool', [130498 9038]);
   msg = pblib_set(msg, 'repeated_string', {'asldfkj', 'asdlkfj'});
   msg = pblib_set(msg, 'repeated_bytes', {uint8('aslkdjlj'), uint8('hgsh')});
-  msg = pblib_set(msg, 'repeated_nested_message', ...
-                  [pb_read_test__TestAllTypes__NestedMessage([]) ...
-                   pb_read_test__TestAllTypes__NestedMessage([])]);
-  msg.repeated_nested_message(1) = pblib_set(msg.repeated_nested_message(1), 'bb', -2);
-  msg.repeated_nested_message(2) = pblib_set(msg.repeated_nested_message(2), 'bb', 12394087);
-  msg = pblib_set(msg, 'repeated_foreign_message', ...
-                  [pb_read_test__ForeignMessage([]) ...
-                   pb_read_test__ForeignMessage([])]);
-  msg.repeated_foreign_message(1) = pblib_set(msg.repeated_foreign_message(1), 'c', 14098);
-  msg.repeated_foreign_message(2) = pblib_set(msg.repeated_foreign_message(2), 'c', -90);
-  msg = pblib_set(msg, 'repeated_import_message', ...
-                  [pb_read_test_import__ImportMessage([]) ...
-                   pb_read_test_import__ImportMessage([])]);
-  msg.repeated_import_message(1) = pblib_set(msg.repeated_import_message(1), 'd', 98);
-  msg.repeated_import_message(2) = pblib_set(msg.repeated_import_message(2), 'd', 98);
+  nested = [pb_read_test__TestAllTypes__NestedMessage([]) ...
+            pb_read_test__TestAllTypes__NestedMessage([])];
+  nested(1) = pblib_set(nested(1), 'bb', -2);
+  nested(2) = pblib_set(nested(2), 'bb', 12394087);
+  msg = set_repeated_messages(msg, 'repeated_nested_message', nested);
+  foreign = [pb_read_test__ForeignMessage([]) pb_read_test__ForeignMessage([])];
+  foreign(1) = pblib_set(foreign(1), 'c', 14098);
+  foreign(2) = pblib_set(foreign(2), 'c', -90);
+  msg = set_repeated_messages(msg, 'repeated_foreign_message', foreign);
+  imported = [pb_read_test_import__ImportMessage([]) ...
+              pb_read_test_import__ImportMessage([])];
+  imported(1) = pblib_set(imported(1), 'd', 98);
+  imported(2) = pblib_set(imported(2), 'd', 98);
+  msg = set_repeated_messages(msg, 'repeated_import_message', imported);
+
+  msg = pblib_set(msg, 'packed_float', single(linspace(-1000, 1000, 1001)));
+  msg = pblib_set(msg, 'packed_double', [0.5 -20398.234089 1e300]);
+  msg = pblib_set(msg, 'packed_fixed32', uint32([0 1 4294967295]));
 
   buffer = pblib_generic_serialize_to_string(msg);
   new_msg = pb_read_test__TestAllTypes(buffer);
 
   check_msg_equal(msg, new_msg);
+  [two_buffer, num_written] = pblib_generic_serialize_to_buffer(msg, zeros([1 2 * length(buffer)], 'uint8'), 0);
+  [two_buffer, num_written] = pb_write_test__TestAllTypes(msg, two_buffer, num_written);
+  if (~isequal(two_buffer(1 : num_written), [buffer buffer]))
+    disp('serializing into a preallocated buffer gives different bytes');
+  end
+  % Lazily read messages decode message and bytes fields in pblib_get
+  lazy_msg = pb_read_test__TestAllTypes(buffer, 1, length(buffer), true);
+  if (~isequal(pblib_generic_serialize_to_string(lazy_msg), buffer))
+    disp('a lazily read message serializes differently');
+  end
+  % and is written back unchanged by the write function, with and without mex
+  mex_enabled = pblib_mex_available();
+  pblib_mex_available(false);
+  m_lazy_buffer = pb_write_test__TestAllTypes(lazy_msg);
+  pblib_mex_available(mex_enabled);
+  if (~isequal(m_lazy_buffer, buffer) || ...
+      ~isequal(pb_write_test__TestAllTypes(lazy_msg), buffer) || ...
+      ~isequal(pblib_write_batch(lazy_msg), [pblib_write_varint(uint64(length(buffer))) buffer]))
+    disp('pb_write_test__TestAllTypes writes a lazily read message differently');
+  end
+  [foreign_message, lazy_msg] = pblib_get(lazy_msg, 'optional_foreign_message');
+  check_msg_equal(msg.optional_foreign_message, foreign_message);
+  check_msg_equal(msg.optional_foreign_message, lazy_msg.optional_foreign_message);
+  [repeated_bytes, lazy_msg] = pblib_get(lazy_msg, 'repeated_bytes');
+  if (~isequal(repeated_bytes, msg.repeated_bytes) || ...
+      ~isequal(pblib_get(lazy_msg, 'optional_bytes'), msg.optional_bytes))
+    disp('pblib_get decodes bytes fields differently');
+  end
+  % Read only some of the fields
+  projection = pblib_field_projection(@pb_descriptor_test__TestAllTypes, ...
+                                      {'optional_int32', 'optional_foreign_message.d', 14});
+  projected_msg = pblib_read_fields(@pb_descriptor_test__TestAllTypes, projection, buffer);
+  if (projected_msg.optional_int32 ~= msg.optional_int32 || ...
+      projected_msg.optional_foreign_message.d ~= msg.optional_foreign_message.d || ...
+      ~isequal(projected_msg.optional_string, msg.optional_string) || ...
+      projected_msg.has_field(2) || projected_msg.optional_foreign_message.has_field(1))
+    disp('pblib_read_fields read the wrong fields');
+  end
+  [float_column, default_column] = pblib_extract_columns(@pb_descriptor_test__TestAllTypes, ...
+      {'optional_float', 'default_double'}, {buffer, buffer});
+  if (~isequal(float_column, single([msg.optional_float msg.optional_float])) || ...
+      ~isequal(default_column, [52e3 52e3]))
+    disp('pblib_extract_columns read the wrong values from buffers');
+  end
+  batch_msgs = [pblib_read_batch(@pb_descriptor_test__TestAllTypes, {buffer, buffer}) ...
+                pblib_read_batch(@pb_descriptor_test__TestAllTypes, [buffer buffer], ...
+                                 [1 length(buffer) + 1], [length(buffer) 2 * length(buffer)])];
+  if (length(batch_msgs) ~= 4)
+    disp('pblib_read_batch read the wrong number of messages');
+  end
+  for i=1:length(batch_msgs)
+    check_msg_equal(msg, batch_msgs(i));
+  end
+  if (~isequal(pblib_write_batch([msg msg]), ...
+               repmat([pblib_write_varint(uint64(length(buffer))) buffer], 1, 2)))
+    disp('pblib_write_batch wrote different bytes');
+  end
+  if (~islogical(new_msg.has_field) || ~isequal(new_msg.has_field, msg.has_field))
+    disp('has_field differs after reading the message back');
+  end
+
+  % Write the message to a file of length delimited messages and read it back
+  filename = [tempname() '.pb'];
+  writer = pblib_delimited_writer_open(filename, 64);
+  writer = pblib_delimited_writer_write(writer, [msg msg]);
+  writer = pblib_delimited_writer_write(writer, msg);
+  pblib_delimited_writer_close(writer);
+  fid = fopen(filename, 'r');
+  file_bytes = fread(fid, Inf, '*uint8')';
+  fclose(fid);
+  if (~isequal(file_bytes, repmat([pblib_write_varint(uint64(length(buffer))) buffer], 1, 3)))
+    disp('pblib_delimited_writer_write wrote different bytes');
+  end
+  reader = pblib_delimited_reader_open(filename, @pb_read_test__TestAllTypes, 64);
+  [delimited_msgs, reader] = pblib_delimited_reader_next(reader, 2);
+  [last_msg, reader] = pblib_delimited_reader_next(reader, 2);
+  pblib_delimited_reader_close(reader);
+  % Read again without a background thread
+  reader = pblib_delimited_reader_open(filename, @pb_read_test__TestAllTypes, 64, 0);
+  [unqueued_msgs, reader] = pblib_delimited_reader_next(reader, 4);
+  pblib_delimited_reader_close(reader);
+  index = pblib_delimited_index_load(filename);
+  indexed_msgs = pblib_delimited_index_read(index, @pb_read_test__TestAllTypes, [3 1 2]);
+  mapped_msgs = pblib_read_mapped_file(filename, @pb_descriptor_test__TestAllTypes, ...
+                                       index.offsets + 1, index.offsets + index.lengths);
+  [int32_column, d_column] = pblib_extract_columns(@pb_descriptor_test__TestAllTypes, ...
+      {'optional_int32', 'optional_foreign_message.d'}, filename);
+  if (~isa(int32_column, 'int32') || ~isequal(int32_column, repmat(msg.optional_int32, 1, 3)) || ...
+      ~isequal(d_column, repmat(msg.optional_foreign_message.d, 1, 3)))
+    disp('pblib_extract_columns read the wrong values from a file');
+  end
+  % Rewrite the file with other messages, longer than before but starting
+  % with a different optional_int32, so that the index no longer matches it.
+  % The writer appends, so the old file is deleted first; its index is kept.
+  rewritten_msg = pblib_set(msg, 'optional_int32', 34);
+  delete(filename);
+  writer = pblib_delimited_writer_open(filename, 64);
+  writer = pblib_delimited_writer_write(writer, repmat(rewritten_msg, 1, 4));
+  pblib_delimited_writer_close(writer);
+  rewritten_index = pblib_delimited_index_load(filename);
+  rewritten_msgs = pblib_delimited_index_read(rewritten_index, @pb_read_test__TestAllTypes, 1:4);
+  if (length(rewritten_index.offsets) ~= 4 || ...
+      ~isequal([rewritten_msgs.optional_int32], repmat(int32(34), 1, 4)))
+    disp('pblib_delimited_index_load kept the index of a rewritten file');
+  end
+  delete(filename);
+  delete([filename '.idx']);
+  if (length(index.offsets) ~= 3 || length(indexed_msgs) ~= 3)
+    disp('pblib_delimited_index_load found the wrong number of messages');
+  end
+  for i=1:length(indexed_msgs)
+    check_msg_equal(msg, indexed_msgs(i));
+  end
+  for i=1:length(mapped_msgs)
+    check_msg_equal(msg, mapped_msgs(i));
+  end
+  delimited_msgs = [delimited_msgs last_msg];
+  if (length(delimited_msgs) ~= 3)
+    disp('pblib_delimited_reader_next read the wrong number of messages');
+  end
+  for i=1:length(delimited_msgs)
+    check_msg_equal(msg, delimited_msgs(i));
+  end
+  if (length(unqueued_msgs) ~= 3)
+    disp('pblib_delimited_reader_next read the wrong number of messages without a queue');
+  end
+  for i=1:length(unqueued_msgs)
+    check_msg_equal(msg, unqueued_msgs(i));
+  end
+
+  % Repeated messages read as columns are written as message structs
+  nested = pblib_columns_to_struct(struct('bb', int32([3 -4])), ...
+                                   @pb_descriptor_test__TestAllTypes__NestedMessage);
+  if (length(nested) ~= 2 || nested(2).bb ~= -4 || ~all(nested(2).has_field))
+    disp('pblib_columns_to_struct converted the columns incorrectly');
+  end
+  columns_msg = set_repeated_messages(pb_read_test__TestAllTypes(), ...
+                                      'repeated_nested_message', nested);
+  columns_msg = pb_read_test__TestAllTypes(pb_write_test__TestAllTypes(columns_msg));
+  if (~isequal([columns_msg.repeated_nested_message.bb], int32([3 -4])))
+    disp('messages from pblib_columns_to_struct did not serialize correctly');
+  end
+
+  % Empty strings and bytes have the shapes pblib_generic_parse_from_string
+  % gives them, also when read by the .m code
+  empty_msg = pblib_set(pb_read_test__TestAllTypes([]), 'optional_string', '');
+  empty_msg = pblib_set(empty_msg, 'optional_bytes', uint8([]));
+  empty_msg = pblib_set(empty_msg, 'repeated_string', {'', 'a'});
+  empty_buffer = pblib_generic_serialize_to_string(empty_msg);
+  generic_empty_msg = pblib_generic_parse_from_string(empty_buffer, pb_descriptor_test__TestAllTypes());
+  mex_enabled = pblib_mex_available();
+  pblib_mex_available(false);
+  m_empty_msg = pb_read_test__TestAllTypes(empty_buffer);
+  pblib_mex_available(mex_enabled);
+  if (~isequal(size(m_empty_msg.optional_string), size(generic_empty_msg.optional_string)) || ...
+      ~isequal(size(m_empty_msg.optional_bytes), size(generic_empty_msg.optional_bytes)) || ...
+      ~isequal(size(m_empty_msg.repeated_string{1}), size(generic_empty_msg.repeated_string{1})) || ...
+      ~isequal(m_empty_msg.has_field, generic_empty_msg.has_field))
+    disp('pb_read_test__TestAllTypes reads empty strings with different shapes');
+  end
+
+  % Compare the mex codec against the .m implementation
+  if (pblib_mex_available())
+    pblib_mex_available(false);
+    m_buffer = pb_write_test__TestAllTypes(new_msg);
+    m_msg = pb_read_test__TestAllTypes(m_buffer);
+    pblib_mex_available(true);
+    mex_buffer = pb_write_test__TestAllTypes(new_msg);
+    if (~isequal(mex_buffer, m_buffer))
+      disp('pblib_mex_codec and pb_write_test__TestAllTypes serialize differently');
+    end
+    check_msg_equal(m_msg, pb_read_test__TestAllTypes(mex_buffer));
+    % the .m code hands packed varints to the mex function
+    generic_msg = pblib_generic_parse_from_string(...
+        mex_buffer, pb_descriptor_test__TestAllTypes());
+    generic_msg.descriptor_function = @pb_descriptor_test__TestAllTypes;
+    check_msg_equal(m_msg, generic_msg);
+    if (~isequal(pblib_generic_serialize_to_string(generic_msg), m_buffer))
+      disp('packed fields serialize differently through pblib_mex_codec');
+    end
+    % a batch large enough to be parsed on several threads
+    count = ceil(2^21 / length(mex_buffer));
+    big_buffer = repmat(mex_buffer, 1, count);
+    ends = (1:count) * length(mex_buffer);
+    starts = ends - length(mex_buffer) + 1;
+    threads = pblib_mex_codec('threads', 1);
+    one_thread = pblib_read_batch(@pb_descriptor_test__TestAllTypes, ...
+        big_buffer, starts, ends);
+    pblib_mex_codec('threads', max(threads, 2));
+    if (~isequal(one_thread, pblib_read_batch(...
+        @pb_descriptor_test__TestAllTypes, big_buffer, starts, ends)))
+      disp('pblib_mex_codec parses differently on several threads');
+    end
+    pblib_mex_codec('threads', 0);
+  end
+
+  % Read messages back from a shared memory ring, once keeping up with the
+  % producer and once after falling a whole ring behind
+  if (pblib_mex_available() && isunix())
+    ring_name = sprintf('/pb_run_test_%d', floor(rand() * 1e9));
+    ring_buffers = cell(1, 13);
+    for i=1:length(ring_buffers)
+      ring_buffers{i} = pb_write_test__TestAllTypes(pblib_set(msg, 'optional_int32', i));
+    end
+    % room for four messages
+    ring = pblib_mex_codec('ring_create', ring_name, 4 * (length(ring_buffers{1}) + 8));
+    reader = pblib_ring_reader_open(ring_name, @pb_descriptor_test__TestAllTypes);
+    for i=1:3
+      pblib_mex_codec('ring_write', ring, ring_buffers{i});
+    end
+    [ring_msgs, reader, dropped] = pblib_ring_reader_next(reader, 2);
+    [last_ring_msgs, reader, last_dropped] = pblib_ring_reader_next(reader);
+    ring_msgs = [ring_msgs last_ring_msgs];
+    if (~isequal([ring_msgs.optional_int32], int32(1:3)) || dropped ~= 0 || last_dropped ~= 0)
+      disp('pblib_ring_reader_next read the wrong messages from a ring');
+    end
+    for i=4:13
+      pblib_mex_codec('ring_write', ring, ring_buffers{i});
+    end
+    [lapped_msgs, reader, dropped] = pblib_ring_reader_next(reader);
+    if (length(lapped_msgs) ~= 1 || lapped_msgs.optional_int32 ~= 13 || dropped ~= 9)
+      disp('pblib_ring_reader_next did not skip to the newest message after a lap');
+    end
+    for i=1:length(ring_msgs)
+      check_msg_equal(pblib_set(msg, 'optional_int32', i), ring_msgs(i));
+    end
+    pblib_ring_reader_close(reader);
+    pblib_mex_codec('ring_close', ring);
+    pblib_mex_codec('ring_unlink', ring_name);
+  end
+
+  % Compare the codec generated with codec=generated against pblib_mex_codec
+  % and the .m implementation, building it first if needed
+  if (pblib_mex_available() && exist('pb_codec_test.cc', 'file'))
+    if (exist('pb_codec_test', 'file') ~= 3)
+      pblib_build_codec(which('pb_codec_test.cc'));
+    end
+    % columns_msg has a columns field when generated with repeated_messages=columns
+    codec_msgs = {new_msg, columns_msg};
+    for i=1:length(codec_msgs)
+      codec_buffer = pb_codec_test('write', 'test.TestAllTypes', codec_msgs{i});
+      pblib_mex_available(false);
+      m_buffer = pb_write_test__TestAllTypes(codec_msgs{i});
+      m_msg = pb_read_test__TestAllTypes(m_buffer);
+      pblib_mex_available(true);
+      if (~isequal(codec_buffer, m_buffer) || ...
+          ~isequal(codec_buffer, pblib_mex_codec('serialize', codec_msgs{i}, ...
+                                                  pb_descriptor_test__TestAllTypes())))
+        disp('pb_codec_test serializes differently from pblib_mex_codec and the .m code');
+      end
+      codec_msg = pb_codec_test('read', 'test.TestAllTypes', m_buffer);
+      mex_msg = pblib_mex_codec('parse', m_buffer, pb_descriptor_test__TestAllTypes());
+      mex_msg.descriptor_function = @pb_descriptor_test__TestAllTypes;
+      check_msg_equal(m_msg, codec_msg);
+      check_msg_equal(mex_msg, codec_msg);
+    end
+  end
+
+function msg = set_repeated_messages(msg, field_name, msgs)
+  % Sets a repeated message field from a struct array of messages, or from
+  % their columns when the field is read as columns
+  d = msg.descriptor_function();
+  field = d.fields(strcmp({d.fields.name}, field_name));
+  if (field.options.columns)
+    values = struct();
+    message_descriptor = field.descriptor_function();
+    for i=1:length(message_descriptor.fields)
+      name = message_descriptor.fields(i).name;
+      values.(name) = [msgs.(name)];
+    end
+  else
+    values = msgs;
+  end
+  msg = pblib_set(msg, field_name, values);
 
 function check_msg_equal(old_msg, new_msg)
   d = new_msg.descriptor_function();
   for i=1:length(d.fields)
     field = d.fields(i);
-    if (field.label == 3) % repeated
+    if (field.options.columns)
+      if (~isequal(old_msg.(field.name), new_msg.(field.name)))
+        disp([field.name ': columns differ']);
+      end
+    elseif (field.label == 3) % repeated
       for j=1:length(old_msg.(field.name))
         if (field.matlab_type == 7 || field.matlab_type == 8)
           old_val = old_msg.(field.name){j};